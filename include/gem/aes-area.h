@@ -19,6 +19,15 @@ static inline bool aes_point_within_area(const struct aes_point p,
 	       p.y <  area.p.y + area.r.h;
 }
 
+static inline bool aes_area_within_area(const struct aes_area a,
+	const struct aes_area b)
+{
+	return a.p.x >= b.p.x &&
+	       a.p.y >= b.p.y &&
+	       a.p.x + a.r.w <= b.p.x + b.r.w &&
+	       a.p.y + a.r.h <= b.p.y + b.r.h;
+}
+
 typedef struct aes_area (*aes_area_justify_rectangle_f)(
 	const struct aes_rectangle rectangle,
 	const struct aes_area area);
@@ -0,0 +1,14 @@
+// SPDX-License-Identifier: LGPL-2.1
+/*
+ * Copyright (C) 2022 Fredrik Noring
+ */
+
+#ifndef _GEM_AES_ATLAS_H
+#define _GEM_AES_ATLAS_H
+
+#include "aes.h"
+
+bool aes_atlas_pack(struct aes_rectangle *size,
+	struct aes_area *areas, const size_t count, const int width);
+
+#endif /* _GEM_AES_ATLAS_H */
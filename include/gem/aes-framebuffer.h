@@ -0,0 +1,32 @@
+// SPDX-License-Identifier: LGPL-2.1
+/*
+ * Copyright (C) 2022 Fredrik Noring
+ */
+
+#ifndef _GEM_AES_FRAMEBUFFER_H
+#define _GEM_AES_FRAMEBUFFER_H
+
+#include "aes.h"
+#include "aes-surface.h"
+
+/**
+ * struct aes_framebuffer - surface of memory mapped file
+ * @size: size in bytes of @map
+ * @map: memory mapping of the file
+ * @surface: surface within @map
+ */
+struct aes_framebuffer {
+	size_t size;
+	void *map;
+	struct aes_surface surface;
+};
+
+bool aes_framebuffer_open(struct aes_framebuffer *fb, const char *path,
+	const struct aes_surface *surface);
+
+bool aes_framebuffer_open_fd(struct aes_framebuffer *fb, int fd,
+	const struct aes_surface *surface);
+
+void aes_framebuffer_close(struct aes_framebuffer *fb);
+
+#endif /* _GEM_AES_FRAMEBUFFER_H */
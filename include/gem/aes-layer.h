@@ -7,6 +7,7 @@
 #define _GEM_AES_LAYER_H
 
 #include "aes.h"
+#include "aes-region.h"
 
 struct aes_object_shape_layer {
 	struct aes_object_shape_layer *next;
@@ -16,6 +17,34 @@ struct aes_object_shape_layer {
 typedef bool (*aes_object_shape_layer_f)(const struct aes_area clip,
 	const struct aes_object_shape_layer *layers, void *arg);
 
+/**
+ * struct aes_object_shape_layer_arena - memory for layers and clip fragments
+ * @size: size in bytes of @data
+ * @data: layers followed by the work stack of clip fragments
+ *
+ * The arena can be initialised to zero, and reused for any number of calls
+ * to aes_object_shape_layers_arena() to avoid repeated allocations. Given
+ * n overlapping layers, the arena never exceeds n layers and 5 * n + 1
+ * clip fragments, regardless of how deeply objects are nested.
+ */
+struct aes_object_shape_layer_arena {
+	size_t size;
+	void *data;
+};
+
+bool aes_object_shape_layers_arena(struct aes_area clip,
+	struct aes_object_shape_iterator *iterator,
+	const aes_object_shape_layer_f f, void *arg,
+	struct aes_object_shape_layer_arena *arena);
+
+bool aes_object_shape_layers_region(const struct aes_region *region,
+	struct aes_object_shape_iterator *iterator,
+	const aes_object_shape_layer_f f, void *arg,
+	struct aes_object_shape_layer_arena *arena);
+
+void aes_object_shape_layer_arena_free(
+	struct aes_object_shape_layer_arena *arena);
+
 bool aes_object_shape_layers(struct aes_area clip,
 	struct aes_object_shape_iterator *iterator,
 	const aes_object_shape_layer_f f, void *arg);
@@ -11,4 +11,6 @@
 int aes_object_shape_pixel(aes_id_t aes_id, const struct aes_point p,
 	const struct aes_object_shape *shape);
 
+bool aes_object_shape_selection_inverts(const struct aes_object_shape *shape);
+
 #endif /* _GEM_AES_PIXEL_H */
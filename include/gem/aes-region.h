@@ -0,0 +1,99 @@
+// SPDX-License-Identifier: LGPL-2.1
+/*
+ * Copyright (C) 2022 Fredrik Noring
+ */
+
+#ifndef _GEM_AES_REGION_H
+#define _GEM_AES_REGION_H
+
+#include "aes.h"
+
+/**
+ * struct aes_region - region of nonoverlapping areas
+ * @count: number of areas
+ * @capacity: maximum number of areas before @areas must be reallocated
+ * @areas: areas sorted in bands
+ *
+ * The areas are sorted from top to bottom in y-bands, where all areas of
+ * a band have the same vertical position and height, and then from left
+ * to right. Areas in a band never touch, and adjacent bands with identical
+ * horizontal spans are coalesced into one band. Hence, every region has
+ * a unique and minimal representation.
+ *
+ * The region can be initialised to zero, which is the empty region.
+ */
+struct aes_region {
+	size_t count;
+	size_t capacity;
+	struct aes_area *areas;
+};
+
+#define aes_for_each_region_area(area_, region_)			\
+	for (size_t i__ = 0;						\
+	     i__ < (region_)->count &&					\
+		(*(area_) = (region_)->areas[i__], true);		\
+	     i__++)
+
+static inline bool aes_region_empty(const struct aes_region *region)
+{
+	return !region->count;
+}
+
+void aes_region_free(struct aes_region *region);
+
+bool aes_region_from_area(struct aes_region *region,
+	const struct aes_area area);
+
+bool aes_region_copy(struct aes_region *region, const struct aes_region *a);
+
+/**
+ * aes_region_union - union of two regions
+ * @region: resulting region, that may be the same as @a or @b
+ * @a: first region
+ * @b: second region
+ *
+ * Return: %true on success, otherwise %false if memory allocation failed,
+ * 	in which case @region is unchanged
+ */
+bool aes_region_union(struct aes_region *region,
+	const struct aes_region *a, const struct aes_region *b);
+
+/**
+ * aes_region_intersection - intersection of two regions
+ * @region: resulting region, that may be the same as @a or @b
+ * @a: first region
+ * @b: second region
+ *
+ * Return: %true on success, otherwise %false if memory allocation failed,
+ * 	in which case @region is unchanged
+ */
+bool aes_region_intersection(struct aes_region *region,
+	const struct aes_region *a, const struct aes_region *b);
+
+/**
+ * aes_region_subtract - subtraction of two regions
+ * @region: resulting region, that may be the same as @a or @b
+ * @a: region to subtract from
+ * @b: region to subtract
+ *
+ * Return: %true on success, otherwise %false if memory allocation failed,
+ * 	in which case @region is unchanged
+ */
+bool aes_region_subtract(struct aes_region *region,
+	const struct aes_region *a, const struct aes_region *b);
+
+bool aes_region_union_area(struct aes_region *region,
+	const struct aes_area area);
+
+bool aes_region_intersection_area(struct aes_region *region,
+	const struct aes_area area);
+
+bool aes_region_subtract_area(struct aes_region *region,
+	const struct aes_area area);
+
+struct aes_area aes_region_bounds(const struct aes_region *region);
+
+bool aes_point_within_region(const struct aes_point p,
+	const struct aes_region *region);
+
+#endif /* _GEM_AES_REGION_H */
@@ -7,12 +7,33 @@
 #define _GEM_AES_RSC_H
 
 #include "aes.h"
+#include "aes-region.h"
+#include "aes-surface.h"
 #include "rsc.h"
 
 struct aes_object_shape aes_rsc_object_shape(aes_id_t aes_id,
 	const struct aes_point p, const struct rsc_object *ro,
 	const struct rsc *rsc);
 
+struct aes_point aes_rsc_object_origin(aes_id_t aes_id,
+	int16_t ob, const struct rsc_object *tree);
+
+struct aes_object_shape aes_rsc_tree_object_shape(aes_id_t aes_id,
+	const int16_t ob, const struct rsc_object *tree,
+	const struct rsc *rsc);
+
+bool aes_rsc_object_damage(aes_id_t aes_id, struct aes_region *damage,
+	const int16_t ob, const struct rsc_object *tree,
+	const struct rsc *rsc);
+
+bool aes_rsc_object_selection_region(aes_id_t aes_id,
+	struct aes_region *region, const int16_t ob,
+	const struct rsc_object *tree, const struct rsc *rsc);
+
+bool aes_rsc_object_toggle_selected(aes_id_t aes_id,
+	const struct aes_surface *surface, const int16_t ob,
+	struct rsc_object *tree, const struct rsc *rsc);
+
 int16_t aes_rsc_tree_traverse_with_origin(aes_id_t aes_id,
 	struct aes_point *origin, int16_t ob, const struct rsc_object *tree);
 
@@ -7,10 +7,14 @@
 #define _GEM_AES_SHAPE_H
 
 #include "aes.h"
+#include "aes-region.h"
 
 struct aes_area aes_object_shape_bounds(
 	struct aes_object_shape_iterator *iterator);
 
+bool aes_object_shape_damage(struct aes_region *damage,
+	const struct aes_object_shape *shape);
+
 bool aes_find_object_shape(struct aes_object_shape *shape,
 	const struct aes_point p, struct aes_object_shape_iterator *iterator);
 
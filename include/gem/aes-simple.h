@@ -31,6 +31,8 @@ struct aes_object_simple_shape_enumerator aes_object_next_simple_shape(
 	struct aes_object_shape *simple, const struct aes_object_shape shape,
 	struct aes_object_simple_shape_enumerator e);
 
+bool aes_object_simple_shape_opaque(const struct aes_object_shape *simple);
+
 struct aes_object_simple_shape_iterator_arg {
 	struct aes_object_shape shape;
 	struct aes_object_shape_iterator iterator;
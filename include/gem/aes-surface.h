@@ -0,0 +1,145 @@
+// SPDX-License-Identifier: LGPL-2.1
+/*
+ * Copyright (C) 2022 Fredrik Noring
+ */
+
+#ifndef _GEM_AES_SURFACE_H
+#define _GEM_AES_SURFACE_H
+
+#include "aes.h"
+#include "aes-layer.h"
+#include "aes-region.h"
+
+/*
+ * Pixel formats of surfaces. Packed pixels of less than 8 bits have the
+ * leftmost pixel in the most significant bits of a byte. Aligned pixels
+ * of 8 bits or more are stored in native byte order. Planar pixels are
+ * interleaved bitplanes as with the Atari ST, where every group of 16
+ * pixels is a big-endian 16-bit word for each plane in turn, with the
+ * least significant bit of the palette index in the first plane.
+ */
+#define AES_SURFACE_FORMAT(f)						\
+	f(INDEXED1,  indexed1,  1, PACKED)  /* 1 bit palette index */	\
+	f(INDEXED4,  indexed4,  4, PACKED)  /* 4 bit palette index */	\
+	f(INDEXED8,  indexed8,  8, ALIGNED) /* 8 bit palette index */	\
+	f(RGB565,    rgb565,   16, ALIGNED) /* 5:6:5 bit RGB */	\
+	f(XRGB8888,  xrgb8888, 32, ALIGNED) /* 8 bit X, R, G and B */	\
+	f(RGBA16,    rgba16,   64, ALIGNED) /* 16 bit R, G, B and A */	\
+	f(PLANAR1,   planar1,   1, PLANAR)  /* 1 bitplane */		\
+	f(PLANAR2,   planar2,   2, PLANAR)  /* 2 interleaved bitplanes */\
+	f(PLANAR4,   planar4,   4, PLANAR)  /* 4 interleaved bitplanes */
+
+enum aes_surface_format {
+#define AES_SURFACE_FORMAT_ENUM(symbol_, label_, bpp_, layout_)	\
+	AES_SURFACE_FORMAT_ ## symbol_,
+AES_SURFACE_FORMAT(AES_SURFACE_FORMAT_ENUM)
+};
+
+enum aes_surface_layout {
+	AES_SURFACE_LAYOUT_PACKED,
+	AES_SURFACE_LAYOUT_ALIGNED,
+	AES_SURFACE_LAYOUT_PLANAR,
+};
+
+/**
+ * struct aes_surface - pixels in memory
+ * @format: pixel format
+ * @area: area in AES coordinates that the surface covers
+ * @scale: number of pixels in each direction per AES coordinate, where
+ * 	zero is the same as one
+ * @reduction: number of AES coordinates in each direction per pixel of a
+ * 	thumbnail, where zero is the same as one, in which case @scale is
+ * 	ignored
+ * @stride: number of bytes from the start of one row to the next
+ * @data: first pixel of the top row
+ */
+struct aes_surface {
+	enum aes_surface_format format;
+	struct aes_area area;
+	int scale;
+	int reduction;
+	size_t stride;
+	void *data;
+};
+
+static inline int aes_surface_reduction(const struct aes_surface *surface)
+{
+	return surface->reduction > 1 ? surface->reduction : 1;
+}
+
+static inline int aes_surface_scale(const struct aes_surface *surface)
+{
+	return surface->scale > 1 &&
+		aes_surface_reduction(surface) == 1 ? surface->scale : 1;
+}
+
+/**
+ * aes_surface_size - width and height in pixels of a surface
+ * @surface: surface
+ *
+ * Return: size of the area of @surface in pixels
+ */
+static inline struct aes_rectangle aes_surface_size(
+	const struct aes_surface *surface)
+{
+	const int reduction = aes_surface_reduction(surface);
+	const int scale = aes_surface_scale(surface);
+
+	return (struct aes_rectangle) {
+		.w = (scale * surface->area.r.w + reduction - 1) / reduction,
+		.h = (scale * surface->area.r.h + reduction - 1) / reduction
+	};
+}
+
+struct aes_surface_palette;
+
+/**
+ * struct aes_surface_arena - memory for drawing surfaces
+ * @layer: memory for layers
+ * @format: pixel format of @palette
+ * @palette: palette encoded in @format, or %NULL
+ * @size: size in bytes of @row
+ * @row: row buffers
+ *
+ * The arena can be initialised to zero, and reused for any number of calls
+ * to draw surfaces with the same AES, to avoid repeated allocations. The
+ * palette is encoded once, and again only if the pixel format changes.
+ */
+struct aes_surface_arena {
+	struct aes_object_shape_layer_arena layer;
+	enum aes_surface_format format;
+	struct aes_surface_palette *palette;
+	size_t size;
+	void *row;
+};
+
+void aes_surface_arena_free(struct aes_surface_arena *arena);
+
+int aes_surface_format_bpp(enum aes_surface_format format);
+
+enum aes_surface_layout aes_surface_format_layout(
+	enum aes_surface_format format);
+
+size_t aes_surface_format_stride(enum aes_surface_format format, int width);
+
+bool aes_surface_draw(aes_id_t aes_id, const struct aes_surface *surface,
+	struct aes_object_shape_iterator *iterator,
+	struct aes_surface_arena *arena);
+
+bool aes_surface_draw_region(aes_id_t aes_id,
+	const struct aes_surface *surface, const struct aes_region *region,
+	struct aes_object_shape_iterator *iterator,
+	struct aes_surface_arena *arena);
+
+bool aes_surface_draw_thumbnail(aes_id_t aes_id,
+	const struct aes_surface *surface, const int samples,
+	struct aes_object_shape_iterator *iterator,
+	struct aes_surface_arena *arena);
+
+void aes_surface_invert_area(const struct aes_surface *surface,
+	const struct aes_area area);
+
+void aes_surface_invert_region(const struct aes_surface *surface,
+	const struct aes_region *region);
+
+#endif /* _GEM_AES_SURFACE_H */
@@ -0,0 +1,77 @@
+// SPDX-License-Identifier: LGPL-2.1
+/*
+ * Copyright (C) 2022 Fredrik Noring
+ */
+
+#ifndef _GEM_AES_TEXT_H
+#define _GEM_AES_TEXT_H
+
+#include "aes.h"
+#include "fnt.h"
+
+/**
+ * struct aes_text - layout of a string in a font
+ * @key: address of the laid out string
+ * @fnt: font of the layout
+ * @length: number of characters
+ * @capacity: number of characters that @s and @x have room for
+ * @s: copy of the string, to detect changes at the same address, allocated
+ * 	together with @x
+ * @x: prefix sums of glyph advances, with @x[i] the horizontal offset in
+ * 	pixels of character i and @x[@length] the width of the text
+ * @used: clock of the cache when the layout was last used
+ */
+struct aes_text {
+	const char *key;
+	const struct fnt *fnt;
+	size_t length;
+	size_t capacity;
+	char *s;
+	int *x;
+	uint64_t used;
+};
+
+#define AES_TEXT_CACHE_BITS 7
+#define AES_TEXT_CACHE_SETS (1 << AES_TEXT_CACHE_BITS)
+#define AES_TEXT_CACHE_WAYS 2
+
+/**
+ * struct aes_text_cache - two-way set associative cache of string layouts
+ * @text: sets of layouts indexed by a hash of the string address and font
+ * @clock: number of lookups, to replace the least recently used layout
+ */
+struct aes_text_cache {
+	struct aes_text text[AES_TEXT_CACHE_SETS][AES_TEXT_CACHE_WAYS];
+	uint64_t clock;
+};
+
+int aes_text_advance(uint16_t c, const struct fnt *fnt);
+
+const struct aes_text *aes_text_layout(aes_id_t aes_id,
+	const char *s, const struct fnt *fnt);
+
+/**
+ * aes_text_char_x - horizontal offset of a character of a layout
+ * @text: layout
+ * @i: index of character, or the length of the text for its width
+ * @spacing: pixels added to the advance of every character
+ *
+ * Return: horizontal offset in pixels of character @i
+ */
+static inline int aes_text_char_x(const struct aes_text *text,
+	const size_t i, const int spacing)
+{
+	return text->x[i] + (int)i * spacing;
+}
+
+static inline int aes_text_width(const struct aes_text *text,
+	const int spacing)
+{
+	return aes_text_char_x(text, text->length, spacing);
+}
+
+int aes_text_char_index(const struct aes_text *text, int x, int spacing);
+
+void aes_text_cache_free(aes_id_t aes_id);
+
+#endif /* _GEM_AES_TEXT_H */
@@ -27,8 +27,11 @@ struct aes_area {
 	struct aes_rectangle r;
 };
 
+struct aes_text_cache;
+
 struct aes {
 	vdi_id_t vdi_id;
+	struct aes_text_cache *text;
 };
 
 typedef struct {
@@ -78,9 +78,16 @@ int fnt_cmp(const struct fnt *a, const struct fnt *b);
 bool fnt_char_pixel(const int x, const int y,
 	const uint16_t c, const struct fnt *fnt);
 
+int fnt_char_bitmap(uint8_t *bitmap, size_t stride,
+	const uint16_t c, const struct fnt *fnt);
+
 bool fnt_char_lighten(const int x, const int y,
 	const uint16_t c, const struct fnt *fnt);
 
+void fnt_normalise_header(struct fnt_header *header);
+
+bool fnt_normalise(void *data, const size_t size);
+
 bool fnt_valid(const struct fnt *fnt);
 
 struct fnt_diagnostic {
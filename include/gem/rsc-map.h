@@ -70,4 +70,14 @@ bool rsc_map(struct rsc_map *map, const struct rsc *rsc);
 bool rsc_valid_map(const struct rsc *rsc,
 	const struct rsc_diagnostic *diagnostic, void *arg);
 
+struct rsc_lazy;
+
+struct rsc_lazy *rsc_lazy_open(const struct rsc *rsc,
+	const struct rsc_diagnostic *diagnostic, void *arg);
+
+struct rsc_object *rsc_lazy_tree_at_index(struct rsc_lazy *lazy,
+	const size_t i);
+
+void rsc_lazy_close(struct rsc_lazy *lazy);
+
 #endif /* _GEM_RSC_MAP_H */
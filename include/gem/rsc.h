@@ -278,6 +278,9 @@ struct rsc_diagnostic {
 	void (*error)(const char *msg, void *arg);
 };
 
+bool rsc_valid_header_diagnostic(const struct rsc *rsc,
+	const struct rsc_diagnostic *diagnostic, void *arg);
+
 bool rsc_valid_structure_diagnostic(const struct rsc *rsc,
 	const struct rsc_diagnostic *diagnostic, void *arg);
 
@@ -14,6 +14,8 @@
 
 struct vdi_;
 
+#define VDI_SYSTEM_FONT 1
+
 typedef struct { struct vdi_ *vdi; } vdi_id_t;
 
 /**
@@ -48,6 +50,24 @@ enum vdi_cs_type {
 	VDI_CS_TYPE_RC  = 2,
 };
 
+/*
+ * Text effects are bits as given to vst_effects(). Outlined and shadowed
+ * text are not supported.
+ */
+#define VDI_TEXT_EFFECT(e)						\
+	e(0, THICKEN,   thicken)					\
+	e(1, LIGHTEN,   lighten)					\
+	e(2, SKEW,      skew)						\
+	e(3, UNDERLINE, underline)
+
+enum vdi_text_effect {
+#define VDI_TEXT_EFFECT_ENUM(n_, symbol_, label_)			\
+	VDI_TEXT_EFFECT_ ## symbol_ = 1 << n_,
+VDI_TEXT_EFFECT(VDI_TEXT_EFFECT_ENUM)
+};
+
+#define VDI_TEXT_EFFECT_COUNT (VDI_TEXT_EFFECT_UNDERLINE << 1)
+
 struct vdi_workstation_default {
 	union {
 		struct {
@@ -126,4 +146,22 @@ bool vq_color(const vdi_id_t vdi_id, const int index, struct vdi_color *color);
 
 bool vdi_v_fontinit(vdi_id_t vdi_id, const struct fnt *fnt);
 
+int vst_load_fonts(vdi_id_t vdi_id, const char *path);
+
+struct fnt *vdi_fnt_lookup(vdi_id_t vdi_id, uint16_t id,
+	uint16_t point, uint16_t height);
+
+int16_t vst_font(vdi_id_t vdi_id, int16_t font);
+
+void vst_height(vdi_id_t vdi_id, int16_t height,
+	int16_t *char_width, int16_t *char_height,
+	int16_t *cell_width, int16_t *cell_height);
+
+struct fnt *vdi_text_fnt(vdi_id_t vdi_id);
+
+struct vdi_fnt_effect;
+
+const struct vdi_fnt_effect *vdi_fnt_effect(struct fnt *fnt,
+	unsigned int effects);
+
 #endif /* _GEM_VDI_H */
@@ -14,11 +14,58 @@
 
 #include "internal/list.h"
 
+/**
+ * struct vdi_fnt_effect - glyphs of a font with text effects applied
+ * @width: width in pixels of glyphs from the first character of the font,
+ * 	or zero if undefined
+ * @max_width: maximum width in pixels of @width
+ * @spacing: pixels added to the advance of every character, by thickening
+ * @overhang: pixels by which glyphs extend beyond their advance and
+ * 	spacing, by skewing, into the next character or after the text
+ * @stride: size in bytes of a glyph row
+ * @bitmap: rows of glyphs from the first character of the font, with the
+ * 	most significant bit first
+ */
+struct vdi_fnt_effect {
+	uint16_t *width;
+	int max_width;
+	int spacing;
+	int overhang;
+	size_t stride;
+	uint8_t *bitmap;
+};
+
+/**
+ * struct vdi_fnt - VDI font
+ * @fnt: font, normalised to little-endian form
+ * @effect: glyphs for every combination of text effects, made when first
+ * 	needed by vdi_fnt_effect()
+ * @list: font list entry
+ * @hash_next: next font in the registry bucket of face id, point size and
+ * 	cell height
+ * @face_next: next font in the registry bucket of face id
+ * @path: path of font file to map when the font is first selected, or
+ * 	%NULL for fonts given to vdi_v_fontinit()
+ * @map: mapped font file, or %NULL if not yet mapped
+ * @invalid: the font file failed to map or validate
+ * @index: header of the font file, with @fnt pointing to it until mapped
+ */
 struct vdi_fnt {
 	struct fnt fnt;
+	struct vdi_fnt_effect *effect[VDI_TEXT_EFFECT_COUNT];
 	struct list_head list;
+	struct vdi_fnt *hash_next;
+	struct vdi_fnt *face_next;
+
+	const char *path;
+	void *map;
+	bool invalid;
+	struct fnt_header index;
 };
 
+#define VDI_FNT_HASH_BITS 8
+#define VDI_FNT_HASH_SIZE (1 << VDI_FNT_HASH_BITS)
+
 struct vdi_ {
 	struct vdi_palette {
 		size_t count;
@@ -27,9 +74,36 @@ struct vdi_ {
 
 	struct {
 		struct list_head list;
+		struct vdi_fnt *hash[VDI_FNT_HASH_SIZE];
+		struct vdi_fnt *face[VDI_FNT_HASH_SIZE];
 		struct fnt *large;
 		struct fnt *small;
 	} font;
+
+	struct {
+		int16_t face;
+		int16_t height;
+		struct fnt *fnt;
+	} text;
 };
 
+static inline bool vdi_fnt_effect_char_pixel(const int x, const int y,
+	const uint16_t c, const struct fnt *fnt,
+	const struct vdi_fnt_effect *effect)
+{
+	if (c < fnt->header->first || c > fnt->header->last ||
+	    y < 0 || y >= fnt->header->bitmap_lines)
+		return false;
+
+	const size_t k = c - fnt->header->first;
+
+	if (x < 0 || x >= effect->width[k])
+		return false;
+
+	const uint8_t *r = &effect->bitmap[effect->stride *
+		(k * fnt->header->bitmap_lines + y)];
+
+	return (r[x / 8] & (0x80 >> (x % 8))) != 0;
+}
+
 #endif /* _GEM_VDI__H */
@@ -0,0 +1,22 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Copyright (C) 2022 Fredrik Noring
+ */
+
+#ifndef INTERNAL_DEFLATE_H
+#define INTERNAL_DEFLATE_H
+
+#include "types.h"
+
+uint32_t adler32(uint32_t adler, const void *buf, size_t nbyte);
+
+struct zlib_writer;
+
+struct zlib_writer *zlib_writer_open(
+	bool (*write)(const void *buf, size_t nbyte, void *arg), void *arg);
+
+bool zlib_writer_write(struct zlib_writer *d, const void *buf, size_t nbyte);
+
+bool zlib_writer_close(struct zlib_writer *d);
+
+#endif /* INTERNAL_DEFLATE_H */
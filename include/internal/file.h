@@ -42,4 +42,20 @@ ssize_t xwrite(int fd, const void *buf, size_t nbyte);
 
 const char *file_basename(const char *path);
 
+#define FILE_WRITER_BUFFER_SIZE	(1024 * 1024)
+
+struct file_writer;
+
+struct file_writer *file_writer_open(
+	bool (*write)(const void *buf, size_t nbyte, void *arg), void *arg);
+
+struct file_writer *file_writer_open_fd(int fd);
+
+void *file_writer_buffer(struct file_writer *writer, size_t size);
+
+bool file_writer_write(struct file_writer *writer,
+	const void *buf, size_t nbyte);
+
+bool file_writer_close(struct file_writer *writer);
+
 #endif /* INTERNAL_FILE_H */
@@ -0,0 +1,28 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Copyright (C) 2022 Fredrik Noring
+ */
+
+#ifndef INTERNAL_PNG_H
+#define INTERNAL_PNG_H
+
+#include "types.h"
+#include "tiff.h"
+
+struct png_image_f {
+	bool (*image)(uint16_t *width, uint16_t *height, void *arg);
+	bool (*row)(uint16_t y, uint16_t width, struct tiff_pixel *row, void *arg);
+	bool (*write)(const void *buf, size_t nbyte, void *arg);
+};
+
+bool png_image(const struct png_image_f *f, void *arg);
+
+struct png_image_file_f {
+	bool (*image)(uint16_t *width, uint16_t *height, void *arg);
+	bool (*row)(uint16_t y, uint16_t width, struct tiff_pixel *row, void *arg);
+};
+
+bool png_image_file(const char *path,
+	const struct png_image_file_f *f, void *arg);
+
+#endif /* INTERNAL_PNG_H */
@@ -95,6 +95,16 @@ struct strbuf {
 	char *s;
 };
 
+/**
+ * sbreserve - reserve space in a string buffer
+ * @sb: string buffer, can be initialised to zero
+ * @size: size in bytes to reserve after @sb->length, in addition to a
+ * 	terminating NUL
+ *
+ * Return: %true if successful, otherwise %false
+ */
+bool sbreserve(struct strbuf *sb, size_t size);
+
 /**
  * sbprintf - formatted output conversion to a string buffer
  * @sb: string buffer, can be initialised to zero
@@ -17,7 +17,7 @@ struct tiff_pixel {
 
 struct tiff_image_f {
 	bool (*image)(uint16_t *width, uint16_t *height, void *arg);
-	bool (*pixel)(uint16_t x, uint16_t y, struct tiff_pixel *pixel, void *arg);
+	bool (*row)(uint16_t y, uint16_t width, struct tiff_pixel *row, void *arg);
 	bool (*write)(const void *buf, size_t nbyte, void *arg);
 };
 
@@ -25,7 +25,7 @@ bool tiff_image(uint16_t n, const struct tiff_image_f *f, void *arg);
 
 struct tiff_image_file_f {
 	bool (*image)(uint16_t *width, uint16_t *height, void *arg);
-	bool (*pixel)(uint16_t x, uint16_t y, struct tiff_pixel *pixel, void *arg);
+	bool (*row)(uint16_t y, uint16_t width, struct tiff_pixel *row, void *arg);
 };
 
 bool tiff_image_file(const char *path, uint16_t n,
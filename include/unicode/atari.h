@@ -15,4 +15,8 @@ uint8_t utf32_to_charset_atari_st(unicode_t u, void *arg);
 
 bool utf8_valid_in_atari_st(const uint8_t *u, size_t length);
 
+uint8_t *charset_atari_st_to_utf8_string(const uint8_t *s, size_t length);
+
+uint8_t *utf8_to_charset_atari_st_string(const uint8_t *u, size_t length);
+
 #endif /* PSGPLAY_UNICODE_ATARI_ST_H */
@@ -7,6 +7,8 @@
 
 typedef uint32_t unicode_t;
 
+struct strbuf;
+
 int utf8_to_utf32(unicode_t *u, const uint8_t *s, size_t insize);
 
 int utf32_to_utf8(unicode_t u, uint8_t *s, size_t maxout);
@@ -18,6 +20,16 @@ ssize_t charset_to_utf8_string_length(const uint8_t *s, size_t length,
 
 ssize_t utf8_to_charset_string_length(const uint8_t *u, size_t length);
 
+size_t utf8_ascii_length(const uint8_t *s, size_t length);
+
+bool charset_to_utf8_strbuf(struct strbuf *sb,
+	const uint8_t *s, size_t length,
+	unicode_t (*charset_to_utf32)(uint8_t c, void *arg), void *arg);
+
+bool utf8_to_charset_strbuf(struct strbuf *sb,
+	const uint8_t *u, size_t length,
+	uint8_t (*utf32_to_charset)(unicode_t u, void *arg), void *arg);
+
 uint8_t *charset_to_utf8_string(const uint8_t *s, size_t length,
 	 unicode_t (*charset_to_utf32)(uint8_t c, void *arg), void *arg);
 
@@ -0,0 +1,96 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Copyright (C) 2022 Fredrik Noring
+ */
+
+#include <stdlib.h>
+
+#include <gem/aes-atlas.h>
+
+#include "internal/compare.h"
+
+static int atlas_cmp(const void *a_, const void *b_)
+{
+	const struct aes_area * const *a = a_;
+	const struct aes_area * const *b = b_;
+
+	/* Tallest first, then widest, then in the given order. */
+	return (*b)->r.h != (*a)->r.h ? (*b)->r.h - (*a)->r.h :
+	       (*b)->r.w != (*a)->r.w ? (*b)->r.w - (*a)->r.w :
+	       (*a > *b) - (*a < *b);
+}
+
+static int atlas_width(const struct aes_area *areas, const size_t count)
+{
+	uint64_t sum = 0;
+	int widest = 0;
+	int width = 0;
+
+	for (size_t i = 0; i < count; i++) {
+		sum += (uint64_t)areas[i].r.w * areas[i].r.h;
+		widest = max(widest, areas[i].r.w);
+	}
+
+	while ((uint64_t)width * width < sum)
+		width++;
+
+	return max(width, widest);
+}
+
+/**
+ * aes_atlas_pack - pack rectangles into an atlas
+ * @size: width and height of the atlas
+ * @areas: rectangles to pack, for which the positions are given
+ * @count: number of rectangles
+ * @width: width of the atlas, or zero for a square root of the sum of
+ * 	the rectangle areas, though not narrower than the widest rectangle
+ *
+ * Rectangles are packed on shelves from left to right, tallest first, and
+ * a new shelf is started below when a rectangle does not fit in the
+ * width. The packing is deterministic.
+ *
+ * Return: %true on success, otherwise %false if memory allocation failed
+ */
+bool aes_atlas_pack(struct aes_rectangle *size,
+	struct aes_area *areas, const size_t count, const int width)
+{
+	struct aes_area **order = malloc(max_t(size_t, count, 1) *
+		sizeof(*order));
+
+	if (!order)
+		return false;
+
+	for (size_t i = 0; i < count; i++)
+		order[i] = &areas[i];
+
+	qsort(order, count, sizeof(*order), atlas_cmp);
+
+	struct aes_point p = { };
+	int shelf = 0;
+
+	*size = (struct aes_rectangle) {
+		.w = width > 0 ? width : atlas_width(areas, count)
+	};
+
+	for (size_t i = 0; i < count; i++) {
+		struct aes_area *a = order[i];
+
+		if (p.x && p.x + a->r.w > size->w) {
+			p.x = 0;
+			p.y += shelf;
+			shelf = 0;
+		}
+
+		a->p = p;
+		p.x += a->r.w;
+		shelf = max(shelf, a->r.h);
+
+		size->w = max(size->w, p.x);
+	}
+
+	size->h = p.y + shelf;
+
+	free(order);
+
+	return true;
+}
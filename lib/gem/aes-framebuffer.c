@@ -0,0 +1,220 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Copyright (C) 2022 Fredrik Noring
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/fb.h>
+#endif
+
+#include <gem/aes-framebuffer.h>
+
+#include "internal/file.h"
+
+#ifdef __linux__
+static bool aes_framebuffer_fbdev_format(enum aes_surface_format *format,
+	const struct fb_fix_screeninfo *fix,
+	const struct fb_var_screeninfo *var)
+{
+	if (fix->type == FB_TYPE_INTERLEAVED_PLANES) {
+		if (fix->type_aux != 2)
+			return false;	/* Plane words must be 16 bits */
+
+		switch (var->bits_per_pixel) {
+		case 1:
+			*format = AES_SURFACE_FORMAT_PLANAR1;
+			return fix->visual == FB_VISUAL_MONO01;
+		case 2:
+			*format = AES_SURFACE_FORMAT_PLANAR2;
+			return fix->visual == FB_VISUAL_PSEUDOCOLOR ||
+			       fix->visual == FB_VISUAL_STATIC_PSEUDOCOLOR;
+		case 4:
+			*format = AES_SURFACE_FORMAT_PLANAR4;
+			return fix->visual == FB_VISUAL_PSEUDOCOLOR ||
+			       fix->visual == FB_VISUAL_STATIC_PSEUDOCOLOR;
+		}
+
+		return false;
+	}
+
+	if (fix->type != FB_TYPE_PACKED_PIXELS)
+		return false;
+
+	switch (var->bits_per_pixel) {
+	case 1:
+		*format = AES_SURFACE_FORMAT_INDEXED1;
+		return fix->visual == FB_VISUAL_MONO01;
+	case 4:
+		*format = AES_SURFACE_FORMAT_INDEXED4;
+		return fix->visual == FB_VISUAL_PSEUDOCOLOR ||
+		       fix->visual == FB_VISUAL_STATIC_PSEUDOCOLOR;
+	case 8:
+		*format = AES_SURFACE_FORMAT_INDEXED8;
+		return fix->visual == FB_VISUAL_PSEUDOCOLOR ||
+		       fix->visual == FB_VISUAL_STATIC_PSEUDOCOLOR;
+	case 16:
+		*format = AES_SURFACE_FORMAT_RGB565;
+		return fix->visual == FB_VISUAL_TRUECOLOR &&
+			var->red.offset   == 11 && var->red.length   == 5 &&
+			var->green.offset ==  5 && var->green.length == 6 &&
+			var->blue.offset  ==  0 && var->blue.length  == 5;
+	case 32:
+		*format = AES_SURFACE_FORMAT_XRGB8888;
+		return fix->visual == FB_VISUAL_TRUECOLOR &&
+			var->red.offset   == 16 && var->red.length   == 8 &&
+			var->green.offset ==  8 && var->green.length == 8 &&
+			var->blue.offset  ==  0 && var->blue.length  == 8;
+	}
+
+	return false;
+}
+
+static bool aes_framebuffer_fbdev(struct aes_framebuffer *fb, int fd,
+	const struct aes_surface *surface)
+{
+	const int reduction = aes_surface_reduction(surface);
+	const int scale = aes_surface_scale(surface);
+	struct fb_fix_screeninfo fix;
+	struct fb_var_screeninfo var;
+
+	if (ioctl(fd, FBIOGET_FSCREENINFO, &fix) == -1 ||
+	    ioctl(fd, FBIOGET_VSCREENINFO, &var) == -1)
+		return false;
+
+	*fb = (struct aes_framebuffer) {
+		.size = fix.smem_len,
+		.surface = {
+			.area = {
+				.p = surface->area.p,
+				.r = {
+					.w = var.xres * reduction / scale,
+					.h = var.yres * reduction / scale
+				}
+			},
+			.scale = surface->scale,
+			.reduction = surface->reduction,
+			.stride = fix.line_length
+		}
+	};
+
+	if (!aes_framebuffer_fbdev_format(&fb->surface.format, &fix, &var) ||
+	    (var.xoffset * var.bits_per_pixel) % 8)
+		goto err_inval;
+
+	const size_t offset = var.yoffset * fix.line_length +
+		var.xoffset * var.bits_per_pixel / 8;
+
+	if (offset + fb->surface.stride * var.yres > fb->size)
+		goto err_inval;
+
+	fb->map = mmap(NULL, fb->size,
+		PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (fb->map == MAP_FAILED)
+		return false;
+
+	fb->surface.data = &((uint8_t *)fb->map)[offset];
+
+	return true;
+
+err_inval:
+	errno = EINVAL;
+	return false;
+}
+#endif /* __linux__ */
+
+static bool aes_framebuffer_file(struct aes_framebuffer *fb, int fd,
+	const struct aes_surface *surface)
+{
+	const struct aes_rectangle size = aes_surface_size(surface);
+	const size_t stride = surface->stride ? surface->stride :
+		aes_surface_format_stride(surface->format, size.w);
+	struct stat st;
+
+	if (size.w <= 0 || size.h <= 0 ||
+	    stride < aes_surface_format_stride(surface->format, size.w)) {
+		errno = EINVAL;
+		return false;
+	}
+
+	*fb = (struct aes_framebuffer) {
+		.size = stride * size.h,
+		.surface = *surface
+	};
+	fb->surface.stride = stride;
+
+	if (fstat(fd, &st) == -1)
+		return false;
+
+	if (S_ISREG(st.st_mode) && (size_t)st.st_size < fb->size &&
+	    ftruncate(fd, fb->size) == -1)
+		return false;
+
+	fb->map = mmap(NULL, fb->size,
+		PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (fb->map == MAP_FAILED)
+		return false;
+
+	fb->surface.data = fb->map;
+
+	return true;
+}
+
+/**
+ * aes_framebuffer_open_fd - map a framebuffer from a file descriptor
+ * @fb: framebuffer to open
+ * @fd: file descriptor of framebuffer device, file or memfd, opened for
+ * 	reading and writing
+ * @surface: pixel format, area, scale, reduction and stride of the
+ * 	framebuffer, where the stride may be zero to pack rows
+ *
+ * The format, size and stride of Linux framebuffer devices are given by
+ * the device, and only the position, scale and reduction of @surface
+ * apply. Files are extended to the size of @surface if necessary. The file
+ * descriptor may be closed once the framebuffer is open.
+ *
+ * Return: %true on success, otherwise %false with errno set
+ */
+bool aes_framebuffer_open_fd(struct aes_framebuffer *fb, int fd,
+	const struct aes_surface *surface)
+{
+#ifdef __linux__
+	struct fb_fix_screeninfo fix;
+
+	if (ioctl(fd, FBIOGET_FSCREENINFO, &fix) != -1)
+		return aes_framebuffer_fbdev(fb, fd, surface);
+#endif
+
+	return aes_framebuffer_file(fb, fd, surface);
+}
+
+bool aes_framebuffer_open(struct aes_framebuffer *fb, const char *path,
+	const struct aes_surface *surface)
+{
+	const int fd = xopen(path, O_RDWR | O_CREAT, 0666);
+
+	if (fd == -1)
+		return false;
+
+	const bool valid = aes_framebuffer_open_fd(fb, fd, surface);
+	const int errno_ = errno;
+
+	xclose(fd);
+	errno = errno_;
+
+	return valid;
+}
+
+void aes_framebuffer_close(struct aes_framebuffer *fb)
+{
+	if (fb->map && fb->map != MAP_FAILED)
+		munmap(fb->map, fb->size);
+
+	*fb = (struct aes_framebuffer) { };
+}
@@ -3,54 +3,161 @@
  * Copyright (C) 2022 Fredrik Noring
  */
 
+#include <stdlib.h>
+
 #include <gem/aes-area.h>
 #include <gem/aes-shape.h>
 #include <gem/aes-filter.h>
 #include <gem/aes-layer.h>
 #include <gem/aes-simple.h>
 
-static bool shape_layer_subdivision(
-	const struct aes_area clip,
-	struct aes_object_shape_layer *layers,
-	const aes_object_shape_layer_f f, void *arg)
+#include "internal/assert.h"
+#include "internal/macro.h"
+
+/**
+ * struct shape_layer_work - clip fragment to draw with a layer and below
+ * @draw: %true to draw the fragment with @k only, otherwise with all
+ * 	layers from @k and below
+ * @k: index of layer
+ * @clip: clip fragment
+ */
+struct shape_layer_work {
+	bool draw;
+	int k;
+	struct aes_area clip;
+};
+
+static bool shape_layer_arena_reserve(const size_t size,
+	struct aes_object_shape_layer_arena *arena)
 {
-	const struct aes_area c =
-		aes_area_intersection(clip, layers->shape.area);
+	if (size <= arena->size)
+		return true;
+
+	const size_t capacity = max(size, 2 * arena->size);
+	void *data = realloc(arena->data, capacity);
 
-	if (!aes_area_degenerate(c) && !f(c, layers, arg))
+	if (!data)
 		return false;
 
-	if (!layers->next)
-		return true;
+	arena->size = capacity;
+	arena->data = data;
+
+	return true;
+}
+
+static size_t shape_layer_work_offset(const int n)
+{
+	return ALIGN(sizeof(struct aes_object_shape_layer[n]),
+		__alignof__(struct shape_layer_work));
+}
 
-	struct aes_area s;
+static bool shape_layer_subdivision(const struct aes_area clip, const int n,
+	const aes_object_shape_layer_f f, void *arg,
+	struct aes_object_shape_layer_arena *arena)
+{
+	const int capacity = 5 * n + 1;
 
-	aes_for_each_area_subdivision (&s, clip, layers->shape.area)
-		if (!shape_layer_subdivision(s, layers->next, f, arg))
-			return false;
+	if (!shape_layer_arena_reserve(shape_layer_work_offset(n) +
+			sizeof(struct shape_layer_work[capacity]), arena))
+		return false;
+
+	struct aes_object_shape_layer *layers = arena->data;
+
+	for (int k = 0; k < n; k++)
+		layers[k].next = k ? &layers[k - 1] : NULL;
+
+	struct shape_layer_work *work = (struct shape_layer_work *)
+		&((uint8_t *)arena->data)[shape_layer_work_offset(n)];
+	int i = 0;
+
+#define PUSH_WORK(draw_, k_, clip_)					\
+	do {								\
+		BUG_ON(i >= capacity);					\
+		work[i++] = (struct shape_layer_work) {			\
+			.draw = (draw_),				\
+			.k = (k_),					\
+			.clip = (clip_)					\
+		};							\
+	} while (0)
+
+	PUSH_WORK(false, n - 1, clip);
+
+	while (i > 0) {
+		const struct shape_layer_work w = work[--i];
+		struct aes_object_shape_layer *layer = &layers[w.k];
+
+		if (w.draw) {
+			if (!f(w.clip, layer, arg))
+				return false;
+
+			continue;
+		}
+
+		const struct aes_area c =
+			aes_area_intersection(w.clip, layer->shape.area);
+
+		if (aes_area_degenerate(c)) {	/* Avoid needless fragmentation */
+			if (w.k)
+				PUSH_WORK(false, w.k - 1, w.clip);
+
+			continue;
+		}
+
+		if (w.k) {
+			struct aes_area s;
+
+			aes_for_each_area_subdivision (&s,
+					w.clip, layer->shape.area)
+				PUSH_WORK(false, w.k - 1, s);
+		}
+
+		if (!w.k || aes_object_simple_shape_opaque(&layer->shape)) {
+			if (!f(c, layer, arg))
+				return false;
+
+			continue;
+		}
+
+		/* Layers below show through transparent shapes, so go first. */
+		PUSH_WORK(true, w.k, c);
+		PUSH_WORK(false, w.k - 1, c);
+	}
+
+#undef PUSH_WORK
 
 	return true;
 }
 
-static bool shape_layers(
-	const struct aes_area clip,
-	struct aes_object_shape_layer *next,
+static bool shape_layer_occludes(const struct aes_area clip,
+	const struct aes_object_shape *shape)
+{
+	return aes_object_simple_shape_opaque(shape) &&
+	       aes_area_within_area(clip, shape->area);
+}
+
+static bool shape_layers(const struct aes_area clip,
 	struct aes_object_shape_iterator *iterator,
-	const aes_object_shape_layer_f f, void *arg)
+	const aes_object_shape_layer_f f, void *arg,
+	struct aes_object_shape_layer_arena *arena)
 {
-	struct aes_object_shape_layer layer_arg = { .next = next };
+	struct aes_object_shape shape;
+	int n = 0;
 
-	if (!next) {
-		if (!iterator->first(&layer_arg.shape, iterator))
-			return true;
+	aes_for_each_object_shape (&shape, iterator) {
+		/* Layers entirely hidden by an opaque shape can be dropped early. */
+		if (shape_layer_occludes(clip, &shape))
+			n = 0;
 
-		return shape_layers(clip, &layer_arg, iterator, f, arg);
-	}
+		if (!shape_layer_arena_reserve(
+				sizeof(struct aes_object_shape_layer[n + 1]), arena))
+			return false;
 
-	if (!iterator->next(&layer_arg.shape, iterator))
-		return shape_layer_subdivision(clip, next, f, arg);
+		struct aes_object_shape_layer *layers = arena->data;
 
-	return shape_layers(clip, &layer_arg, iterator, f, arg);
+		layers[n++] = (struct aes_object_shape_layer) { .shape = shape };
+	}
+
+	return !n || shape_layer_subdivision(clip, n, f, arg, arena);
 }
 
 static bool clip_filter(struct aes_object_shape *shape, void *arg)
@@ -60,9 +167,10 @@ static bool clip_filter(struct aes_object_shape *shape, void *arg)
 	return aes_area_overlap(shape->area, *clip);
 }
 
-bool aes_object_shape_layers(struct aes_area clip,
+bool aes_object_shape_layers_arena(struct aes_area clip,
 	struct aes_object_shape_iterator *iterator,
-	const aes_object_shape_layer_f f, void *arg)
+	const aes_object_shape_layer_f f, void *arg,
+	struct aes_object_shape_layer_arena *arena)
 {
 	struct aes_object_simple_shape_iterator_arg simple_arg;
 	struct aes_object_filter_shape_iterator_arg filter_arg;
@@ -73,5 +181,66 @@ bool aes_object_shape_layers(struct aes_area clip,
 		aes_object_filter_shape_iterator(clip_filter, &clip,
 			&simple_iterator, &filter_arg);
 
-	return shape_layers(clip, NULL, &clip_iterator, f, arg);
+	return shape_layers(clip, &clip_iterator, f, arg, arena);
+}
+
+/**
+ * aes_object_shape_layers_region - draw layers within a region only
+ * @region: region to draw, for example a damage region
+ * @iterator: shape iterator
+ * @f: layer drawing function
+ * @arg: argument for @f
+ * @arena: reusable arena
+ *
+ * Areas of the region are drawn one row at a time, such that @f is given
+ * clips of a single row, as with aes_surface_draw(). Pixels not covered by
+ * any shape are left untouched, so the region should be cleared to the
+ * background beforehand if shapes may have shrunk.
+ *
+ * Return: %true on success, otherwise %false
+ */
+bool aes_object_shape_layers_region(const struct aes_region *region,
+	struct aes_object_shape_iterator *iterator,
+	const aes_object_shape_layer_f f, void *arg,
+	struct aes_object_shape_layer_arena *arena)
+{
+	struct aes_area area;
+
+	aes_for_each_region_area (&area, region)
+		for (int y = 0; y < area.r.h; y++)
+			if (!aes_object_shape_layers_arena((struct aes_area) {
+					.p = {
+						.x = area.p.x,
+						.y = area.p.y + y
+					},
+					.r = {
+						.w = area.r.w,
+						.h = 1
+					}
+				}, iterator, f, arg, arena))
+				return false;
+
+	return true;
+}
+
+void aes_object_shape_layer_arena_free(
+	struct aes_object_shape_layer_arena *arena)
+{
+	free(arena->data);
+
+	*arena = (struct aes_object_shape_layer_arena) { };
+}
+
+bool aes_object_shape_layers(struct aes_area clip,
+	struct aes_object_shape_iterator *iterator,
+	const aes_object_shape_layer_f f, void *arg)
+{
+	struct aes_object_shape_layer_arena arena = { };
+
+	const bool valid = aes_object_shape_layers_arena(
+		clip, iterator, f, arg, &arena);
+
+	aes_object_shape_layer_arena_free(&arena);
+
+	return valid;
 }
@@ -6,10 +6,10 @@
 #include <gem/aes-area.h>
 #include <gem/aes-shape.h>
 #include <gem/aes-pixel.h>
+#include <gem/aes-text.h>
 #include <gem/vdi_.h>
 
-typedef bool (*aes_char_pixel_f)(const struct aes_point p,
-	const uint16_t c, const struct fnt *fnt);
+#include "internal/macro.h"
 
 typedef struct fnt *(*aes_fnt_f)(aes_id_t aes_id);
 
@@ -57,55 +57,93 @@ bool aes_bitblk_pixel(const struct aes_point p,
 	return (d & w) != 0;
 }
 
-static bool aes_char_pixel(const struct aes_point p,
-	const uint16_t c, const struct fnt *fnt)
+/*
+ * Glyphs may be wider than their advance, such as skewed glyphs, so the
+ * pixel may also be in glyphs of preceding characters.
+ */
+static bool aes_text_pixel(const struct aes_point p,
+	const struct aes_area area, const struct aes_text *text,
+	const aes_area_justify_rectangle_f justify_text,
+	const unsigned int effects, struct fnt *fnt_)
 {
-	return fnt_char_pixel(p.x, p.y, c, fnt);
-}
+	const struct vdi_fnt_effect *effect = vdi_fnt_effect(fnt_, effects);
 
-static bool aes_char_pixel_lighten(const struct aes_point p,
-	const uint16_t c, const struct fnt *fnt)
-{
-	return fnt_char_lighten(p.x, p.y, c, fnt) &&
-	       fnt_char_pixel(p.x, p.y, c, fnt);
+	if (!effect)
+		return false;
+
+	const int width = aes_text_width(text, effect->spacing);
+	const struct aes_rectangle text_rectangle = {
+		.w = width ? width + effect->overhang : 0,
+		.h = fnt_->header->bitmap_lines
+	};
+	const struct aes_area text_area = justify_text(text_rectangle, area);
+
+	if (!aes_point_within_area(p, text_area))
+		return false;
+
+	const struct aes_point tp = {
+		.x = p.x - text_area.p.x,
+		.y = p.y - text_area.p.y
+	};
+
+	for (int i = aes_text_char_index(text, min(tp.x, width - 1),
+			effect->spacing); i >= 0; i--) {
+		const int cx = tp.x - aes_text_char_x(text, i, effect->spacing);
+
+		if (cx >= effect->max_width)
+			break;
+
+		const uint8_t c = text->s[i];
+
+		if (vdi_fnt_effect_char_pixel(cx, tp.y, c, fnt_, effect))
+			return true;
+	}
+
+	return false;
 }
 
 static bool aes_string_pixel(aes_id_t aes_id,
 	const struct aes_point p, const struct aes_area area, const char *s,
 	const aes_area_justify_rectangle_f justify_text,
-	const aes_char_pixel_f char_pixel, const aes_fnt_f font)
+	const unsigned int effects, const aes_fnt_f font)
 {
 	struct fnt *fnt_ = font(aes_id);
-	const size_t length = strlen(s);
-	const struct aes_rectangle grid = {
-		.w = fnt_->header->max_cell_width,
-		.h = fnt_->header->bitmap_lines
-	};
 
-	const struct aes_rectangle text_rectangle = {
-		.w = grid.w * length,
-		.h = grid.h
-	};
-	const struct aes_area text_area = justify_text(text_rectangle, area);
+	if (!fnt_)
+		return false;
 
-	if (!fnt_ || !aes_point_within_area(p, text_area))
+	const struct aes_text *text = aes_text_layout(aes_id, s, fnt_);
+
+	if (!text)
 		return false;
 
-	const int i  = (p.x - text_area.p.x) / grid.w;
+	return aes_text_pixel(p, area, text, justify_text, effects, fnt_);
+}
 
-	if (i < 0 || i >= length)
+/*
+ * Single characters are laid out on the stack rather than cached, since
+ * their strings are temporary.
+ */
+static bool aes_char_pixel(aes_id_t aes_id,
+	const struct aes_point p, const struct aes_area area, const char c,
+	const aes_area_justify_rectangle_f justify_text,
+	const unsigned int effects, const aes_fnt_f font)
+{
+	struct fnt *fnt_ = font(aes_id);
+
+	if (!fnt_ || !c)
 		return false;
 
-	const struct aes_point cp = {
-		.x = (p.x - text_area.p.x) % grid.w,
-		.y =  p.y - text_area.p.y
+	char s[] = { c, '\0' };
+	int x[] = { 0, aes_text_advance((uint8_t)c, fnt_) };
+	const struct aes_text text = {
+		.fnt = fnt_,
+		.length = 1,
+		.s = s,
+		.x = x
 	};
-	const char c = s[i];
-
-	if (char_pixel(cp, c, fnt_))
-		return true;
 
-	return false;
+	return aes_text_pixel(p, area, &text, justify_text, effects, fnt_);
 }
 
 static aes_area_justify_rectangle_f aes_tedinfo_justification(
@@ -139,11 +177,9 @@ static int aes_g_box_pixel(aes_id_t aes_id,
 static int aes_g_boxchar_pixel(aes_id_t aes_id,
 	const struct aes_point p, const struct aes_object_shape *shape)
 {
-	const char s[] = { shape->spec.box.c, '\0' };
-
-	if (aes_string_pixel(aes_id, p, shape->area, s,
+	if (aes_char_pixel(aes_id, p, shape->area, shape->spec.box.c,
 			aes_area_justify_rectangle_center,
-				aes_char_pixel, aes_fnt_large))
+				0, aes_fnt_large))
 		return !shape->state.selected;
 
 	return aes_g_box_pixel(aes_id, p, shape);
@@ -155,7 +191,7 @@ static int aes_g_text_pixel(aes_id_t aes_id,
 	const struct aes_tedinfo *t = &shape->spec.tedinfo;
 
 	return aes_string_pixel(aes_id, p, shape->area, t->text,
-		aes_tedinfo_justification(t), aes_char_pixel,
+		aes_tedinfo_justification(t), 0,
 		aes_fnt_large) ^ shape->state.selected;
 }
 
@@ -165,7 +201,7 @@ static int aes_g_ftext_pixel(aes_id_t aes_id,
 	const struct aes_tedinfo *t = &shape->spec.tedinfo;
 
 	return aes_string_pixel(aes_id, p, shape->area, t->tmplt,
-		aes_tedinfo_justification(t), aes_char_pixel,
+		aes_tedinfo_justification(t), 0,
 		aes_fnt_large) ^ shape->state.selected;
 }
 
@@ -174,7 +210,7 @@ static int aes_g_string_pixel(aes_id_t aes_id,
 {
 	return aes_string_pixel(aes_id, p, shape->area, shape->spec.string,
 		aes_area_justify_rectangle_center_left,
-		shape->state.disabled ? aes_char_pixel_lighten : aes_char_pixel,
+		shape->state.disabled ? VDI_TEXT_EFFECT_LIGHTEN : 0,
 		aes_fnt_large) ^ shape->state.selected;
 }
 
@@ -183,7 +219,7 @@ static int aes_g_button_pixel(aes_id_t aes_id,
 {
 	return aes_string_pixel(aes_id, p, shape->area, shape->spec.string,
 		aes_area_justify_rectangle_center,
-		aes_char_pixel, aes_fnt_large) ^ shape->state.selected;
+		0, aes_fnt_large) ^ shape->state.selected;
 }
 
 static int aes_g_image_pixel(aes_id_t aes_id,
@@ -230,12 +266,11 @@ static int aes_g_icon_pixel(aes_id_t aes_id,
 			}
 		};
 
-		const char s[] = { iconblk->char_.c, '\0' };
-
 		if (aes_point_within_area(p, char_area))
-			return aes_string_pixel(aes_id, p, char_area,
-				s, aes_area_justify_rectangle_center,
-				aes_char_pixel, aes_fnt_small) ?
+			return aes_char_pixel(aes_id, p, char_area,
+				iconblk->char_.c,
+				aes_area_justify_rectangle_center,
+				0, aes_fnt_small) ?
 					iconblk->char_.color.fg :
 					iconblk->char_.color.bg;
 	}
@@ -255,7 +290,7 @@ static int aes_g_icon_pixel(aes_id_t aes_id,
 		return aes_string_pixel(aes_id, p, text_area,
 			iconblk->text.s,
 			aes_area_justify_rectangle_center,
-			aes_char_pixel, aes_fnt_small);
+			0, aes_fnt_small);
 
 	if (!aes_point_within_area(p, icon_area))
 		return 0;
@@ -319,3 +354,26 @@ GEM_OBJECT_G_TYPE(AES_OBJECT_G_TYPE_SPEC)
 
 	return -1;
 }
+
+/**
+ * aes_object_shape_selection_inverts - does selection invert a simple shape?
+ * @shape: simple shape, for example as given by aes_object_first_simple_shape()
+ *
+ * The pixels of these shapes are palette indices 0 or 1, which the
+ * selected state exchanges over the whole area of the shape. Changing
+ * the state is therefore the same as inverting the pixels already drawn.
+ *
+ * Return: %true if selection inverts the shape, otherwise %false
+ */
+bool aes_object_shape_selection_inverts(const struct aes_object_shape *shape)
+{
+	switch (shape->type.g) {
+	case GEM_G_TEXT:
+	case GEM_G_FTEXT:
+	case GEM_G_STRING:
+	case GEM_G_BUTTON:
+		return true;
+	}
+
+	return false;
+}
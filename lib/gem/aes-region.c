@@ -0,0 +1,340 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Copyright (C) 2022 Fredrik Noring
+ */
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <gem/aes-area.h>
+#include <gem/aes-region.h>
+
+typedef bool (*aes_region_op_f)(bool a, bool b);
+
+static bool region_op_union(bool a, bool b)
+{
+	return a || b;
+}
+
+static bool region_op_intersection(bool a, bool b)
+{
+	return a && b;
+}
+
+static bool region_op_subtract(bool a, bool b)
+{
+	return a && !b;
+}
+
+void aes_region_free(struct aes_region *region)
+{
+	free(region->areas);
+
+	*region = (struct aes_region) { };
+}
+
+static bool region_reserve(const size_t count, struct aes_region *region)
+{
+	if (count <= region->capacity)
+		return true;
+
+	const size_t capacity = max(count, max_t(size_t, 16,
+		2 * region->capacity));
+	struct aes_area *areas = realloc(region->areas,
+		sizeof(struct aes_area[capacity]));
+
+	if (!areas)
+		return false;
+
+	region->capacity = capacity;
+	region->areas = areas;
+
+	return true;
+}
+
+static bool region_append(const struct aes_area area,
+	struct aes_region *region)
+{
+	if (!region_reserve(region->count + 1, region))
+		return false;
+
+	region->areas[region->count++] = area;
+
+	return true;
+}
+
+bool aes_region_from_area(struct aes_region *region,
+	const struct aes_area area)
+{
+	region->count = 0;
+
+	return aes_area_degenerate(area) || region_append(area, region);
+}
+
+bool aes_region_copy(struct aes_region *region, const struct aes_region *a)
+{
+	if (region == a)
+		return true;
+
+	if (!a->count) {
+		region->count = 0;
+
+		return true;
+	}
+
+	if (!region_reserve(a->count, region))
+		return false;
+
+	memcpy(region->areas, a->areas, sizeof(struct aes_area[a->count]));
+	region->count = a->count;
+
+	return true;
+}
+
+static int area_bottom(const struct aes_area area)
+{
+	return area.p.y + area.r.h;
+}
+
+static size_t band_end(const struct aes_region *region, size_t i)
+{
+	const int y = region->areas[i].p.y;
+
+	while (i < region->count && region->areas[i].p.y == y)
+		i++;
+
+	return i;
+}
+
+static size_t band_skip(const struct aes_region *region, size_t i,
+	const int y)
+{
+	while (i < region->count && area_bottom(region->areas[i]) <= y)
+		i = band_end(region, i);
+
+	return i;
+}
+
+static int band_next_y(const struct aes_region *region, size_t i,
+	const int y)
+{
+	if (i >= region->count)
+		return INT_MAX;
+
+	return region->areas[i].p.y > y ? region->areas[i].p.y :
+		area_bottom(region->areas[i]);
+}
+
+struct band_spans {
+	size_t i;
+	size_t n;
+	bool in;
+};
+
+static int band_spans_next_x(const struct band_spans *s,
+	const struct aes_region *region)
+{
+	if (s->i >= s->n)
+		return INT_MAX;
+
+	const struct aes_area area = region->areas[s->i];
+
+	return s->in ? area.p.x + area.r.w : area.p.x;
+}
+
+static void band_spans_advance(struct band_spans *s, const int x,
+	const struct aes_region *region)
+{
+	if (band_spans_next_x(s, region) != x)
+		return;
+
+	if (s->in)
+		s->i++;
+	s->in = !s->in;
+}
+
+/* Coalesce with the band above if it has identical horizontal spans. */
+static bool band_coalesce(const size_t above, const size_t band,
+	struct aes_region *region)
+{
+	const size_t n = band - above;
+
+	if (above == band || region->count - band != n)
+		return false;
+
+	for (size_t i = 0; i < n; i++) {
+		const struct aes_area a = region->areas[above + i];
+		const struct aes_area b = region->areas[band + i];
+
+		if (area_bottom(a) != b.p.y ||
+		    a.p.x != b.p.x ||
+		    a.r.w != b.r.w)
+			return false;
+	}
+
+	for (size_t i = 0; i < n; i++)
+		region->areas[above + i].r.h += region->areas[band + i].r.h;
+
+	region->count = band;
+
+	return true;
+}
+
+static bool region_band_op(const int y0, const int y1,
+	struct band_spans sa, const struct aes_region *a,
+	struct band_spans sb, const struct aes_region *b,
+	const aes_region_op_f op, struct aes_region *region)
+{
+	int x0 = 0;
+
+	for (;;) {
+		const int x = min(band_spans_next_x(&sa, a),
+				  band_spans_next_x(&sb, b));
+
+		if (x == INT_MAX)
+			return true;
+
+		const bool before = op(sa.in, sb.in);
+
+		band_spans_advance(&sa, x, a);
+		band_spans_advance(&sb, x, b);
+
+		const bool after = op(sa.in, sb.in);
+
+		if (!before && after)
+			x0 = x;
+		else if (before && !after &&
+			 !region_append((struct aes_area) {
+				.p = { .x = x0, .y = y0 },
+				.r = { .w = x - x0, .h = y1 - y0 }
+			}, region))
+			return false;
+	}
+}
+
+static bool region_op(struct aes_region *region,
+	const struct aes_region *a, const struct aes_region *b,
+	const aes_region_op_f op)
+{
+	struct aes_region r = { };
+	size_t above = 0;
+	size_t ia = 0;
+	size_t ib = 0;
+
+	for (int y = INT_MIN; ; ) {
+		ia = band_skip(a, ia, y);
+		ib = band_skip(b, ib, y);
+
+		if (ia >= a->count && ib >= b->count)
+			break;
+
+		const int ta = ia < a->count ? a->areas[ia].p.y : INT_MAX;
+		const int tb = ib < b->count ? b->areas[ib].p.y : INT_MAX;
+		const int y0 = max(y, min(ta, tb));
+		const int y1 = min(band_next_y(a, ia, y0),
+				   band_next_y(b, ib, y0));
+		const struct band_spans sa = {
+			.i = ia,
+			.n = ta <= y0 ? band_end(a, ia) : ia
+		};
+		const struct band_spans sb = {
+			.i = ib,
+			.n = tb <= y0 ? band_end(b, ib) : ib
+		};
+		const size_t band = r.count;
+
+		if (!region_band_op(y0, y1, sa, a, sb, b, op, &r)) {
+			aes_region_free(&r);
+
+			return false;
+		}
+
+		if (r.count > band && !band_coalesce(above, band, &r))
+			above = band;
+
+		y = y1;
+	}
+
+	aes_region_free(region);
+	*region = r;
+
+	return true;
+}
+
+bool aes_region_union(struct aes_region *region,
+	const struct aes_region *a, const struct aes_region *b)
+{
+	return region_op(region, a, b, region_op_union);
+}
+
+bool aes_region_intersection(struct aes_region *region,
+	const struct aes_region *a, const struct aes_region *b)
+{
+	return region_op(region, a, b, region_op_intersection);
+}
+
+bool aes_region_subtract(struct aes_region *region,
+	const struct aes_region *a, const struct aes_region *b)
+{
+	return region_op(region, a, b, region_op_subtract);
+}
+
+static bool region_op_area(struct aes_region *region,
+	const struct aes_area area, const aes_region_op_f op)
+{
+	struct aes_area a = area;
+	const struct aes_region b = aes_area_degenerate(area) ?
+		(struct aes_region) { } :
+		(struct aes_region) {
+			.count = 1,
+			.capacity = 1,
+			.areas = &a
+		};
+
+	return region_op(region, region, &b, op);
+}
+
+bool aes_region_union_area(struct aes_region *region,
+	const struct aes_area area)
+{
+	return region_op_area(region, area, region_op_union);
+}
+
+bool aes_region_intersection_area(struct aes_region *region,
+	const struct aes_area area)
+{
+	return region_op_area(region, area, region_op_intersection);
+}
+
+bool aes_region_subtract_area(struct aes_region *region,
+	const struct aes_area area)
+{
+	return region_op_area(region, area, region_op_subtract);
+}
+
+struct aes_area aes_region_bounds(const struct aes_region *region)
+{
+	struct aes_area bounds = { };
+	struct aes_area area;
+	int k = 0;
+
+	aes_for_each_region_area (&area, region)
+		bounds = !k++ ? area : aes_area_bounds(bounds, area);
+
+	return bounds;
+}
+
+bool aes_point_within_region(const struct aes_point p,
+	const struct aes_region *region)
+{
+	struct aes_area area;
+
+	aes_for_each_region_area (&area, region)
+		if (aes_point_within_area(p, area))
+			return true;
+		else if (area.p.y > p.y)
+			break;
+
+	return false;
+}
@@ -4,8 +4,10 @@
  */
 
 #include <gem/aes-area.h>
+#include <gem/aes-pixel.h>
 #include <gem/aes-rsc.h>
 #include <gem/aes-shape.h>
+#include <gem/aes-simple.h>
 
 static struct aes_rectangle aes_rsc_grid(aes_id_t aes_id)
 {
@@ -264,6 +266,153 @@ struct aes_object_shape aes_rsc_object_shape(aes_id_t aes_id,
 	};
 }
 
+struct aes_point aes_rsc_object_origin(aes_id_t aes_id,
+	int16_t ob, const struct rsc_object *tree)
+{
+	struct aes_point origin = { };
+
+	for (; ob > 0; ob = rsc_object_parent(ob, tree))	/* Except root */
+		origin = aes_point_add(origin, aes_point_from_rcs(
+			aes_id, tree[ob].shape.area.p));
+
+	return origin;
+}
+
+struct aes_object_shape aes_rsc_tree_object_shape(aes_id_t aes_id,
+	const int16_t ob, const struct rsc_object *tree,
+	const struct rsc *rsc)
+{
+	return aes_rsc_object_shape(aes_id,
+		aes_rsc_object_origin(aes_id, ob, tree), &tree[ob], rsc);
+}
+
+/**
+ * aes_rsc_object_damage - add the area drawn by an object to a damage region
+ * @aes_id: AES to draw with
+ * @damage: region to extend
+ * @ob: index of object
+ * @tree: object tree
+ * @rsc: resource of @tree
+ *
+ * Call this both before and after changing the state or specification of
+ * the object, and then redraw the damage region with, for example,
+ * aes_object_shape_layers_region().
+ *
+ * Return: %true on success, otherwise %false if memory allocation failed
+ */
+bool aes_rsc_object_damage(aes_id_t aes_id, struct aes_region *damage,
+	const int16_t ob, const struct rsc_object *tree,
+	const struct rsc *rsc)
+{
+	const struct aes_object_shape shape =
+		aes_rsc_tree_object_shape(aes_id, ob, tree, rsc);
+
+	return aes_object_shape_damage(damage, &shape);
+}
+
+/**
+ * aes_rsc_object_selection_region - visible area that selection inverts
+ * @aes_id: AES to draw with
+ * @region: region to replace with the visible area of the object
+ * @ob: index of object
+ * @tree: object tree
+ * @rsc: resource of @tree
+ *
+ * Objects that are drawn after the object, and therefore on top of it,
+ * are excluded from the region. Transparent objects on top, and objects
+ * whose pixels are not exchanged by the selected state, cannot be
+ * inverted in place and must be redrawn, for example with
+ * aes_rsc_object_damage().
+ *
+ * Return: %true if changing the selected state of the object is the same
+ * 	as inverting @region of a drawn tree, otherwise %false in which
+ * 	case @region is unchanged
+ */
+bool aes_rsc_object_selection_region(aes_id_t aes_id,
+	struct aes_region *region, const int16_t ob,
+	const struct rsc_object *tree, const struct rsc *rsc)
+{
+	const struct aes_object_shape shape =
+		aes_rsc_tree_object_shape(aes_id, ob, tree, rsc);
+	struct aes_rsc_object_shape_iterator_arg arg;
+	struct aes_object_shape_iterator iterator =
+		aes_rsc_object_shape_iterator(aes_id, tree, rsc, &arg);
+	struct aes_region visible = { };
+	struct aes_object_shape object;
+	struct aes_object_shape simple;
+	struct aes_object_shape s;
+	bool above = false;
+
+	aes_for_each_simple_object_shape (&simple, shape)
+		;	/* The object itself is the last simple shape */
+
+	if (!aes_object_shape_selection_inverts(&simple) ||
+	    !aes_region_from_area(&visible, simple.area))
+		return false;
+
+	aes_for_each_object_shape (&object, &iterator) {
+		if (arg.ob == ob) {
+			above = true;
+			continue;
+		}
+
+		if (!above)
+			continue;
+
+		aes_for_each_simple_object_shape (&s, object) {
+			if (!aes_area_overlap(s.area,
+					aes_region_bounds(&visible)))
+				continue;
+
+			if (!aes_object_simple_shape_opaque(&s) ||
+			    !aes_region_subtract_area(&visible, s.area))
+				goto err;
+		}
+	}
+
+	aes_region_free(region);
+	*region = visible;
+
+	return true;
+
+err:
+	aes_region_free(&visible);
+
+	return false;
+}
+
+/**
+ * aes_rsc_object_toggle_selected - toggle selection of a drawn object
+ * @aes_id: AES to draw with
+ * @surface: surface on which @tree is drawn
+ * @ob: index of object
+ * @tree: object tree
+ * @rsc: resource of @tree
+ *
+ * The selected state of the object is toggled and its visible area on
+ * @surface is inverted, without redrawing any pixels.
+ *
+ * Return: %true on success, otherwise %false if the object must be redrawn
+ * 	instead, or memory allocation failed, in which case neither @surface
+ * 	nor @tree is changed
+ */
+bool aes_rsc_object_toggle_selected(aes_id_t aes_id,
+	const struct aes_surface *surface, const int16_t ob,
+	struct rsc_object *tree, const struct rsc *rsc)
+{
+	struct aes_region region = { };
+
+	if (!aes_rsc_object_selection_region(aes_id, &region, ob, tree, rsc))
+		return false;
+
+	aes_surface_invert_region(surface, &region);
+	tree[ob].shape.state.selected = !tree[ob].shape.state.selected;
+
+	aes_region_free(&region);
+
+	return true;
+}
+
 int16_t aes_rsc_tree_traverse_with_origin(aes_id_t aes_id,
 	struct aes_point *origin, int16_t ob, const struct rsc_object *tree)
 {
@@ -23,6 +23,29 @@ struct aes_area aes_object_shape_bounds(
 	return bounds;
 }
 
+/**
+ * aes_object_shape_damage - add the area drawn by a shape to a damage region
+ * @damage: region to extend
+ * @shape: shape to add, including any outline and border growth
+ *
+ * To find the damage caused by a change of state or specification, add the
+ * shape as it was both before and after the change, and then redraw the
+ * damage region.
+ *
+ * Return: %true on success, otherwise %false if memory allocation failed
+ */
+bool aes_object_shape_damage(struct aes_region *damage,
+	const struct aes_object_shape *shape)
+{
+	struct aes_object_shape simple;
+
+	aes_for_each_simple_object_shape (&simple, *shape)
+		if (!aes_region_union_area(damage, simple.area))
+			return false;
+
+	return true;
+}
+
 bool aes_find_object_shape(struct aes_object_shape *shape,
 	const struct aes_point p, struct aes_object_shape_iterator *iterator)
 {
@@ -113,6 +113,33 @@ struct aes_object_simple_shape_enumerator aes_object_next_simple_shape(
 	return aes_object_simple_shape(e.i + 1, simple, shape);
 }
 
+/**
+ * aes_object_simple_shape_opaque - does a simple shape hide shapes below it?
+ * @simple: simple shape, for example as given by aes_object_first_simple_shape()
+ *
+ * Filled boxes, which include the synthesised outline and border boxes,
+ * as well as objects drawn in replace mode give every pixel of their area
+ * a colour. Other objects may leave pixels transparent.
+ *
+ * Return: %true if the shape is fully opaque, otherwise %false
+ */
+bool aes_object_simple_shape_opaque(const struct aes_object_shape *simple)
+{
+	switch (simple->type.g) {
+	case GEM_G_BOX:
+	case GEM_G_BOXCHAR:
+	case GEM_G_TEXT:
+	case GEM_G_FTEXT:
+	case GEM_G_IMAGE:
+	case GEM_G_BUTTON:
+	case GEM_G_STRING:
+	case GEM_G_ICON:
+		return true;
+	}
+
+	return false;
+}
+
 static bool aes_object_first_simple_shape_(
 	struct aes_object_shape *shape,
 	struct aes_object_shape_iterator *iterator)
@@ -0,0 +1,940 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Copyright (C) 2022 Fredrik Noring
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <gem/aes-area.h>
+#include <gem/aes-pixel.h>
+#include <gem/aes-surface.h>
+
+#include "internal/assert.h"
+#include "internal/macro.h"
+
+int aes_surface_format_bpp(enum aes_surface_format format)
+{
+	switch (format) {
+#define AES_SURFACE_FORMAT_BPP(symbol_, label_, bpp_, layout_)		\
+	case AES_SURFACE_FORMAT_ ## symbol_: return bpp_;
+AES_SURFACE_FORMAT(AES_SURFACE_FORMAT_BPP)
+	}
+
+	BUG();
+}
+
+enum aes_surface_layout aes_surface_format_layout(
+	enum aes_surface_format format)
+{
+	switch (format) {
+#define AES_SURFACE_FORMAT_LAYOUT(symbol_, label_, bpp_, layout_)	\
+	case AES_SURFACE_FORMAT_ ## symbol_:				\
+		return AES_SURFACE_LAYOUT_ ## layout_;
+AES_SURFACE_FORMAT(AES_SURFACE_FORMAT_LAYOUT)
+	}
+
+	BUG();
+}
+
+size_t aes_surface_format_stride(enum aes_surface_format format, int width)
+{
+	if (aes_surface_format_layout(format) == AES_SURFACE_LAYOUT_PLANAR)
+		width = ALIGN(width, 16);	/* Whole plane words */
+
+	return ((size_t)width * aes_surface_format_bpp(format) + 7) / 8;
+}
+
+/*
+ * Eight bytes of bits to exclusive-or, in memory order, that exchange the
+ * palette indices 0 and 1, or white and black for direct colour formats.
+ * Every pixel size divides eight bytes, so the pattern repeats with every
+ * eight bytes of a row.
+ */
+static uint64_t aes_surface_invert_pattern(enum aes_surface_format format)
+{
+	union {
+		uint8_t u8[8];
+		uint16_t u16[4];
+		uint32_t u32[2];
+		uint64_t u64;
+	} pattern;
+
+	switch (format) {
+	case AES_SURFACE_FORMAT_INDEXED1:
+		memset(pattern.u8, 0xff, sizeof(pattern.u8));
+		break;
+	case AES_SURFACE_FORMAT_INDEXED4:
+		memset(pattern.u8, 0x11, sizeof(pattern.u8));
+		break;
+	case AES_SURFACE_FORMAT_INDEXED8:
+		memset(pattern.u8, 0x01, sizeof(pattern.u8));
+		break;
+	case AES_SURFACE_FORMAT_RGB565:
+		memset(pattern.u8, 0xff, sizeof(pattern.u8));
+		break;
+	case AES_SURFACE_FORMAT_XRGB8888:
+		pattern.u32[0] = pattern.u32[1] = 0x00ffffff;
+		break;
+	case AES_SURFACE_FORMAT_RGBA16:
+		pattern.u16[0] = pattern.u16[1] = pattern.u16[2] = 0xffff;
+		pattern.u16[3] = 0;	/* Alpha is unchanged */
+		break;
+	default:
+		BUG();
+	}
+
+	return pattern.u64;
+}
+
+static uint64_t aes_surface_rotate_pattern(uint64_t pattern, size_t phase)
+{
+	uint8_t b[16];
+
+	memcpy(&b[0], &pattern, sizeof(pattern));
+	memcpy(&b[8], &pattern, sizeof(pattern));
+	memcpy(&pattern, &b[phase % 8], sizeof(pattern));
+
+	return pattern;
+}
+
+static void aes_surface_invert_bits(uint8_t *row,
+	const size_t b0, const size_t b1, const uint64_t pattern)
+{
+	const uint8_t *p = (const uint8_t *)&pattern;
+	const size_t end = b1 / 8;
+	size_t i = b0 / 8;
+
+	if (b1 <= b0)
+		return;
+
+	if (i == end) {
+		row[i] ^= p[i % 8] & (0xff >> (b0 % 8)) & ~(0xff >> (b1 % 8));
+		return;
+	}
+
+	if (b0 % 8)
+		row[i] ^= p[i % 8] & (0xff >> (b0 % 8)), i++;
+
+	if (i + sizeof(uint64_t) <= end) {
+		const uint64_t w = aes_surface_rotate_pattern(pattern, i);
+
+		for (; i + sizeof(uint64_t) <= end; i += sizeof(uint64_t)) {
+			uint64_t v;
+
+			memcpy(&v, &row[i], sizeof(v));
+			v ^= w;
+			memcpy(&row[i], &v, sizeof(v));
+		}
+	}
+
+	for (; i < end; i++)
+		row[i] ^= p[i % 8];
+
+	if (b1 % 8)
+		row[end] ^= p[end % 8] & ~(0xff >> (b1 % 8));
+}
+
+static void aes_surface_invert_plane(uint8_t *row,
+	const size_t x0, const size_t x1, const size_t planes)
+{
+	for (size_t g = x0 / 16; 16 * g < x1; g++) {
+		const size_t a = max(x0, 16 * g) - 16 * g;
+		const size_t b = min(x1, 16 * g + 16) - 16 * g;
+		const uint16_t m = (0xffff >> a) & ~(0xffff >> b);
+		uint8_t *w = &row[2 * planes * g];
+
+		w[0] ^= m >> 8;
+		w[1] ^= m & 0xff;
+	}
+}
+
+/*
+ * First pixel at or after an AES coordinate, relative to the area of the
+ * surface. Thumbnail pixels are sampled in their centres.
+ */
+static size_t aes_surface_pixel(const struct aes_surface *surface, int d)
+{
+	const int reduction = aes_surface_reduction(surface);
+
+	if (reduction == 1)
+		return aes_surface_scale(surface) * d;
+
+	d -= reduction / 2;
+
+	return d > 0 ? (d + reduction - 1) / reduction : 0;
+}
+
+/**
+ * aes_surface_invert_area - exchange palette indices 0 and 1 of an area
+ * @surface: surface to modify
+ * @area: area in AES coordinates, clipped to the area of the surface
+ *
+ * Pixels of direct colour formats are assumed to be either white or
+ * black, as given by palette indices 0 and 1. Whole rows are inverted
+ * eight bytes at a time, and planar rows one word of the first plane
+ * at a time. Thumbnail pixels are inverted if their centres are within
+ * the area, which is exact only for thumbnails of single samples.
+ */
+void aes_surface_invert_area(const struct aes_surface *surface,
+	const struct aes_area area)
+{
+	const struct aes_area a = aes_area_intersection(area, surface->area);
+	const size_t bpp = aes_surface_format_bpp(surface->format);
+
+	if (aes_area_degenerate(a))
+		return;
+
+	const size_t x0 = aes_surface_pixel(surface, a.p.x - surface->area.p.x);
+	const size_t y0 = aes_surface_pixel(surface, a.p.y - surface->area.p.y);
+	const size_t x1 = aes_surface_pixel(surface,
+		a.p.x + a.r.w - surface->area.p.x);
+	const size_t y1 = aes_surface_pixel(surface,
+		a.p.y + a.r.h - surface->area.p.y);
+
+	if (aes_surface_format_layout(surface->format) ==
+			AES_SURFACE_LAYOUT_PLANAR) {
+		for (size_t y = y0; y < y1; y++)
+			aes_surface_invert_plane(&((uint8_t *)surface->data)[
+					y * surface->stride], x0, x1, bpp);
+
+		return;
+	}
+
+	const uint64_t pattern = aes_surface_invert_pattern(surface->format);
+
+	for (size_t y = y0; y < y1; y++)
+		aes_surface_invert_bits(&((uint8_t *)surface->data)[
+				y * surface->stride],
+			x0 * bpp, x1 * bpp, pattern);
+}
+
+void aes_surface_invert_region(const struct aes_surface *surface,
+	const struct aes_region *region)
+{
+	struct aes_area area;
+
+	aes_for_each_region_area (&area, region)
+		aes_surface_invert_area(surface, area);
+}
+
+/**
+ * struct aes_surface_palette - pixels encoded in the format of a surface
+ * @count: number of palette indices
+ * @pixels: pixels in memory order for no shape, followed by palette indices
+ * @colors: colours of palette indices
+ *
+ * Pixels not covered by any shape are transparent with RGBA16, and palette
+ * index 0 with other formats that lack an alpha channel.
+ */
+struct aes_surface_palette {
+	int count;
+	uint64_t pixels[1 + 256];
+	struct vdi_color colors[256];
+};
+
+struct aes_surface_row {
+	aes_id_t aes_id;
+	struct aes_area clip;
+	const struct aes_surface_palette *palette;
+	uint64_t *pixels;
+};
+
+static uint16_t aes_surface_color_component(int c, int max)
+{
+	return (max * c + 500) / 1000;
+}
+
+static uint64_t aes_surface_encode(enum aes_surface_format format,
+	const int index, const struct vdi_color *color, const int alpha)
+{
+	union {
+		uint16_t u16[4];
+		uint64_t u64;
+	} rgba16 = { };
+
+	switch (format) {
+	case AES_SURFACE_FORMAT_INDEXED1:
+		return index & 0x1;
+	case AES_SURFACE_FORMAT_INDEXED4:
+		return index & 0xf;
+	case AES_SURFACE_FORMAT_INDEXED8:
+		return index & 0xff;
+	case AES_SURFACE_FORMAT_PLANAR1:
+		return index & 0x1;
+	case AES_SURFACE_FORMAT_PLANAR2:
+		return index & 0x3;
+	case AES_SURFACE_FORMAT_PLANAR4:
+		return index & 0xf;
+	case AES_SURFACE_FORMAT_RGB565:
+		return (aes_surface_color_component(color->r, 0x1f) << 11) |
+		       (aes_surface_color_component(color->g, 0x3f) <<  5) |
+			aes_surface_color_component(color->b, 0x1f);
+	case AES_SURFACE_FORMAT_XRGB8888:
+		return (aes_surface_color_component(color->r, 0xff) << 16) |
+		       (aes_surface_color_component(color->g, 0xff) <<  8) |
+			aes_surface_color_component(color->b, 0xff);
+	case AES_SURFACE_FORMAT_RGBA16:
+		rgba16.u16[0] = aes_surface_color_component(color->r, 0xffff);
+		rgba16.u16[1] = aes_surface_color_component(color->g, 0xffff);
+		rgba16.u16[2] = aes_surface_color_component(color->b, 0xffff);
+		rgba16.u16[3] = aes_surface_color_component(alpha, 0xffff);
+
+		return rgba16.u64;
+	}
+
+	BUG();
+}
+
+static void aes_surface_palette(struct aes_surface_palette *palette,
+	aes_id_t aes_id, enum aes_surface_format format)
+{
+	struct vdi_color *color;
+
+	*palette = (struct aes_surface_palette) { };
+
+	while (palette->count < ARRAY_SIZE(palette->colors) &&
+	       aes_palette_color(aes_id, palette->count,
+			(color = &palette->colors[palette->count]))) {
+		palette->pixels[1 + palette->count] =
+			aes_surface_encode(format, palette->count, color, 1000);
+		palette->count++;
+	}
+
+	if (format != AES_SURFACE_FORMAT_RGBA16)
+		palette->pixels[0] = palette->pixels[1];
+}
+
+static const struct aes_surface_palette *aes_surface_arena_palette(
+	struct aes_surface_arena *arena, aes_id_t aes_id,
+	enum aes_surface_format format)
+{
+	if (arena->palette && arena->format == format)
+		return arena->palette;
+
+	if (!arena->palette &&
+	    !(arena->palette = malloc(sizeof(*arena->palette))))
+		return NULL;
+
+	aes_surface_palette(arena->palette, aes_id, format);
+	arena->format = format;
+
+	return arena->palette;
+}
+
+static void *aes_surface_arena_row(struct aes_surface_arena *arena,
+	const size_t size)
+{
+	if (size <= arena->size)
+		return arena->row;
+
+	const size_t capacity = max(size, 2 * arena->size);
+	void *row = realloc(arena->row, capacity);
+
+	if (!row)
+		return NULL;
+
+	arena->size = capacity;
+	arena->row = row;
+
+	return row;
+}
+
+void aes_surface_arena_free(struct aes_surface_arena *arena)
+{
+	aes_object_shape_layer_arena_free(&arena->layer);
+	free(arena->palette);
+	free(arena->row);
+
+	*arena = (struct aes_surface_arena) { };
+}
+
+/*
+ * Row writers are specialised for each pixel format, such that storing
+ * encoded pixels is a tight loop without any branches on the format.
+ */
+typedef void (*aes_surface_row_writer_f)(uint8_t *row,
+	const uint64_t *pixels, const int width);
+
+#define AES_SURFACE_ROW_WRITER_PACKED(label_, bpp_)			\
+static void aes_surface_write_row_ ## label_(uint8_t *row,		\
+	const uint64_t *pixels, const int width)			\
+{									\
+	const int n = 8 / (bpp_);					\
+	int x = 0;							\
+									\
+	for (; x + n <= width; x += n) {				\
+		uint8_t b = 0;						\
+									\
+		for (int k = 0; k < n; k++)				\
+			b = (b << (bpp_)) | pixels[x + k];		\
+									\
+		row[x / n] = b;						\
+	}								\
+									\
+	if (x < width) {	/* Keep pixels beyond the width */	\
+		uint8_t b = 0;						\
+		uint8_t m = 0;						\
+									\
+		for (int k = 0; k < n; k++) {				\
+			b <<= (bpp_);					\
+			m <<= (bpp_);					\
+									\
+			if (x + k < width) {				\
+				b |= pixels[x + k];			\
+				m |= (1 << (bpp_)) - 1;			\
+			}						\
+		}							\
+									\
+		row[x / n] = (row[x / n] & ~m) | b;			\
+	}								\
+}
+
+#define AES_SURFACE_ROW_WRITER_ALIGNED(label_, bpp_)			\
+static void aes_surface_write_row_ ## label_(uint8_t *row,		\
+	const uint64_t *pixels, const int width)			\
+{									\
+	for (int x = 0; x < width; x++) {				\
+		const uint ## bpp_ ## _t pixel = pixels[x];		\
+									\
+		memcpy(&row[x * sizeof(pixel)], &pixel, sizeof(pixel));	\
+	}								\
+}
+
+static inline uint64_t aes_surface_delta_swap(uint64_t x,
+	const uint64_t mask, const int delta)
+{
+	const uint64_t t = ((x >> delta) ^ x) & mask;
+
+	return x ^ t ^ (t << delta);
+}
+
+/*
+ * Converts 16 chunky 4-bit pixels, with the leftmost pixel in the most
+ * significant bits, to four 16-bit plane words, with the first plane in
+ * the least significant bits. This is a transpose of a 16 by 4 bit matrix,
+ * done with four delta swaps that each exchange two bits of the bit
+ * indices.
+ */
+static inline uint64_t aes_surface_chunky_to_planar(uint64_t x)
+{
+	x = aes_surface_delta_swap(x, 0x0a0a0a0a0a0a0a0a,  3);
+	x = aes_surface_delta_swap(x, 0x00cc00cc00cc00cc,  6);
+	x = aes_surface_delta_swap(x, 0x0000f0f00000f0f0, 12);
+	x = aes_surface_delta_swap(x, 0x00000000ff00ff00, 24);
+
+	return x;
+}
+
+static inline uint64_t aes_surface_chunky(const uint64_t *pixels,
+	const int n)
+{
+	uint64_t x = 0;
+
+	for (int k = 0; k < n; k++)
+		x = (x << 4) | pixels[k];
+
+	return x << (4 * (16 - n));
+}
+
+#define AES_SURFACE_ROW_WRITER_PLANAR(label_, bpp_)			\
+static void aes_surface_write_row_ ## label_(uint8_t *row,		\
+	const uint64_t *pixels, const int width)			\
+{									\
+	for (int x = 0; x < width; x += 16) {				\
+		const int n = min(width - x, 16);			\
+		const uint64_t planes = aes_surface_chunky_to_planar(	\
+			aes_surface_chunky(&pixels[x], n));		\
+		const uint16_t m = ~(0xffff >> n);			\
+		uint8_t *w = &row[2 * (bpp_) * (x / 16)];		\
+									\
+		for (int p = 0; p < (bpp_); p++) {			\
+			uint16_t v = planes >> (16 * p);		\
+									\
+			if (n < 16)	/* Keep pixels beyond the width */\
+				v = (v & m) | (((w[2 * p] << 8) |	\
+					w[2 * p + 1]) & ~m);		\
+									\
+			w[2 * p] = v >> 8;				\
+			w[2 * p + 1] = v & 0xff;			\
+		}							\
+	}								\
+}
+
+#define AES_SURFACE_ROW_WRITER(symbol_, label_, bpp_, layout_)		\
+	AES_SURFACE_ROW_WRITER_ ## layout_(label_, bpp_)
+AES_SURFACE_FORMAT(AES_SURFACE_ROW_WRITER)
+
+static aes_surface_row_writer_f aes_surface_row_writer(
+	enum aes_surface_format format)
+{
+	switch (format) {
+#define AES_SURFACE_ROW_WRITER_CASE(symbol_, label_, bpp_, layout_)	\
+	case AES_SURFACE_FORMAT_ ## symbol_:				\
+		return aes_surface_write_row_ ## label_;
+AES_SURFACE_FORMAT(AES_SURFACE_ROW_WRITER_CASE)
+	}
+
+	BUG();
+}
+
+/*
+ * Writes a row of pixels from pixel x, that must be at the start of a byte
+ * with packed formats and of a plane word with planar formats.
+ */
+static void aes_surface_write_row(const struct aes_surface *surface,
+	const aes_surface_row_writer_f write_row, const int x, const int y,
+	const uint64_t *pixels, const int width)
+{
+	write_row(&((uint8_t *)surface->data)[y * surface->stride +
+			aes_surface_format_stride(surface->format, x)],
+		pixels, width);
+}
+
+/* Alignment in pixels of rows written with aes_surface_write_row(). */
+static int aes_surface_format_align(enum aes_surface_format format)
+{
+	switch (aes_surface_format_layout(format)) {
+	case AES_SURFACE_LAYOUT_PACKED:
+		return 8 / aes_surface_format_bpp(format);
+	case AES_SURFACE_LAYOUT_ALIGNED:
+		return 1;
+	case AES_SURFACE_LAYOUT_PLANAR:
+		return 16;
+	}
+
+	BUG();
+}
+
+static struct aes_area aes_surface_row_clip(
+	const struct aes_surface *surface, const int y)
+{
+	return (struct aes_area) {
+		.p = {
+			.x = surface->area.p.x,
+			.y = y
+		},
+		.r = {
+			.w = surface->area.r.w,
+			.h = 1
+		}
+	};
+}
+
+static bool aes_surface_draw_layer(const struct aes_area clip,
+	const struct aes_object_shape_layer *layers, void *arg)
+{
+	struct aes_surface_row *row = arg;
+
+	BUG_ON(clip.r.h != 1);
+
+	for (int x = 0; x < clip.r.w; x++) {
+		const struct aes_point p = {
+			.x = clip.p.x + x,
+			.y = clip.p.y
+		};
+		const int index = aes_object_shape_pixel(
+			row->aes_id, p, &layers->shape);
+
+		if (index < 0 || index >= row->palette->count)
+			continue;	/* Transparent pixel */
+
+		row->pixels[p.x - row->clip.p.x] =
+			row->palette->pixels[1 + index];
+	}
+
+	return true;
+}
+
+/*
+ * Replicates every pixel of a row scale times, in place from right to
+ * left. The scales of 2, 3 and 4 have constant spans that are unrolled.
+ */
+static inline void aes_surface_replicate_span(uint64_t *pixels,
+	const int width, const int scale)
+{
+	for (int x = width - 1; x >= 0; x--)
+		for (int k = scale - 1; k >= 0; k--)
+			pixels[scale * x + k] = pixels[x];
+}
+
+static void aes_surface_replicate(uint64_t *pixels,
+	const int width, const int scale)
+{
+	switch (scale) {
+	case 1:
+		break;
+	case 2:
+		aes_surface_replicate_span(pixels, width, 2);
+		break;
+	case 3:
+		aes_surface_replicate_span(pixels, width, 3);
+		break;
+	case 4:
+		aes_surface_replicate_span(pixels, width, 4);
+		break;
+	default:
+		aes_surface_replicate_span(pixels, width, scale);
+	}
+}
+
+/*
+ * Draws a clip of a single row, that starts at a pixel that can be written
+ * with aes_surface_write_row(), and writes it scale times.
+ */
+static bool aes_surface_draw_span(const struct aes_surface *surface,
+	const aes_surface_row_writer_f write_row, const struct aes_area clip,
+	struct aes_surface_row *row, struct aes_object_shape_iterator *iterator,
+	struct aes_surface_arena *arena)
+{
+	const int scale = aes_surface_scale(surface);
+	const struct aes_rectangle size = aes_surface_size(surface);
+	const int px = scale * (clip.p.x - surface->area.p.x);
+	const int py = scale * (clip.p.y - surface->area.p.y);
+
+	row->clip = clip;
+
+	for (int x = 0; x < clip.r.w; x++)
+		row->pixels[x] = row->palette->pixels[0];
+
+	if (!aes_object_shape_layers_arena(clip, iterator,
+			aes_surface_draw_layer, row, &arena->layer))
+		return false;
+
+	aes_surface_replicate(row->pixels, clip.r.w, scale);
+
+	for (int k = 0; k < scale; k++)
+		aes_surface_write_row(surface, write_row, px, py + k,
+			row->pixels, min(scale * clip.r.w, size.w - px));
+
+	return true;
+}
+
+/**
+ * aes_surface_draw - draw shapes on a surface
+ * @aes_id: AES to draw with
+ * @surface: surface to draw on
+ * @iterator: shapes to draw
+ * @arena: memory for drawing, or %NULL
+ *
+ * The surface is drawn row by row from top to bottom, and every pixel is
+ * written exactly once, so the surface may be mapped video memory that is
+ * displayed while it is drawn. Memory is bounded by one row of pixels and
+ * the layers of a row.
+ *
+ * Scaled surfaces ray cast each AES coordinate once. Its pixel is
+ * replicated into a span, and the row is written as many times as the
+ * scale. Thumbnails are drawn with aes_surface_draw_thumbnail() using a
+ * single sample per pixel.
+ *
+ * Text layouts cached by the AES are compared with their strings once per
+ * drawing, so strings may change between drawings.
+ *
+ * Return: %true on success, otherwise %false if memory allocation failed
+ */
+bool aes_surface_draw(aes_id_t aes_id, const struct aes_surface *surface,
+	struct aes_object_shape_iterator *iterator,
+	struct aes_surface_arena *arena)
+{
+	if (aes_surface_reduction(surface) > 1)
+		return aes_surface_draw_thumbnail(aes_id,
+			surface, 1, iterator, arena);
+
+	const struct aes_rectangle size = aes_surface_size(surface);
+	struct aes_surface_arena arena_ = { };
+
+	if (!arena)
+		arena = &arena_;
+
+	struct aes_surface_row row = {
+		.aes_id = aes_id,
+		.palette = aes_surface_arena_palette(arena,
+			aes_id, surface->format),
+		.pixels = aes_surface_arena_row(arena,
+			max(size.w, 1) * sizeof(*row.pixels))
+	};
+	const aes_surface_row_writer_f write_row =
+		aes_surface_row_writer(surface->format);
+	bool valid = row.palette && row.pixels;
+
+	for (int y = 0; valid && y < surface->area.r.h; y++)
+		valid = aes_surface_draw_span(surface, write_row,
+			aes_surface_row_clip(surface, surface->area.p.y + y),
+			&row, iterator, arena);
+
+	aes_surface_arena_free(&arena_);
+
+	return valid;
+}
+
+/**
+ * aes_surface_draw_region - redraw a region of a surface
+ * @aes_id: AES to draw with
+ * @surface: surface to draw on, with shapes already drawn
+ * @region: region in AES coordinates to redraw, for example a damage region
+ * 	given by aes_rsc_object_damage()
+ * @iterator: shapes to draw
+ * @arena: memory for drawing, or %NULL
+ *
+ * Pixels within the region are cleared and drawn again, row by row, and
+ * pixels outside of the region are kept. Spans are widened to start at
+ * whole bytes of packed formats and whole plane words of planar formats,
+ * whose pixels are drawn again with the same values. Thumbnails are drawn
+ * in full with aes_surface_draw_thumbnail() using a single sample.
+ *
+ * Return: %true on success, otherwise %false if memory allocation failed
+ */
+bool aes_surface_draw_region(aes_id_t aes_id,
+	const struct aes_surface *surface, const struct aes_region *region,
+	struct aes_object_shape_iterator *iterator,
+	struct aes_surface_arena *arena)
+{
+	if (aes_surface_reduction(surface) > 1)
+		return aes_surface_draw_thumbnail(aes_id,
+			surface, 1, iterator, arena);
+
+	const int align = aes_surface_format_align(surface->format);
+	const struct aes_rectangle size = aes_surface_size(surface);
+	struct aes_surface_arena arena_ = { };
+
+	if (!arena)
+		arena = &arena_;
+
+	struct aes_surface_row row = {
+		.aes_id = aes_id,
+		.palette = aes_surface_arena_palette(arena,
+			aes_id, surface->format),
+		.pixels = aes_surface_arena_row(arena,
+			max(size.w, 1) * sizeof(*row.pixels))
+	};
+	const aes_surface_row_writer_f write_row =
+		aes_surface_row_writer(surface->format);
+	bool valid = row.palette && row.pixels;
+	struct aes_area area;
+
+	aes_for_each_region_area (&area, region) {
+		const struct aes_area a =
+			aes_area_intersection(area, surface->area);
+
+		if (!valid || aes_area_degenerate(a))
+			continue;
+
+		const int x0 = a.p.x - surface->area.p.x;
+		const int x1 = x0 + a.r.w;
+		struct aes_area clip = {
+			.p.x = surface->area.p.x + x0 - x0 % align,
+			.r = {
+				.w = x1 - (x0 - x0 % align),
+				.h = 1
+			}
+		};
+
+		for (int y = 0; valid && y < a.r.h; y++) {
+			clip.p.y = a.p.y + y;
+
+			valid = aes_surface_draw_span(surface, write_row,
+				clip, &row, iterator, arena);
+		}
+	}
+
+	aes_surface_arena_free(&arena_);
+
+	return valid;
+}
+
+struct aes_surface_sample {
+	uint32_t r;
+	uint32_t g;
+	uint32_t b;
+	uint32_t n;
+};
+
+struct aes_surface_sample_row {
+	aes_id_t aes_id;
+	struct aes_area clip;
+	int reduction;
+	int samples;
+	int16_t *indices;
+};
+
+/* AES coordinate of sample k of a row, relative to the area of surface. */
+static int aes_surface_sample_offset(const int k,
+	const int reduction, const int samples)
+{
+	return reduction * (k / samples) +
+		((2 * (k % samples) + 1) * reduction) / (2 * samples);
+}
+
+static bool aes_surface_sample_layer(const struct aes_area clip,
+	const struct aes_object_shape_layer *layers, void *arg)
+{
+	struct aes_surface_sample_row *row = arg;
+	const int x0 = clip.p.x - row->clip.p.x;
+	const int x1 = x0 + clip.r.w;
+	int k = max(x0 * row->samples / row->reduction - 1, 0);
+
+	BUG_ON(clip.r.h != 1);
+
+	for (;; k++) {
+		const int x = aes_surface_sample_offset(k,
+			row->reduction, row->samples);
+
+		if (x < x0)
+			continue;
+		if (x >= x1)
+			break;
+
+		const struct aes_point p = {
+			.x = row->clip.p.x + x,
+			.y = clip.p.y
+		};
+		const int index = aes_object_shape_pixel(
+			row->aes_id, p, &layers->shape);
+
+		if (index >= 0)
+			row->indices[k] = index;
+	}
+
+	return true;
+}
+
+static void aes_surface_sample_add(struct aes_surface_sample *sample,
+	const struct vdi_color *color)
+{
+	sample->r += color->r;
+	sample->g += color->g;
+	sample->b += color->b;
+	sample->n++;
+}
+
+static uint64_t aes_surface_sample_pixel(enum aes_surface_format format,
+	const struct aes_surface_sample *sample, const int n)
+{
+	if (!sample->n)
+		return 0;	/* Transparent */
+
+	const struct vdi_color color = {
+		.r = (sample->r + sample->n / 2) / sample->n,
+		.g = (sample->g + sample->n / 2) / sample->n,
+		.b = (sample->b + sample->n / 2) / sample->n
+	};
+
+	return aes_surface_encode(format, 0, &color,
+		(1000 * sample->n + n / 2) / n);
+}
+
+/**
+ * aes_surface_draw_thumbnail - draw shapes on a reduced surface
+ * @aes_id: AES to draw with
+ * @surface: surface to draw on, where the reduction gives the number of
+ * 	AES coordinates in each direction per pixel
+ * @samples: number of samples in each direction per pixel, averaged with
+ * 	a box filter, where zero is the same as one for a single sample in
+ * 	the centre of the pixel
+ * @iterator: shapes to draw
+ * @arena: memory for drawing, or %NULL
+ *
+ * Only the sample points are ray cast, so the cost is proportional to the
+ * size of the thumbnail rather than the size of the area. Colours can be
+ * averaged with direct colour formats only, and palette index formats
+ * therefore always take a single sample. Surfaces without a reduction are
+ * drawn in full with aes_surface_draw().
+ *
+ * Return: %true on success, otherwise %false if memory allocation failed
+ */
+bool aes_surface_draw_thumbnail(aes_id_t aes_id,
+	const struct aes_surface *surface, const int samples,
+	struct aes_object_shape_iterator *iterator,
+	struct aes_surface_arena *arena)
+{
+	const int reduction = aes_surface_reduction(surface);
+
+	if (reduction == 1)
+		return aes_surface_draw(aes_id, surface, iterator, arena);
+
+	const bool average = samples > 1 &&
+		aes_surface_format_layout(surface->format) ==
+			AES_SURFACE_LAYOUT_ALIGNED &&
+		aes_surface_format_bpp(surface->format) > 8;
+	const int s = average ? samples : 1;
+	const struct aes_rectangle size = aes_surface_size(surface);
+	const size_t w = max(size.w, 1);
+	struct aes_surface_arena arena_ = { };
+
+	if (!arena)
+		arena = &arena_;
+
+	/* Pixels, sums and sample indices share the row buffer. */
+	uint64_t *pixels = aes_surface_arena_row(arena,
+		w * (sizeof(uint64_t) + sizeof(struct aes_surface_sample) +
+		     s * sizeof(int16_t)));
+	struct aes_surface_sample *sum = pixels ?
+		(struct aes_surface_sample *)&pixels[w] : NULL;
+	struct aes_surface_sample_row row = {
+		.aes_id = aes_id,
+		.reduction = reduction,
+		.samples = s,
+		.indices = sum ? (int16_t *)&sum[w] : NULL
+	};
+	const struct aes_surface_palette *palette =
+		aes_surface_arena_palette(arena, aes_id, surface->format);
+	const aes_surface_row_writer_f write_row =
+		aes_surface_row_writer(surface->format);
+	bool valid = palette && pixels;
+
+	for (int y = 0; valid && y < size.h; y++) {
+		for (int x = 0; x < size.w; x++)
+			sum[x] = (struct aes_surface_sample) { };
+
+		for (int j = 0; valid && j < s; j++) {
+			const int v = aes_surface_sample_offset(
+				s * y + j, reduction, s);
+
+			row.clip = aes_surface_row_clip(surface,
+				surface->area.p.y + v);
+
+			for (int k = 0; k < s * size.w; k++)
+				row.indices[k] = -1;
+
+			if (v < surface->area.r.h)
+				valid = aes_object_shape_layers_arena(row.clip,
+					iterator, aes_surface_sample_layer,
+					&row, &arena->layer);
+
+			for (int k = 0; valid && k < s * size.w; k++) {
+				int index = row.indices[k];
+
+				if (index >= palette->count)
+					index = -1;	/* Transparent */
+
+				if (!average) {
+					pixels[k] = palette->pixels[1 + index];
+					continue;
+				}
+
+				if (index < 0 &&
+				    surface->format != AES_SURFACE_FORMAT_RGBA16)
+					index = 0;	/* No alpha channel */
+
+				if (index >= 0)
+					aes_surface_sample_add(&sum[k / s],
+						&palette->colors[index]);
+			}
+		}
+
+		if (!valid)
+			break;
+
+		if (average)
+			for (int x = 0; x < size.w; x++)
+				pixels[x] = aes_surface_sample_pixel(
+					surface->format, &sum[x], s * s);
+
+		aes_surface_write_row(surface, write_row,
+			0, y, pixels, size.w);
+	}
+
+	aes_surface_arena_free(&arena_);
+
+	return valid;
+}
@@ -0,0 +1,185 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Copyright (C) 2022 Fredrik Noring
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <gem/aes-text.h>
+
+/**
+ * aes_text_advance - horizontal advance of a character
+ * @c: character
+ * @fnt: font
+ *
+ * Monospace fonts advance the maximum cell width for every character,
+ * including undefined ones. Proportional fonts advance the width of the
+ * character, adjusted by its horizontal offset if the font has such a
+ * table, and undefined characters take no space.
+ *
+ * Return: advance in pixels, zero or more
+ */
+int aes_text_advance(uint16_t c, const struct fnt *fnt)
+{
+	if (fnt->header->flags.monospace)
+		return fnt->header->max_cell_width;
+
+	const int w = fnt_char_width(c, fnt);
+
+	if (w <= 0)
+		return 0;
+
+	const int h = fnt->header->flags.horizontal ?
+		fnt_char_horizontal(c, fnt) : 0;
+
+	return w + h > 0 ? w + h : 0;
+}
+
+static size_t aes_text_hash(const char *s, const struct fnt *fnt)
+{
+	const uintptr_t k = (uintptr_t)s ^ ((uintptr_t)fnt >> 4);
+
+	return ((uint32_t)k * 2654435761u) >> (32 - AES_TEXT_CACHE_BITS);
+}
+
+/*
+ * Allocations are kept for the next string of the entry, and only grown
+ * for longer strings.
+ */
+static bool aes_text_layout_string(struct aes_text *text,
+	const char *s, const struct fnt *fnt)
+{
+	const size_t length = strlen(s);
+
+	if (!text->x || text->capacity < length) {
+		int *x = malloc(sizeof(int[length + 1]) + length + 1);
+
+		if (!x)
+			return false;
+
+		free(text->x);
+
+		text->x = x;
+		text->s = (char *)&x[length + 1];
+		text->capacity = length;
+	}
+
+	memcpy(text->s, s, length + 1);
+
+	text->x[0] = 0;
+	for (size_t i = 0; i < length; i++) {
+		const uint8_t k = s[i];
+
+		text->x[i + 1] = text->x[i] + aes_text_advance(k, fnt);
+	}
+
+	text->key = s;
+	text->fnt = fnt;
+	text->length = length;
+
+	return true;
+}
+
+/**
+ * aes_text_layout - layout of a string in a font
+ * @aes_id: AES id with the layout cache
+ * @s: NUL terminated string
+ * @fnt: font
+ *
+ * Layouts are cached by string address and font, and computed once for
+ * all pixels of a string. A cached layout is compared with its string on
+ * every use, so strings edited in place, or other strings at the same
+ * address, are laid out again. Strings of the same set take turns with
+ * the least recently used layout of the set.
+ *
+ * Return: layout, valid until the next call, or %NULL with errno set
+ */
+const struct aes_text *aes_text_layout(aes_id_t aes_id,
+	const char *s, const struct fnt *fnt)
+{
+	struct aes_text_cache *cache = aes_id.aes_->text;
+
+	if (!cache) {
+		if (!(cache = calloc(1, sizeof(*cache))))
+			return NULL;
+
+		aes_id.aes_->text = cache;
+	}
+
+	struct aes_text *set = cache->text[aes_text_hash(s, fnt)];
+	struct aes_text *text = &set[0];
+
+	cache->clock++;
+
+	for (size_t i = 0; i < AES_TEXT_CACHE_WAYS; i++) {
+		if (set[i].key == s && set[i].fnt == fnt) {
+			text = &set[i];
+
+			if (strcmp(text->s, s) == 0) {
+				text->used = cache->clock;
+				return text;
+			}
+
+			break;
+		}
+
+		if (set[i].used < text->used)
+			text = &set[i];
+	}
+
+	if (!aes_text_layout_string(text, s, fnt))
+		return NULL;
+
+	text->used = cache->clock;
+
+	return text;
+}
+
+/**
+ * aes_text_char_index - character at a horizontal offset of a layout
+ * @text: layout
+ * @x: horizontal offset in pixels relative to the start of the text
+ * @spacing: pixels added to the advance of every character, for example
+ * 	by thickened text
+ *
+ * Characters are found by binary search of the advance prefix sums.
+ * Characters without advance and spacing are never found.
+ *
+ * Return: index of character, or -1 if outside of the text
+ */
+int aes_text_char_index(const struct aes_text *text, int x, int spacing)
+{
+	if (x < 0 || x >= aes_text_width(text, spacing))
+		return -1;
+
+	size_t lo = 0;
+	size_t hi = text->length;
+
+	/* Find the last i such that x[i] <= x, with x[lo] <= x < x[hi]. */
+	while (hi - lo > 1) {
+		const size_t mid = lo + (hi - lo) / 2;
+
+		if (aes_text_char_x(text, mid, spacing) <= x)
+			lo = mid;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+void aes_text_cache_free(aes_id_t aes_id)
+{
+	struct aes_text_cache *cache = aes_id.aes_->text;
+
+	if (!cache)
+		return;
+
+	for (size_t i = 0; i < AES_TEXT_CACHE_SETS; i++)
+	for (size_t k = 0; k < AES_TEXT_CACHE_WAYS; k++)
+		free(cache->text[i][k].x);
+
+	free(cache);
+	aes_id.aes_->text = NULL;
+}
@@ -9,6 +9,7 @@
 #include <gem/aes-pixel.h>
 #include <gem/aes-shape.h>
 #include <gem/aes-simple.h>
+#include <gem/aes-text.h>
 #include <gem/vdi_.h>
 
 #include "internal/assert.h"
@@ -24,6 +25,7 @@ aes_id_t aes_appl_init(struct aes *aes_)
 
 void aes_appl_exit(aes_id_t aes_id)
 {
+	aes_text_cache_free(aes_id);
 	vdi_v_clswk(aes_id.aes_->vdi_id);
 }
 
@@ -4,6 +4,7 @@
  */
 
 #include <stdarg.h>
+#include <string.h>
 
 #include <gem/fnt.h>
 
@@ -74,8 +75,6 @@ bool fnt_char_pixel(const int x, const int y,
 	if (x0 < 0)
 		return false;
 
-	/* FIXME: Consider fnt->header->flags.big_endian */
-
 	const uint8_t *b = (const uint8_t *)fnt->header;
 	const uint8_t *d = &b[fnt->header->character_bitmap +
 			      fnt->header->bitmap_stride * y + ((x0 + x) / 8)];
@@ -83,6 +82,146 @@ bool fnt_char_pixel(const int x, const int y,
 	return (*d & (0x80 >> ((x0 + x) % 8))) != 0;
 }
 
+/**
+ * fnt_char_bitmap - rows of pixels of a character
+ * @bitmap: rows of pixels, left aligned with the most significant bit
+ * 	first, of @stride times the number of bitmap lines bytes
+ * @stride: size in bytes of a row, at least the width rounded up to bytes
+ * @c: character
+ * @fnt: font
+ *
+ * Rows are extracted a byte at a time from the character bitmap, shifted
+ * by the bit offset of the character. Bits beyond the width are cleared.
+ *
+ * Return: width of character in pixels, or -1 if undefined
+ */
+int fnt_char_bitmap(uint8_t *bitmap, size_t stride,
+	const uint16_t c, const struct fnt *fnt)
+{
+	const int w = fnt_char_width(c, fnt);
+	const int32_t x0 = fnt_char_offset(c, fnt);
+
+	if (w < 0 || x0 < 0 || stride < (w + 7) / 8)
+		return -1;
+
+	const uint8_t *b = (const uint8_t *)fnt->header;
+	const size_t n = (w + 7) / 8;
+	const int shift = x0 % 8;
+	const uint8_t last = w % 8 ? 0xff00 >> (w % 8) : 0xff;
+
+	for (int y = 0; y < fnt->header->bitmap_lines; y++) {
+		const uint8_t *d = &b[fnt->header->character_bitmap +
+				      fnt->header->bitmap_stride * y];
+		uint8_t *r = &bitmap[y * stride];
+
+		for (size_t i = 0, k = x0 / 8; i < n; i++, k++) {
+			const unsigned int v = (d[k] << 8) |
+				(k + 1 < fnt->header->bitmap_stride ?
+					d[k + 1] : 0);
+
+			r[i] = v >> (8 - shift);
+		}
+
+		if (n)
+			r[n - 1] &= last;
+
+		memset(&r[n], 0, stride - n);
+	}
+
+	return w;
+}
+
+static void fnt_swap(uint8_t *b, const size_t size)
+{
+	for (size_t i = 0; i < size / 2; i++) {
+		const uint8_t t = b[i];
+
+		b[i] = b[size - 1 - i];
+		b[size - 1 - i] = t;
+	}
+}
+
+static void fnt_swap_words(uint8_t *b, const size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+		fnt_swap(&b[2 * i], 2);
+}
+
+/**
+ * fnt_normalise_header - convert a big-endian font header to native form
+ * @header: header to convert in place
+ *
+ * The header words are byte-swapped if the high byte of the flags has the
+ * big-endian flag. The big-endian flag itself is kept, since the offset
+ * tables following the header are not converted.
+ */
+void fnt_normalise_header(struct fnt_header *header)
+{
+	uint8_t *b = (uint8_t *)header;
+	const size_t flags = offsetof(struct fnt_header, flags);
+
+	if (!(b[flags] & 0x04) && (b[flags + 1] & 0x04)) {
+#define FNT_HEADER_SWAP(type_, symbol_, form_)				\
+		if (sizeof(type_) == 2 || sizeof(type_) == 4)		\
+			fnt_swap(&b[offsetof(struct fnt_header, symbol_)],\
+				sizeof(type_));
+FNT_HEADER_FIELD(FNT_HEADER_SWAP)
+	}
+}
+
+/**
+ * fnt_normalise - convert a big-endian font to native little-endian form
+ * @data: font data to convert in place
+ * @size: size in bytes of @data
+ *
+ * A header with the words in big-endian order is recognised by the
+ * big-endian flag in the high byte of the flags. Such a header, and
+ * the horizontal and character offset tables of a font with the
+ * big-endian flag, are byte-swapped, and the flag is cleared. Every
+ * font accessor can then read the little-endian form without branching
+ * on the byte order. The character bitmap is a sequence of bytes in
+ * pixel order in both forms, so it is left as is.
+ *
+ * Return: %true if the font is in little-endian form, otherwise %false
+ * 	if the offset tables are beyond the end of the font
+ */
+bool fnt_normalise(void *data, const size_t size)
+{
+	struct fnt_header *header = data;
+	uint8_t *b = data;
+
+	if (size < sizeof(*header))
+		return false;
+
+	fnt_normalise_header(header);
+
+	if (!header->flags.big_endian)
+		return true;
+
+	if (header->first > header->last)
+		return false;
+
+	const size_t character_count = 1 + header->last - header->first;
+
+	if (header->flags.horizontal) {
+		if (header->horizontal_offsets +
+				2 * character_count > size)
+			return false;
+
+		fnt_swap_words(&b[header->horizontal_offsets],
+			character_count);
+	}
+
+	if (header->character_offsets + 2 * (character_count + 1) > size)
+		return false;
+
+	fnt_swap_words(&b[header->character_offsets], character_count + 1);
+
+	header->flags.big_endian = 0;
+
+	return true;
+}
+
 bool fnt_char_lighten(const int x, const int y,
 	const uint16_t c, const struct fnt *fnt)
 {
@@ -129,6 +268,10 @@ bool fnt_valid_diagnostic(const struct fnt *fnt,
 		return fnt_error(arg, diagnostic,
 			"Header %zu bytes too small", fnt->size);
 
+	if (fnt->header->flags.big_endian)
+		return fnt_error(arg, diagnostic,
+			"Big-endian font not normalised");
+
 	if (fnt->header->first > fnt->header->last)
 		return fnt_error(arg, diagnostic,
 			"First character %u greater than last %u",
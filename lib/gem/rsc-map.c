@@ -1,5 +1,6 @@
 // SPDX-License-Identifier: GPL-2.0
 
+#include <errno.h>
 #include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
@@ -7,12 +8,27 @@
 #include <gem/rsc.h>
 #include <gem/rsc-map.h>
 
+#include "internal/compare.h"
 #include "internal/print.h"
 
+/**
+ * struct rsc_map_diagnostic - state of mapping and validating an RSC file
+ * @map: map to mark
+ * @rsc: RSC file
+ * @parent: objects with children of the tree being mapped, in traversal
+ * 	order, to check their tail links once every object of the tree is
+ * 	mapped
+ * @parent_capacity: number of objects @parent can hold
+ * @diagnostic: warning and error callbacks, or %NULL
+ * @arg: argument passed to the callbacks
+ */
 struct rsc_map_diagnostic {
 	struct rsc_map *map;
 	const struct rsc *rsc;
 
+	int16_t *parent;
+	size_t parent_capacity;
+
 	const struct rsc_diagnostic *diagnostic;
 	void *arg;
 };
@@ -148,6 +164,37 @@ static bool rsc_map_header(struct rsc_map_diagnostic *map_diagnostic)
 		0, sizeof(struct rsc_header), map_diagnostic->map);
 }
 
+static bool rsc_map_string_reused(const size_t string_offset,
+	const struct rsc_map *map)
+{
+	return string_offset && string_offset < map->size &&
+	       map->entry[string_offset].start &&
+	       map->entry[string_offset].type == rsc_map_entry_type_string;
+}
+
+/*
+ * Strings referred to several times are recognised by their map entry
+ * before their length is measured, such that shared strings are scanned
+ * once regardless of the number of references.
+ */
+static bool rsc_map_string(const size_t string_offset,
+	struct rsc_map *map, const struct rsc *rsc)
+{
+	if (rsc_map_string_reused(string_offset, map))
+		return true;
+
+	const char *s = rsc_string_at_offset(string_offset, rsc);
+
+	if (!s)
+		return false;
+
+	if (!rsc_map_mark_type_reuse(rsc_map_entry_type_string,
+			string_offset, strlen(s) + 1, map))
+		return false;
+
+	return true;
+}
+
 static bool rsc_map_frstr(struct rsc_map_diagnostic *map_diagnostic)
 {
 	const struct rsc_header *h = map_diagnostic->rsc->header;
@@ -156,14 +203,11 @@ static bool rsc_map_frstr(struct rsc_map_diagnostic *map_diagnostic)
 			sizeof(uint32_t[h->rsh_nstring]), map_diagnostic->map))
 		return false;
 
-	for (size_t i = 0; i < h->rsh_nstring; i++) {
-		const char *s = rsc_string_at_index(i, map_diagnostic->rsc);
-
-		if (!s || !rsc_map_mark_type_reuse(rsc_map_entry_type_string,
-				rsc_string_offset_at_index(i, map_diagnostic->rsc),
-				strlen(s) + 1, map_diagnostic->map))
+	for (size_t i = 0; i < h->rsh_nstring; i++)
+		if (!rsc_map_string(rsc_string_offset_at_index(
+				i, map_diagnostic->rsc),
+				map_diagnostic->map, map_diagnostic->rsc))
 			return false;
-	}
 
 	return true;
 }
@@ -218,21 +262,6 @@ static bool rsc_valid_object_index(const int16_t ob,
 		rsc_unextended_size(rsc);
 }
 
-static bool rsc_map_string(const size_t string_offset,
-	struct rsc_map *map, const struct rsc *rsc)
-{
-	const char *s = rsc_string_at_offset(string_offset, rsc);
-
-	if (!s)
-		return false;
-
-	if (!rsc_map_mark_type_reuse(rsc_map_entry_type_string,
-			string_offset, strlen(s) + 1, map))
-		return false;
-
-	return true;
-}
-
 static bool rsc_map_tedinfo(const size_t tedinfo_offset,
 	struct rsc_map *map, const struct rsc *rsc)
 {
@@ -354,21 +383,63 @@ static bool rsc_mapped_object(const int16_t ob, const struct rsc_object *tree,
 			sizeof(*tree), map);
 }
 
+static bool rsc_map_parent(const size_t count, const int16_t ob,
+	struct rsc_map_diagnostic *map_diagnostic)
+{
+	if (count == map_diagnostic->parent_capacity) {
+		const size_t capacity = max_t(size_t, 64, 2 * count);
+		int16_t *parent = realloc(map_diagnostic->parent,
+			sizeof(int16_t[capacity]));
+
+		if (!parent)
+			return false;
+
+		map_diagnostic->parent = parent;
+		map_diagnostic->parent_capacity = capacity;
+	}
+
+	map_diagnostic->parent[count] = ob;
+
+	return true;
+}
+
+/*
+ * Objects are mapped in a single traversal of the tree. Tail links can
+ * only be checked once every object of the tree is mapped, so objects
+ * with children are kept in traversal order to check them afterwards,
+ * and the first misplaced last object flag is reported after them, in
+ * the same order as separate traversals would.
+ */
 static bool rsc_map_tree_objects(const struct rsc_object *tree,
 	const size_t i, struct rsc_map_diagnostic *map_diagnostic)
 {
 	const size_t tree_offset =
 		rsc_tree_offset_at_index(i, map_diagnostic->rsc);
+	int16_t not_lastob = -1;
 	int16_t lastob = 0;
+	size_t count = 0;
 
-	for (int16_t ob = 0; rsc_valid_ob(ob); ob = rsc_tree_traverse(ob, tree))
+	for (int16_t ob = 0, next; rsc_valid_ob(ob); ob = next) {
 		if (!rsc_map_object(ob, tree, tree_offset, map_diagnostic))
 			return rsc_map_error(map_diagnostic,
 				"Tree %zu object %d malformed", i, ob);
 
-	for (int16_t ob = 0; rsc_valid_ob(ob); ob = rsc_tree_traverse(ob, tree)) {
-		if (tree[ob].link.head == -1)
-			continue;
+		if (tree[ob].link.head != -1 &&
+		    !rsc_map_parent(count++, ob, map_diagnostic))
+			return rsc_map_error(map_diagnostic,
+				"Memory allocation failed");
+
+		next = rsc_tree_traverse(ob, tree);
+
+		if (tree[ob].shape.flags.lastob && rsc_valid_ob(next) &&
+		    not_lastob == -1)
+			not_lastob = ob;
+
+		lastob = ob;
+	}
+
+	for (size_t k = 0; k < count; k++) {
+		const int16_t ob = map_diagnostic->parent[k];
 
 		if (tree[ob].link.tail < 0)
 			return rsc_map_error(map_diagnostic,
@@ -386,14 +457,9 @@ static bool rsc_map_tree_objects(const struct rsc_object *tree,
 				i, ob, tree[tree[ob].link.tail].link.next, ob);
 	}
 
-	for (int16_t ob = 0; rsc_valid_ob(ob); ob = rsc_tree_traverse(ob, tree)) {
-		if (tree[ob].shape.flags.lastob &&
-		    rsc_valid_ob(rsc_tree_traverse(ob, tree)))
-			return rsc_map_error(map_diagnostic,
-				"Tree %zu object %d not last object", i, ob);
-
-		lastob = ob;
-	}
+	if (not_lastob != -1)
+		return rsc_map_error(map_diagnostic,
+			"Tree %zu object %d not last object", i, not_lastob);
 
 	if (!tree[lastob].shape.flags.lastob)
 		return rsc_map_error(map_diagnostic,
@@ -402,65 +468,81 @@ static bool rsc_map_tree_objects(const struct rsc_object *tree,
 	return true;
 }
 
-static bool rsc_map_tree(struct rsc_map_diagnostic *map_diagnostic)
+static bool rsc_map_tree_index(const size_t i,
+	struct rsc_map_diagnostic *map_diagnostic)
 {
 	const struct rsc_header *h = map_diagnostic->rsc->header;
 
-	for (size_t i = 0; i < h->rsh_ntree; i++) {
-		const struct rsc_object *tree =
-			rsc_tree_at_index(i, map_diagnostic->rsc);
+	if (!rsc_tree_at_index(i, map_diagnostic->rsc))
+		return rsc_map_error(map_diagnostic, "Tree %zu not found", i);
 
-		if (!tree)
-			return rsc_map_error(map_diagnostic, "Tree %zu not found", i);
+	if (!rsc_map_mark_type(rsc_map_entry_type_trindex,
+			h->rsh_trindex + sizeof(uint32_t[i]),
+			sizeof(uint32_t), map_diagnostic->map))
+		return rsc_map_error(map_diagnostic, "Tree %zu malformed", i);
 
-		if (!rsc_map_mark_type(rsc_map_entry_type_trindex,
-				h->rsh_trindex + sizeof(uint32_t[i]),
-				sizeof(uint32_t), map_diagnostic->map))
-			return rsc_map_error(map_diagnostic, "Tree %zu malformed", i);
+	return true;
+}
 
-		if (!rsc_map_tree_objects(tree, i, map_diagnostic))
-			return rsc_map_error(map_diagnostic, "Tree %zu malformed objects", i);
-	}
+static bool rsc_map_tree_at_index(const size_t i,
+	struct rsc_map_diagnostic *map_diagnostic)
+{
+	const struct rsc_object *tree =
+		rsc_tree_at_index(i, map_diagnostic->rsc);
+
+	if (!rsc_map_tree_objects(tree, i, map_diagnostic))
+		return rsc_map_error(map_diagnostic, "Tree %zu malformed objects", i);
+
+	return true;
+}
+
+static bool rsc_map_tree(struct rsc_map_diagnostic *map_diagnostic)
+{
+	const struct rsc_header *h = map_diagnostic->rsc->header;
+
+	for (size_t i = 0; i < h->rsh_ntree; i++)
+		if (!rsc_map_tree_index(i, map_diagnostic) ||
+		    !rsc_map_tree_at_index(i, map_diagnostic))
+			return false;
 
 	return true;
 }
 
-static bool rsc_map_padding(struct rsc_map_diagnostic *map_diagnostic)
+/*
+ * Single bytes of unused space after strings at odd offsets are marked
+ * as padding, and every other structure must be aligned to words, in a
+ * single sweep of the regions of the map in order of offset.
+ */
+static bool rsc_map_padding_alignment(
+	struct rsc_map_diagnostic *map_diagnostic)
 {
 	enum rsc_map_entry_type entry_type = rsc_map_entry_type_unused;
 	struct rsc_map_region region;
 
 	rsc_map_for_each_region (region, map_diagnostic->map) {
+		const enum rsc_map_entry_type type = region.entry.type;
+
 		if (entry_type == rsc_map_entry_type_string &&
-		    region.entry.type == rsc_map_entry_type_unused &&
+		    type == rsc_map_entry_type_unused &&
 		    region.offset % 2 &&
-		    region.size == 1)
+		    region.size == 1) {
 			if (!rsc_map_mark_type(rsc_map_entry_type_padding,
 					region.offset, region.size,
 					map_diagnostic->map))
-				return false;
-
-		entry_type = region.entry.type;
-	}
-
-	return true;
-}
-
-static bool rsc_map_alignment(struct rsc_map_diagnostic *map_diagnostic)
-{
-	struct rsc_map_region region;
-
-	rsc_map_for_each_region (region, map_diagnostic->map)
-		if (region.entry.type == rsc_map_entry_type_unused ||
-		    region.entry.type == rsc_map_entry_type_string ||
-		    region.entry.type == rsc_map_entry_type_padding)
-			continue;
-		else if (region.offset % 2 != 0)
+				return rsc_map_error(map_diagnostic,
+					"Malformed padding");
+		} else if (type != rsc_map_entry_type_unused &&
+			   type != rsc_map_entry_type_string &&
+			   type != rsc_map_entry_type_padding &&
+			   region.offset % 2 != 0)
 			return rsc_map_error(map_diagnostic,
 				"Unaligned %s at offset %zu",
-				rsc_map_entry_type_symbol(region.entry.type),
+				rsc_map_entry_type_symbol(type),
 				region.offset);
 
+		entry_type = type;
+	}
+
 	return true;
 }
 
@@ -499,17 +581,45 @@ static bool rsc_map_unextended(struct rsc_map_diagnostic *map_diagnostic)
 		map_diagnostic->map);
 }
 
+static uint8_t rsc_map_entry_byte(const struct rsc_map_entry entry)
+{
+	uint8_t b;
+
+	memcpy(&b, &entry, sizeof(b));
+
+	return b;
+}
+
+/*
+ * A region continues with entries of the same type and reservation that
+ * do not start a new region, that is entries equal to the first entry
+ * with the start bit cleared. Entries are compared eight at a time.
+ */
 static size_t rsc_map_region_size(const size_t offset, struct rsc_map *map)
 {
-	size_t i;
+	if (offset >= map->size)
+		return 0;
+
+	const uint8_t *b = (const uint8_t *)map->entry;
+	struct rsc_map_entry continued = map->entry[offset];
+
+	continued.start = 0;
 
-	for (i = 0; offset + i < map->size; i++)
-		if (map->entry[offset + i].type != map->entry[offset].type ||
-		    map->entry[offset + i].reserved != map->entry[offset].reserved ||
-		    (i > 0 && map->entry[offset + i].start))
+	const uint8_t c = rsc_map_entry_byte(continued);
+	const uint64_t cc = c * 0x0101010101010101ull;
+	size_t i = offset + 1;
+
+	for (uint64_t w; i + 8 <= map->size; i += 8) {
+		memcpy(&w, &b[i], sizeof(w));
+
+		if (w != cc)
 			break;
+	}
 
-	return i;
+	while (i < map->size && b[i] == c)
+		i++;
+
+	return i - offset;
 }
 
 struct rsc_map_region rsc_map_first_region(struct rsc_map *map)
@@ -575,10 +685,7 @@ static bool rsc_map_diagnostic(struct rsc_map_diagnostic *map_diagnostic)
 	if (!rsc_map_tree(map_diagnostic))
 		return rsc_map_error(map_diagnostic, "Malformed tree");
 
-	if (!rsc_map_padding(map_diagnostic))
-		return rsc_map_error(map_diagnostic, "Malformed padding");
-
-	if (!rsc_map_alignment(map_diagnostic))
+	if (!rsc_map_padding_alignment(map_diagnostic))
 		return false;
 
 	if (!rsc_map_reservations(map_diagnostic))
@@ -593,8 +700,11 @@ static bool rsc_map_diagnostic(struct rsc_map_diagnostic *map_diagnostic)
 bool rsc_map(struct rsc_map *map, const struct rsc *rsc)
 {
 	struct rsc_map_diagnostic map_diagnostic = { .map = map, .rsc = rsc };
+	const bool valid = rsc_map_diagnostic(&map_diagnostic);
+
+	free(map_diagnostic.parent);
 
-	return rsc_map_diagnostic(&map_diagnostic);
+	return valid;
 }
 
 bool rsc_valid_map(const struct rsc *rsc,
@@ -614,7 +724,178 @@ bool rsc_valid_map(const struct rsc *rsc,
 
 	const bool valid = rsc_map_diagnostic(&map_diagnostic);
 
+	free(map_diagnostic.parent);
 	rsc_map_free(map_diagnostic.map);
 
 	return valid;
 }
+
+/**
+ * struct rsc_lazy - RSC file with trees validated on first access
+ * @map_diagnostic: map shared by all trees, and diagnostic callbacks
+ * @tree: validation state of every tree
+ */
+struct rsc_lazy {
+	struct rsc_map_diagnostic map_diagnostic;
+	enum rsc_lazy_tree {
+		rsc_lazy_tree_unknown,
+		rsc_lazy_tree_valid,
+		rsc_lazy_tree_invalid,
+	} *tree;
+};
+
+/*
+ * Maps the header, the free strings and images, and the tree index, that
+ * every tree is validated against.
+ */
+static bool rsc_lazy_map(struct rsc_map_diagnostic *map_diagnostic)
+{
+	const struct rsc_header *h = map_diagnostic->rsc->header;
+
+	memset(map_diagnostic->map->entry, 0, map_diagnostic->map->size);
+
+	if (!rsc_map_header(map_diagnostic))
+		return rsc_map_error(map_diagnostic, "Malformed header");
+
+	if (!rsc_map_frstr(map_diagnostic))
+		return rsc_map_error(map_diagnostic, "Malformed frstr");
+
+	if (!rsc_map_frimg(map_diagnostic))
+		return rsc_map_error(map_diagnostic, "Malformed frimg");
+
+	for (size_t i = 0; i < h->rsh_ntree; i++)
+		if (!rsc_map_tree_index(i, map_diagnostic))
+			return rsc_map_error(map_diagnostic, "Malformed tree");
+
+	return true;
+}
+
+/*
+ * An invalid tree may have marked some of its structures before failing,
+ * and those marks would make later trees that share or overlap them fail
+ * too, depending on the order of access. The map is therefore made again
+ * of the structures of the file and the valid trees, which succeeds since
+ * all of them were mapped together before. Diagnostics were reported
+ * already, so they are not reported again.
+ */
+static void rsc_lazy_unmap_invalid(struct rsc_lazy *lazy)
+{
+	struct rsc_map_diagnostic *map_diagnostic = &lazy->map_diagnostic;
+	const struct rsc_diagnostic *diagnostic = map_diagnostic->diagnostic;
+	const struct rsc_header *h = map_diagnostic->rsc->header;
+
+	map_diagnostic->diagnostic = NULL;
+
+	rsc_lazy_map(map_diagnostic);
+
+	for (size_t i = 0; i < h->rsh_ntree; i++)
+		if (lazy->tree[i] == rsc_lazy_tree_valid)
+			rsc_map_tree_at_index(i, map_diagnostic);
+
+	map_diagnostic->diagnostic = diagnostic;
+}
+
+/**
+ * rsc_lazy_open - validate an RSC file except for its trees
+ * @rsc: RSC file, that must remain unchanged until rsc_lazy_close()
+ * @diagnostic: warning and error callbacks, or %NULL
+ * @arg: argument passed to the callbacks
+ *
+ * The header, the free strings and images, and the tree index are
+ * validated. Trees are validated on first access by rsc_lazy_tree_at_index(),
+ * such that opening a large file to use a few of its trees takes time
+ * independent of the number of trees. All trees share one map, so trees
+ * that overlap other structures are rejected as by rsc_valid_structure().
+ * Padding, alignment, reservations and the unextended structure concern
+ * the whole file, and are only validated by rsc_valid_structure().
+ *
+ * Return: lazily validated RSC file, or %NULL with errno set
+ */
+struct rsc_lazy *rsc_lazy_open(const struct rsc *rsc,
+	const struct rsc_diagnostic *diagnostic, void *arg)
+{
+	const struct rsc_diagnostic no_diagnostic = { };
+
+	if (!rsc_valid_header_diagnostic(rsc,
+			diagnostic ? diagnostic : &no_diagnostic, arg)) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	struct rsc_lazy *lazy = calloc(1, sizeof(*lazy));
+
+	if (!lazy)
+		return NULL;
+
+	lazy->map_diagnostic = (struct rsc_map_diagnostic) {
+		.map = rsc_map_alloc(rsc),
+		.rsc = rsc,
+
+		.diagnostic = diagnostic,
+		.arg = arg
+	};
+	lazy->tree = calloc(max_t(size_t, rsc->header->rsh_ntree, 1),
+		sizeof(*lazy->tree));
+
+	if (!lazy->map_diagnostic.map || !lazy->tree) {
+		rsc_lazy_close(lazy);
+		return NULL;
+	}
+
+	if (!rsc_lazy_map(&lazy->map_diagnostic)) {
+		rsc_lazy_close(lazy);
+		errno = EINVAL;
+
+		return NULL;
+	}
+
+	return lazy;
+}
+
+/**
+ * rsc_lazy_tree_at_index - validated tree of an RSC file
+ * @lazy: lazily validated RSC file
+ * @i: index of tree
+ *
+ * The objects of the tree, and their tedinfos, iconblks, bitblks and
+ * strings, are validated on the first access, and the result is kept for
+ * later accesses. Diagnostics are reported on the first access only.
+ * Whether a tree is valid is independent of the order of access, except
+ * that of two trees that overlap each other only the tree accessed first
+ * is valid. rsc_valid_structure() rejects such files altogether.
+ *
+ * Return: tree, or %NULL if out of range or invalid
+ */
+struct rsc_object *rsc_lazy_tree_at_index(struct rsc_lazy *lazy,
+	const size_t i)
+{
+	const struct rsc *rsc = lazy->map_diagnostic.rsc;
+
+	if (i >= rsc->header->rsh_ntree)
+		return (struct rsc_object *)NULL;
+
+	if (lazy->tree[i] == rsc_lazy_tree_unknown) {
+		const bool valid = rsc_map_tree_at_index(i,
+			&lazy->map_diagnostic);
+
+		lazy->tree[i] = valid ?
+			rsc_lazy_tree_valid : rsc_lazy_tree_invalid;
+
+		if (!valid)
+			rsc_lazy_unmap_invalid(lazy);
+	}
+
+	return lazy->tree[i] == rsc_lazy_tree_valid ?
+		rsc_tree_at_index(i, rsc) : (struct rsc_object *)NULL;
+}
+
+void rsc_lazy_close(struct rsc_lazy *lazy)
+{
+	if (!lazy)
+		return;
+
+	free(lazy->map_diagnostic.parent);
+	rsc_map_free(lazy->map_diagnostic.map);
+	free(lazy->tree);
+	free(lazy);
+}
@@ -313,6 +313,21 @@ static bool rsc_valid_header_rssize(const struct rsc *rsc,
 	return valid;
 }
 
+bool rsc_valid_header_diagnostic(const struct rsc *rsc,
+	const struct rsc_diagnostic *diagnostic, void *arg)
+{
+	if (!rsc_valid_header(rsc))
+		return rsc_error(arg, diagnostic, "Malformed header");
+
+	if (!rsc_valid_header_vrsn(rsc, diagnostic, arg))
+		return false;
+
+	if (!rsc_valid_header_rssize(rsc, diagnostic, arg))
+		return false;
+
+	return true;
+}
+
 bool rsc_valid_structure_diagnostic(const struct rsc *rsc,
 	const struct rsc_diagnostic *diagnostic, void *arg)
 {
@@ -336,13 +351,7 @@ bool rsc_valid_structure_diagnostic(const struct rsc *rsc,
 	BUILD_BUG_ON(sizeof(struct rsc_iconblk_area)       !=  8);
 	BUILD_BUG_ON(sizeof(struct rsc_iconblk)            != 34);
 
-	if (!rsc_valid_header(rsc))
-		return rsc_error(arg, diagnostic, "Malformed header");
-
-	if (!rsc_valid_header_vrsn(rsc, diagnostic, arg))
-		return false;
-
-	if (!rsc_valid_header_rssize(rsc, diagnostic, arg))
+	if (!rsc_valid_header_diagnostic(rsc, diagnostic, arg))
 		return false;
 
 	if (!rsc_valid_map(rsc, diagnostic, arg))
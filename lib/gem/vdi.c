@@ -1,11 +1,20 @@
 // SPDX-License-Identifier: GPL-2.0
 
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include <gem/color.h>
 #include <gem/vdi_.h>
 
+#include "internal/compare.h"
+#include "internal/file.h"
+#include "internal/macro.h"
 #include "internal/print.h"
 #include "internal/storage.h"
 #include "internal/string.h"
@@ -17,6 +26,13 @@ void vdi_v_clswk(vdi_id_t vdi_id)
 	while ((vdi_fnt = list_first_entry_or_null(
 			&vdi_id.vdi->font.list, struct vdi_fnt, list))) {
 		list_del(&vdi_fnt->list);
+
+		for (size_t i = 0; i < ARRAY_SIZE(vdi_fnt->effect); i++)
+			free(vdi_fnt->effect[i]);
+
+		if (vdi_fnt->map)
+			munmap(vdi_fnt->map, vdi_fnt->fnt.size);
+
 		free(vdi_fnt);
 	}
 
@@ -59,12 +75,234 @@ GEM_PALETTE_COLOR(VDI_SYSTEM_COLOR)
 					file->path);
 		}
 
+	vdi->text.height = vdi->font.large ? vdi->font.large->header->top : 0;
+	vst_font(vdi_id, VDI_SYSTEM_FONT);
+
 	return vdi_id;
 }
 
+static size_t vdi_fnt_hash(const uint16_t id, const uint16_t point,
+	const uint16_t height)
+{
+	const uint64_t k = ((uint64_t)id << 32) |
+		((uint32_t)point << 16) | height;
+
+	return (k * 0x9e3779b97f4a7c15ull) >> (64 - VDI_FNT_HASH_BITS);
+}
+
+static size_t vdi_fnt_face_hash(const uint16_t id)
+{
+	return (id * 2654435761u) >> (32 - VDI_FNT_HASH_BITS);
+}
+
+static void vdi_fnt_register(struct vdi_ *vdi, struct vdi_fnt *vdi_fnt)
+{
+	const struct fnt_header *header = vdi_fnt->fnt.header;
+	struct vdi_fnt **hash = &vdi->font.hash[vdi_fnt_hash(header->id,
+		header->point, header->bitmap_lines)];
+	struct vdi_fnt **face = &vdi->font.face[vdi_fnt_face_hash(header->id)];
+
+	vdi_fnt->hash_next = *hash;
+	*hash = vdi_fnt;
+
+	vdi_fnt->face_next = *face;
+	*face = vdi_fnt;
+}
+
+static bool vdi_fnt_same_key(const struct fnt_header *a,
+	const struct fnt_header *b)
+{
+	return a->id == b->id &&
+	       a->point == b->point &&
+	       a->top == b->top &&
+	       a->bitmap_lines == b->bitmap_lines;
+}
+
+/*
+ * Maps the font file of a font indexed by vst_load_fonts(), unless already
+ * mapped. The mapping is private, such that big-endian fonts are normalised
+ * in copies of the pages without changing the file.
+ */
+static bool vdi_fnt_map(struct vdi_fnt *vdi_fnt)
+{
+	if (!vdi_fnt->path || vdi_fnt->map)
+		return true;
+	if (vdi_fnt->invalid)
+		return false;
+
+	void *map = MAP_FAILED;
+	struct stat st = { };
+	const int fd = xopen(vdi_fnt->path, O_RDONLY);
+
+	if (fd >= 0) {
+		if (fstat(fd, &st) == 0 &&
+		    st.st_size >= sizeof(struct fnt_header))
+			map = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE, fd, 0);
+
+		xclose(fd);
+	}
+
+	const struct fnt fnt = { .size = st.st_size, .header = map };
+
+	if (map == MAP_FAILED ||
+	    !fnt_normalise(map, fnt.size) ||
+	    !vdi_fnt_same_key(fnt.header, &vdi_fnt->index) ||
+	    !fnt_valid(&fnt)) {
+		if (map != MAP_FAILED)
+			munmap(map, st.st_size);
+
+		pr_warn("%s: font failed to load\n", vdi_fnt->path);
+		vdi_fnt->invalid = true;
+
+		return false;
+	}
+
+	vdi_fnt->map = map;
+	vdi_fnt->fnt = fnt;
+
+	return true;
+}
+
+/**
+ * vdi_fnt_lookup - font by face id, point size and cell height
+ * @vdi_id: VDI id
+ * @id: face id
+ * @point: point size
+ * @height: cell height in pixels
+ *
+ * Fonts are registered in a hash table, such that lookups take constant
+ * time regardless of the number of fonts loaded. The most recently loaded
+ * font is found if several have the same face id, point size and height.
+ * Fonts indexed by vst_load_fonts() are mapped when first found.
+ *
+ * Return: font, or %NULL if none is loaded
+ */
+struct fnt *vdi_fnt_lookup(vdi_id_t vdi_id, const uint16_t id,
+	const uint16_t point, const uint16_t height)
+{
+	for (struct vdi_fnt *vdi_fnt =
+			vdi_id.vdi->font.hash[vdi_fnt_hash(id, point, height)];
+	     vdi_fnt; vdi_fnt = vdi_fnt->hash_next) {
+		const struct fnt_header *header = vdi_fnt->fnt.header;
+
+		if (header->id == id &&
+		    header->point == point &&
+		    header->bitmap_lines == height &&
+		    vdi_fnt_map(vdi_fnt))
+			return &vdi_fnt->fnt;
+	}
+
+	return NULL;
+}
+
+/*
+ * Selects the largest font of the face whose height from the baseline to
+ * the top line is at most the text height, or otherwise the smallest font
+ * of the face. Only the fonts of the face bucket are considered, and only
+ * the selected font is mapped if it was indexed by vst_load_fonts().
+ */
+static struct vdi_fnt *vdi_text_select_index(struct vdi_ *vdi)
+{
+	struct vdi_fnt *best = NULL;
+
+	for (struct vdi_fnt *vdi_fnt =
+			vdi->font.face[vdi_fnt_face_hash(vdi->text.face)];
+	     vdi_fnt; vdi_fnt = vdi_fnt->face_next) {
+		const struct fnt_header *header = vdi_fnt->fnt.header;
+
+		if (header->id != vdi->text.face || vdi_fnt->invalid)
+			continue;
+
+		if (!best)
+			best = vdi_fnt;
+		else if (header->top <= vdi->text.height ?
+				best->fnt.header->top > vdi->text.height ||
+				best->fnt.header->top < header->top :
+				best->fnt.header->top > vdi->text.height &&
+				best->fnt.header->top > header->top)
+			best = vdi_fnt;
+	}
+
+	return best;
+}
+
+static struct fnt *vdi_text_select(struct vdi_ *vdi)
+{
+	struct vdi_fnt *vdi_fnt;
+
+	while ((vdi_fnt = vdi_text_select_index(vdi)) && !vdi_fnt_map(vdi_fnt))
+		;
+
+	return vdi->text.fnt = vdi_fnt ? &vdi_fnt->fnt : NULL;
+}
+
+/**
+ * vst_font - select text face
+ * @vdi_id: VDI id
+ * @font: face id
+ *
+ * The system font is selected if no font of the face is loaded. The size
+ * is selected as by vst_height() with the current text height.
+ *
+ * Return: selected face id
+ */
+int16_t vst_font(vdi_id_t vdi_id, const int16_t font)
+{
+	struct vdi_ *vdi = vdi_id.vdi;
+
+	vdi->text.face = font;
+
+	if (!vdi_text_select(vdi) && font != VDI_SYSTEM_FONT) {
+		vdi->text.face = VDI_SYSTEM_FONT;
+		vdi_text_select(vdi);
+	}
+
+	return vdi->text.face;
+}
+
+/**
+ * vst_height - select text height
+ * @vdi_id: VDI id
+ * @height: height in pixels from the baseline to the top line
+ * @char_width: maximum character width of selected font
+ * @char_height: height from the baseline to the top line of selected font
+ * @cell_width: maximum cell width of selected font
+ * @cell_height: cell height of selected font
+ *
+ * The largest font of the current face not exceeding @height is selected,
+ * or the smallest font of the face if all are larger.
+ */
+void vst_height(vdi_id_t vdi_id, const int16_t height,
+	int16_t *char_width, int16_t *char_height,
+	int16_t *cell_width, int16_t *cell_height)
+{
+	struct vdi_ *vdi = vdi_id.vdi;
+
+	vdi->text.height = height;
+
+	const struct fnt *fnt = vdi_text_select(vdi);
+
+	*char_width  = fnt ? fnt->header->max_char_width : 0;
+	*char_height = fnt ? fnt->header->top            : 0;
+	*cell_width  = fnt ? fnt->header->max_cell_width : 0;
+	*cell_height = fnt ? fnt->header->bitmap_lines   : 0;
+}
+
+/**
+ * vdi_text_fnt - font selected by vst_font() and vst_height()
+ * @vdi_id: VDI id
+ *
+ * Return: selected font, or %NULL if none is loaded
+ */
+struct fnt *vdi_text_fnt(vdi_id_t vdi_id)
+{
+	return vdi_id.vdi->text.fnt;
+}
+
 bool vq_color(const vdi_id_t vdi_id, const int index, struct vdi_color *color)
 {
-	if (index < 0 && index >= vdi_id.vdi->palette.count)
+	if (index < 0 || index >= vdi_id.vdi->palette.count)
 		return false;
 
 	*color = vdi_id.vdi->palette.colors[index];
@@ -72,11 +310,12 @@ bool vq_color(const vdi_id_t vdi_id, const int index, struct vdi_color *color)
 	return true;
 }
 
+/*
+ * Fonts are copied and normalised to little-endian form, such that big-endian
+ * fonts are byte-swapped once here rather than on every access.
+ */
 bool vdi_v_fontinit(vdi_id_t vdi_id, const struct fnt *fnt)
 {
-	if (!fnt_valid(fnt))
-		return false;
-
 	struct vdi_fnt *vdi_fnt =
 		malloc(sizeof(*vdi_fnt) + fnt->size);
 
@@ -93,7 +332,13 @@ bool vdi_v_fontinit(vdi_id_t vdi_id, const struct fnt *fnt)
 	};
 	memcpy(d, fnt->header, fnt->size);
 
+	if (!fnt_normalise(d, fnt->size) || !fnt_valid(&vdi_fnt->fnt)) {
+		free(vdi_fnt);
+		return false;
+	}
+
 	list_add(&vdi_fnt->list, &vdi_id.vdi->font.list);
+	vdi_fnt_register(vdi_id.vdi, vdi_fnt);
 
 	if (!vdi_id.vdi->font.large ||
 	    fnt_cmp(vdi_id.vdi->font.large, &vdi_fnt->fnt) <= 0)
@@ -105,3 +350,267 @@ bool vdi_v_fontinit(vdi_id_t vdi_id, const struct fnt *fnt)
 
 	return true;
 }
+
+static bool vdi_fnt_effect_bit(const uint8_t *r, const int x, const int w)
+{
+	return x >= 0 && x < w && (r[x / 8] & (0x80 >> (x % 8))) != 0;
+}
+
+/* Skewed rows are shifted right by the skew mask bits of rows below them. */
+static int vdi_fnt_skew_offset(const struct fnt_header *header, const int y)
+{
+	int offset = 0;
+
+	for (int k = 0; k < header->bitmap_lines - 1 - y; k++)
+		if (header->skew_mask & (0x8000 >> (k & 0xf)))
+			offset++;
+
+	return offset;
+}
+
+static bool vdi_fnt_effect_pixel(const int x, const int y,
+	const uint8_t *r, const int w, const struct fnt_header *header,
+	const unsigned int effects)
+{
+	const int underline = header->top + 1;
+
+	if ((effects & VDI_TEXT_EFFECT_UNDERLINE) &&
+	    y >= underline && y < underline + header->underline_size)
+		return true;
+
+	const int sx = effects & VDI_TEXT_EFFECT_SKEW ?
+		x - vdi_fnt_skew_offset(header, y) : x;
+	const int thicken = effects & VDI_TEXT_EFFECT_THICKEN ?
+		header->thicken_size : 0;
+	bool pixel = false;
+
+	for (int t = 0; t <= thicken && !pixel; t++)
+		pixel = vdi_fnt_effect_bit(r, sx - t, w);
+
+	if (effects & VDI_TEXT_EFFECT_LIGHTEN)
+		pixel = pixel &&
+			(header->lighten_mask & (1 << ((sx + y) & 0xf)));
+
+	return pixel;
+}
+
+static struct vdi_fnt_effect *vdi_fnt_effect_glyphs(const struct fnt *fnt,
+	const unsigned int effects)
+{
+	const struct fnt_header *header = fnt->header;
+	const size_t count = header->last - header->first + 1;
+	const int lines = header->bitmap_lines;
+	const int spacing = effects & VDI_TEXT_EFFECT_THICKEN ?
+		header->thicken_size : 0;
+	const int overhang = effects & VDI_TEXT_EFFECT_SKEW ?
+		vdi_fnt_skew_offset(header, 0) : 0;
+	const int extra = spacing + overhang;
+	int max_width = 0;
+
+	for (size_t k = 0; k < count; k++)
+		max_width = max(max_width,
+			fnt_char_width(header->first + k, fnt));
+
+	const size_t stride = (max_width + extra + 7) / 8;
+	struct vdi_fnt_effect *effect = malloc(sizeof(*effect) +
+		sizeof(uint16_t[count]) + count * lines * stride);
+	uint8_t *glyph = malloc(max(lines * stride, (size_t)1));
+
+	if (!effect || !glyph) {
+		free(glyph);
+		free(effect);
+		return NULL;
+	}
+
+	*effect = (struct vdi_fnt_effect) {
+		.width = (uint16_t *)&effect[1],
+		.max_width = max_width + extra,
+		.spacing = spacing,
+		.overhang = overhang,
+		.stride = stride,
+	};
+	effect->bitmap = (uint8_t *)&effect->width[count];
+	memset(effect->bitmap, 0, count * lines * stride);
+
+	for (size_t k = 0; k < count; k++) {
+		const int w = fnt_char_bitmap(glyph, stride,
+			header->first + k, fnt);
+
+		effect->width[k] = w > 0 ? w + extra : 0;
+
+		for (int y = 0; y < lines; y++) {
+			uint8_t *r = &effect->bitmap[stride * (k * lines + y)];
+
+			for (int x = 0; x < effect->width[k]; x++)
+				if (vdi_fnt_effect_pixel(x, y,
+						&glyph[y * stride], w,
+						header, effects))
+					r[x / 8] |= 0x80 >> (x % 8);
+		}
+	}
+
+	free(glyph);
+
+	return effect;
+}
+
+/**
+ * vdi_fnt_effect - glyphs of a font with text effects applied
+ * @fnt: font of a VDI workstation
+ * @effects: combination of &enum vdi_text_effect bits
+ *
+ * Glyphs are made once per font and combination of effects, from the
+ * thicken size, lighten mask, skew mask and underline size of the font
+ * header, such that text with effects costs the same as plain text.
+ * Thickened glyphs are wider than the plain glyphs and advance by the
+ * thicken size more. Skewed glyphs are wider too, and overhang the next
+ * character and the end of the text by the skew offset of the top row.
+ *
+ * Return: glyphs, or %NULL with errno set
+ */
+const struct vdi_fnt_effect *vdi_fnt_effect(struct fnt *fnt,
+	unsigned int effects)
+{
+	struct vdi_fnt *vdi_fnt = container_of(fnt, struct vdi_fnt, fnt);
+
+	if (effects >= ARRAY_SIZE(vdi_fnt->effect)) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	if (!vdi_fnt->effect[effects])
+		vdi_fnt->effect[effects] = vdi_fnt_effect_glyphs(fnt, effects);
+
+	return vdi_fnt->effect[effects];
+}
+
+static bool vdi_fnt_suffix(const char *path)
+{
+	const size_t length = strlen(path);
+
+	return length >= 4 && strcasecmp(&path[length - 4], ".fnt") == 0;
+}
+
+static bool vdi_fnt_index(vdi_id_t vdi_id, const char *path)
+{
+	struct fnt_header header;
+	const int fd = xopen(path, O_RDONLY);
+
+	if (fd < 0)
+		return false;
+
+	const ssize_t r = xread(fd, &header, sizeof(header));
+
+	xclose(fd);
+
+	if (r != sizeof(header))
+		return false;
+
+	const size_t size = strlen(path) + 1;
+	struct vdi_fnt *vdi_fnt = malloc(sizeof(*vdi_fnt) + size);
+
+	if (!vdi_fnt)
+		return false;
+
+	char *p = (char *)&vdi_fnt[1];
+
+	memcpy(p, path, size);
+
+	*vdi_fnt = (struct vdi_fnt) {
+		.path = p,
+		.index = header
+	};
+	vdi_fnt->fnt.header = &vdi_fnt->index;
+	fnt_normalise_header(&vdi_fnt->index);
+
+	list_add_tail(&vdi_fnt->list, &vdi_id.vdi->font.list);
+	vdi_fnt_register(vdi_id.vdi, vdi_fnt);
+
+	return true;
+}
+
+/*
+ * Fonts indexed most recently are at the heads of their hash chains and
+ * at the tail of the font list, so they are unregistered in reverse order.
+ */
+static void vdi_fnt_unindex_last(struct vdi_ *vdi)
+{
+	struct vdi_fnt *vdi_fnt = list_last_entry(&vdi->font.list,
+		struct vdi_fnt, list);
+	const struct fnt_header *header = vdi_fnt->fnt.header;
+
+	vdi->font.hash[vdi_fnt_hash(header->id, header->point,
+		header->bitmap_lines)] = vdi_fnt->hash_next;
+	vdi->font.face[vdi_fnt_face_hash(header->id)] = vdi_fnt->face_next;
+
+	list_del(&vdi_fnt->list);
+	free(vdi_fnt);
+}
+
+static int vdi_fnt_dirent(const struct dirent *d)
+{
+	return vdi_fnt_suffix(d->d_name);
+}
+
+static int vdi_fnt_dirent_compare(const struct dirent **a,
+	const struct dirent **b)
+{
+	return strcmp((*a)->d_name, (*b)->d_name);
+}
+
+/**
+ * vst_load_fonts - index the fonts of a GDOS font directory
+ * @vdi_id: VDI id
+ * @path: directory of FNT files
+ *
+ * Only the header of every FNT file is read, to register the font by face
+ * id, point size and cell height. A font file is mapped and validated when
+ * the font is first selected, such that opening a directory takes time
+ * independent of the sizes of its fonts, and memory is spent only on fonts
+ * in use. Fonts that fail to load are skipped when selecting.
+ *
+ * Files are indexed in byte order of their names, rather than in the
+ * order of the directory, so that the most recently loaded of fonts with
+ * the same key is the same on every file system. If the directory fails
+ * to be read, no font of it remains indexed.
+ *
+ * Return: number of fonts indexed, or -1 with errno set if the directory
+ * 	could not be read
+ */
+int vst_load_fonts(vdi_id_t vdi_id, const char *path)
+{
+	const char *sep = strsuffix("/", path) ? "" : "/";
+	struct dirent **d;
+	const int n = scandir(path, &d, vdi_fnt_dirent, vdi_fnt_dirent_compare);
+	int count = 0;
+
+	if (n < 0)
+		return -1;
+
+	for (int i = 0; i < n; i++) {
+		struct strbuf sb = { };
+
+		if (!sbprintf(&sb, "%s%s%s", path, sep, d[i]->d_name)) {
+			preserve (errno) {
+				while (count--)
+					vdi_fnt_unindex_last(vdi_id.vdi);
+			}
+
+			count = -1;
+			break;
+		}
+
+		if (vdi_fnt_index(vdi_id, sb.s))
+			count++;
+		else
+			pr_warn("%s: font header failed to read\n", sb.s);
+
+		free(sb.s);
+	}
+
+	for (int i = 0; i < n; i++)
+		free(d[i]);
+	free(d);
+
+	return count;
+}
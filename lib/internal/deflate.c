@@ -0,0 +1,869 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Copyright (C) 2022 Fredrik Noring
+ *
+ * Deflate compression as specified by RFC 1951, in the zlib format of
+ * RFC 1950. Matches are found with hash chains and lazy evaluation, and
+ * every block is written with dynamic Huffman codes, fixed Huffman codes
+ * or stored, whichever is smallest.
+ *
+ * Data is compressed as it is written, in a buffer that slides by whole
+ * windows, and blocks are given to a callback as soon as they are done.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "internal/assert.h"
+#include "internal/compare.h"
+#include "internal/deflate.h"
+#include "internal/macro.h"
+
+#define DEFLATE_WINDOW		32768
+#define DEFLATE_MIN_MATCH	3
+#define DEFLATE_MAX_MATCH	258
+#define DEFLATE_NICE_MATCH	128
+#define DEFLATE_MAX_CHAIN	128
+#define DEFLATE_TOO_FAR		4096	/* Distance too far for length 3 */
+#define DEFLATE_HASH_BITS	15
+#define DEFLATE_BLOCK_TOKENS	16384
+#define DEFLATE_STORED_MAX	65535
+#define DEFLATE_BUFFER		(4 * DEFLATE_WINDOW)
+#define DEFLATE_LOOKAHEAD	(DEFLATE_MAX_MATCH + DEFLATE_MIN_MATCH)
+
+#define DEFLATE_LITLEN_CODES	286
+#define DEFLATE_FIXED_CODES	288	/* Two more that are never used */
+#define DEFLATE_DISTANCE_CODES	30
+#define DEFLATE_CODELEN_CODES	19
+#define DEFLATE_END_OF_BLOCK	256
+
+static const uint16_t length_base[29] = {
+	3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+	35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+
+static const uint8_t length_extra[29] = {
+	0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+	3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+
+static const uint16_t distance_base[30] = {
+	1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+	257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+	8193, 12289, 16385, 24577
+};
+
+static const uint8_t distance_extra[30] = {
+	0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+	7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+static const uint8_t codelen_order[DEFLATE_CODELEN_CODES] = {
+	16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+};
+
+static const uint8_t codelen_extra[DEFLATE_CODELEN_CODES] = {
+	[16] = 2, [17] = 3, [18] = 7
+};
+
+/**
+ * struct deflate_token - literal or match
+ * @length: literal byte if @distance is zero, otherwise match length
+ * @distance: match distance, or zero for a literal
+ */
+struct deflate_token {
+	uint16_t length;
+	uint16_t distance;
+};
+
+struct deflate_match {
+	int length;
+	int distance;
+};
+
+/**
+ * struct deflate_code - Huffman code
+ * @code: bit reversed code, as deflate packs codes starting with their
+ * 	most significant bit
+ * @length: length in bits of code, or zero if unused
+ */
+struct deflate_code {
+	uint16_t code;
+	uint8_t length;
+};
+
+struct deflate_rle {
+	uint8_t symbol;
+	uint8_t extra;
+};
+
+/**
+ * struct zlib_writer - zlib stream compressed as it is written
+ * @write: callback to write compressed data
+ * @arg: argument passed to @write
+ * @adler: Adler-32 checksum of data written so far
+ * @size: size in bytes of @in
+ * @pos: position in @in to compress next
+ * @pending: match deferred by lazy evaluation
+ * @out: compressed data not yet given to @write
+ * @block_start: position in @in where the current block starts
+ * @block_end: position in @in where the current block ends
+ * @in: sliding buffer of data, with at least a window before @pos
+ */
+struct zlib_writer {
+	bool (*write)(const void *buf, size_t nbyte, void *arg);
+	void *arg;
+	uint32_t adler;
+
+	size_t size;
+	size_t pos;
+	struct deflate_match pending;
+
+	struct {
+		uint8_t *data;
+		size_t size;
+		size_t capacity;
+		uint64_t bits;
+		int count;
+		bool valid;
+		int errno_;
+	} out;
+
+	size_t block_start;
+	size_t block_end;
+	size_t token_count;
+	struct deflate_token token[DEFLATE_BLOCK_TOKENS];
+	uint32_t litlen_freq[DEFLATE_LITLEN_CODES];
+	uint32_t distance_freq[DEFLATE_DISTANCE_CODES];
+
+	uint8_t length_symbol[DEFLATE_MAX_MATCH + 1];
+	uint8_t distance_symbol[512];
+
+	int32_t head[1 << DEFLATE_HASH_BITS];
+	int32_t prev[DEFLATE_WINDOW];
+
+	uint8_t in[DEFLATE_BUFFER];
+};
+
+uint32_t adler32(uint32_t adler, const void *buf, size_t nbyte)
+{
+	const uint8_t *b = buf;
+	uint32_t s1 = adler & 0xffff;
+	uint32_t s2 = adler >> 16;
+
+	while (nbyte) {
+		size_t n = min_t(size_t, nbyte, 5552);	/* No overflow */
+
+		nbyte -= n;
+
+		while (n--) {
+			s1 += *b++;
+			s2 += s1;
+		}
+
+		s1 %= 65521;
+		s2 %= 65521;
+	}
+
+	return (s2 << 16) | s1;
+}
+
+static void deflate_fail(struct zlib_writer *d)
+{
+	if (d->out.valid)
+		d->out.errno_ = errno;
+
+	d->out.valid = false;
+}
+
+static void deflate_flush(struct zlib_writer *d)
+{
+	if (d->out.valid && d->out.size &&
+	    !d->write(d->out.data, d->out.size, d->arg))
+		deflate_fail(d);
+
+	d->out.size = 0;
+}
+
+static void deflate_put_byte(struct zlib_writer *d, const uint8_t b)
+{
+	if (d->out.size == d->out.capacity) {
+		const size_t capacity = max_t(size_t, 0x1000,
+			2 * d->out.capacity);
+		uint8_t *data = realloc(d->out.data, capacity);
+
+		if (!data) {
+			deflate_fail(d);
+			return;
+		}
+
+		d->out.data = data;
+		d->out.capacity = capacity;
+	}
+
+	d->out.data[d->out.size++] = b;
+}
+
+static void deflate_put_bits(struct zlib_writer *d,
+	const uint32_t value, const int n)
+{
+	d->out.bits |= (uint64_t)value << d->out.count;
+	d->out.count += n;
+
+	while (d->out.count >= 8) {
+		deflate_put_byte(d, d->out.bits & 0xff);
+		d->out.bits >>= 8;
+		d->out.count -= 8;
+	}
+}
+
+static void deflate_align(struct zlib_writer *d)
+{
+	deflate_put_bits(d, 0, (8 - d->out.count) & 7);
+}
+
+static void deflate_put_code(struct zlib_writer *d,
+	const struct deflate_code code)
+{
+	deflate_put_bits(d, code.code, code.length);
+}
+
+static int deflate_distance_symbol(const struct zlib_writer *d,
+	const int distance)
+{
+	return distance <= 256 ? d->distance_symbol[distance - 1] :
+		d->distance_symbol[256 + ((distance - 1) >> 7)];
+}
+
+static void deflate_symbols(struct zlib_writer *d)
+{
+	for (int s = 0; s < ARRAY_SIZE(length_base); s++)
+		for (int k = 0; k < 1 << length_extra[s]; k++)
+			if (length_base[s] + k <= DEFLATE_MAX_MATCH)
+				d->length_symbol[length_base[s] + k] = s;
+
+	for (int s = 0; s < ARRAY_SIZE(distance_base); s++)
+		for (int k = 0; k < 1 << distance_extra[s]; k++) {
+			const int distance = distance_base[s] + k;
+
+			if (distance <= 256)
+				d->distance_symbol[distance - 1] = s;
+			else
+				d->distance_symbol[256 +
+					((distance - 1) >> 7)] = s;
+		}
+}
+
+/*
+ * Huffman code lengths are limited with the method of miniz, where codes
+ * that are too long are shortened, and the Kraft sum is then restored by
+ * lengthening shorter codes.
+ */
+static void huffman_lengths(uint8_t *lengths, const uint32_t *freq,
+	const int n, const int limit)
+{
+	int symbol[DEFLATE_LITLEN_CODES];
+	uint32_t weight[2 * DEFLATE_LITLEN_CODES];
+	int parent[2 * DEFLATE_LITLEN_CODES];
+	int depth[2 * DEFLATE_LITLEN_CODES];
+	int count = 0;
+
+	memset(lengths, 0, n);
+
+	for (int s = 0; s < n; s++)
+		if (freq[s]) {
+			int i = count++;
+
+			/* Insertion sort in ascending frequency */
+			for (; i > 0 && freq[symbol[i - 1]] > freq[s]; i--)
+				symbol[i] = symbol[i - 1];
+			symbol[i] = s;
+		}
+
+	if (count == 1)
+		lengths[symbol[0]] = 1;
+	if (count < 2)
+		return;
+
+	/* Two queue Huffman with leaves first, then internal nodes. */
+	for (int i = 0; i < count; i++)
+		weight[i] = freq[symbol[i]];
+
+	for (int next = count, leaf = 0, node = count;
+	     next < 2 * count - 1; next++) {
+		int pick[2];
+
+		for (int k = 0; k < 2; k++)
+			pick[k] = leaf < count && (node >= next ||
+				weight[leaf] <= weight[node]) ? leaf++ : node++;
+
+		weight[next] = weight[pick[0]] + weight[pick[1]];
+		parent[pick[0]] = parent[pick[1]] = next;
+	}
+
+	depth[2 * count - 2] = 0;
+	for (int i = 2 * count - 3; i >= 0; i--)
+		depth[i] = depth[parent[i]] + 1;
+
+	int num[32] = { };
+
+	for (int i = 0; i < count; i++)
+		num[min(depth[i], limit)]++;
+
+	uint32_t total = 0;
+
+	for (int l = 1; l <= limit; l++)
+		total += num[l] << (limit - l);
+
+	for (; total > 1u << limit; total--) {
+		num[limit]--;
+
+		for (int l = limit - 1; l > 0; l--)
+			if (num[l]) {
+				num[l]--;
+				num[l + 1] += 2;
+				break;
+			}
+	}
+
+	for (int l = limit, i = 0; l > 0; l--)
+		for (int k = 0; k < num[l]; k++)
+			lengths[symbol[i++]] = l;
+}
+
+/* Some inflaters require at least two codes, as does zlib. */
+static void huffman_two_codes(uint32_t *freq, const int n)
+{
+	int count = 0;
+
+	for (int s = 0; s < n; s++)
+		count += !!freq[s];
+
+	for (int s = 0; count < 2; s++)
+		if (!freq[s]) {
+			freq[s] = 1;
+			count++;
+		}
+}
+
+static void huffman_codes(struct deflate_code *codes,
+	const uint8_t *lengths, const int n)
+{
+	int count[16] = { };
+	uint16_t next[16];
+	uint16_t code = 0;
+
+	for (int s = 0; s < n; s++)
+		count[lengths[s]]++;
+	count[0] = 0;
+
+	for (int l = 1; l < 16; l++)
+		next[l] = code = (code + count[l - 1]) << 1;
+
+	for (int s = 0; s < n; s++) {
+		const int l = lengths[s];
+		uint16_t c = l ? next[l]++ : 0;
+		uint16_t r = 0;
+
+		for (int k = 0; k < l; k++, c >>= 1)
+			r = (r << 1) | (c & 1);
+
+		codes[s] = (struct deflate_code) {
+			.code = r,
+			.length = l
+		};
+	}
+}
+
+static void deflate_fixed_lengths(uint8_t *litlen, uint8_t *distance)
+{
+	for (int s = 0; s < DEFLATE_FIXED_CODES; s++)
+		litlen[s] = s < 144 ? 8 : s < 256 ? 9 : s < 280 ? 7 : 8;
+
+	for (int s = 0; s < DEFLATE_DISTANCE_CODES; s++)
+		distance[s] = 5;
+}
+
+static size_t deflate_data_cost(const struct zlib_writer *d,
+	const uint8_t *litlen, const uint8_t *distance)
+{
+	size_t cost = 0;
+
+	for (int s = 0; s < DEFLATE_LITLEN_CODES; s++)
+		cost += d->litlen_freq[s] * (litlen[s] +
+			(s > DEFLATE_END_OF_BLOCK ? length_extra[s - 257] : 0));
+
+	for (int s = 0; s < DEFLATE_DISTANCE_CODES; s++)
+		cost += d->distance_freq[s] * (distance[s] + distance_extra[s]);
+
+	return cost;
+}
+
+static int deflate_rle(struct deflate_rle *rle,
+	const uint8_t *lengths, const int n)
+{
+	int count = 0;
+
+	for (int i = 0; i < n;) {
+		const int l = lengths[i];
+		int run = 1;
+
+		while (i + run < n && lengths[i + run] == l)
+			run++;
+
+		if (!l && run >= 3) {
+			run = min(run, 138);
+			rle[count++] = run >= 11 ?
+				(struct deflate_rle) { 18, run - 11 } :
+				(struct deflate_rle) { 17, run - 3 };
+			i += run;
+			continue;
+		}
+
+		rle[count++] = (struct deflate_rle) { l, 0 };
+		i++;
+
+		if (l && run >= 4)
+			for (run--; run >= 3; ) {
+				const int r = min(run, 6);
+
+				rle[count++] = (struct deflate_rle) { 16, r - 3 };
+				i += r;
+				run -= r;
+			}
+	}
+
+	return count;
+}
+
+static void deflate_write_tokens(struct zlib_writer *d,
+	const struct deflate_code *litlen, const struct deflate_code *distance)
+{
+	for (size_t i = 0; i < d->token_count; i++) {
+		const struct deflate_token t = d->token[i];
+
+		if (!t.distance) {
+			deflate_put_code(d, litlen[t.length]);
+			continue;
+		}
+
+		const int ls = d->length_symbol[t.length];
+		const int ds = deflate_distance_symbol(d, t.distance);
+
+		deflate_put_code(d, litlen[257 + ls]);
+		deflate_put_bits(d, t.length - length_base[ls],
+			length_extra[ls]);
+		deflate_put_code(d, distance[ds]);
+		deflate_put_bits(d, t.distance - distance_base[ds],
+			distance_extra[ds]);
+	}
+
+	deflate_put_code(d, litlen[DEFLATE_END_OF_BLOCK]);
+}
+
+static void deflate_write_stored(struct zlib_writer *d, const bool final)
+{
+	size_t i = d->block_start;
+
+	do {
+		const size_t n = min_t(size_t, d->block_end - i,
+			DEFLATE_STORED_MAX);
+
+		deflate_put_bits(d, final && i + n == d->block_end, 1);
+		deflate_put_bits(d, 0, 2);
+		deflate_align(d);
+		deflate_put_bits(d, n, 16);
+		deflate_put_bits(d, ~n & 0xffff, 16);
+
+		for (size_t k = 0; k < n; k++)
+			deflate_put_byte(d, d->in[i + k]);
+
+		i += n;
+	} while (i < d->block_end);
+}
+
+static void deflate_block(struct zlib_writer *d, const bool final)
+{
+	uint8_t litlen[DEFLATE_LITLEN_CODES];
+	uint8_t distance[DEFLATE_DISTANCE_CODES];
+	uint8_t fixed_litlen[DEFLATE_FIXED_CODES];
+	uint8_t fixed_distance[DEFLATE_DISTANCE_CODES];
+	uint8_t lengths[DEFLATE_LITLEN_CODES + DEFLATE_DISTANCE_CODES];
+	struct deflate_rle rle[DEFLATE_LITLEN_CODES + DEFLATE_DISTANCE_CODES];
+	uint32_t codelen_freq[DEFLATE_CODELEN_CODES] = { };
+	uint8_t codelen[DEFLATE_CODELEN_CODES];
+	struct deflate_code litlen_code[DEFLATE_FIXED_CODES];
+	struct deflate_code distance_code[DEFLATE_DISTANCE_CODES];
+	struct deflate_code codelen_code[DEFLATE_CODELEN_CODES];
+	int hlit = 257;
+	int hdist = 1;
+	int hclen = 4;
+
+	d->litlen_freq[DEFLATE_END_OF_BLOCK]++;
+	huffman_two_codes(d->litlen_freq, DEFLATE_LITLEN_CODES);
+	huffman_two_codes(d->distance_freq, DEFLATE_DISTANCE_CODES);
+
+	huffman_lengths(litlen, d->litlen_freq, DEFLATE_LITLEN_CODES, 15);
+	huffman_lengths(distance, d->distance_freq,
+		DEFLATE_DISTANCE_CODES, 15);
+
+	for (int s = 0; s < DEFLATE_LITLEN_CODES; s++)
+		if (litlen[s])
+			hlit = max(hlit, s + 1);
+	for (int s = 0; s < DEFLATE_DISTANCE_CODES; s++)
+		if (distance[s])
+			hdist = max(hdist, s + 1);
+
+	memcpy(&lengths[0], litlen, hlit);
+	memcpy(&lengths[hlit], distance, hdist);
+
+	const int rle_count = deflate_rle(rle, lengths, hlit + hdist);
+
+	for (int i = 0; i < rle_count; i++)
+		codelen_freq[rle[i].symbol]++;
+
+	huffman_lengths(codelen, codelen_freq, DEFLATE_CODELEN_CODES, 7);
+
+	for (int i = 0; i < DEFLATE_CODELEN_CODES; i++)
+		if (codelen[codelen_order[i]])
+			hclen = max(hclen, i + 1);
+
+	size_t dynamic_cost = 3 + 5 + 5 + 4 + 3 * hclen +
+		deflate_data_cost(d, litlen, distance);
+
+	for (int i = 0; i < rle_count; i++)
+		dynamic_cost += codelen[rle[i].symbol] +
+			codelen_extra[rle[i].symbol];
+
+	deflate_fixed_lengths(fixed_litlen, fixed_distance);
+
+	const size_t fixed_cost = 3 +
+		deflate_data_cost(d, fixed_litlen, fixed_distance);
+	const size_t stored_size = d->block_end - d->block_start;
+	const size_t stored_cost = 8 * stored_size + (3 + 7 + 32) *
+		(1 + stored_size / DEFLATE_STORED_MAX);
+
+	if (stored_cost <= fixed_cost && stored_cost <= dynamic_cost) {
+		deflate_write_stored(d, final);
+	} else if (fixed_cost <= dynamic_cost) {
+		huffman_codes(litlen_code, fixed_litlen, DEFLATE_FIXED_CODES);
+		huffman_codes(distance_code, fixed_distance,
+			DEFLATE_DISTANCE_CODES);
+
+		deflate_put_bits(d, final, 1);
+		deflate_put_bits(d, 1, 2);
+		deflate_write_tokens(d, litlen_code, distance_code);
+	} else {
+		huffman_codes(litlen_code, litlen, DEFLATE_LITLEN_CODES);
+		huffman_codes(distance_code, distance, DEFLATE_DISTANCE_CODES);
+		huffman_codes(codelen_code, codelen, DEFLATE_CODELEN_CODES);
+
+		deflate_put_bits(d, final, 1);
+		deflate_put_bits(d, 2, 2);
+		deflate_put_bits(d, hlit - 257, 5);
+		deflate_put_bits(d, hdist - 1, 5);
+		deflate_put_bits(d, hclen - 4, 4);
+
+		for (int i = 0; i < hclen; i++)
+			deflate_put_bits(d, codelen[codelen_order[i]], 3);
+
+		for (int i = 0; i < rle_count; i++) {
+			deflate_put_code(d, codelen_code[rle[i].symbol]);
+			deflate_put_bits(d, rle[i].extra,
+				codelen_extra[rle[i].symbol]);
+		}
+
+		deflate_write_tokens(d, litlen_code, distance_code);
+	}
+
+	memset(d->litlen_freq, 0, sizeof(d->litlen_freq));
+	memset(d->distance_freq, 0, sizeof(d->distance_freq));
+	d->token_count = 0;
+	d->block_start = d->block_end;
+
+	if (!final)
+		deflate_flush(d);	/* The final block is flushed on close */
+}
+
+static void deflate_token(struct zlib_writer *d,
+	const int length, const int distance)
+{
+	d->token[d->token_count++] = (struct deflate_token) {
+		.length = length,
+		.distance = distance
+	};
+
+	if (distance) {
+		d->litlen_freq[257 + d->length_symbol[length]]++;
+		d->distance_freq[deflate_distance_symbol(d, distance)]++;
+		d->block_end += length;
+	} else {
+		d->litlen_freq[length]++;
+		d->block_end++;
+	}
+
+	if (d->token_count == ARRAY_SIZE(d->token))
+		deflate_block(d, false);
+}
+
+static uint32_t deflate_hash(const uint8_t *p)
+{
+	const uint32_t v = (p[0] << 16) | (p[1] << 8) | p[2];
+
+	return (v * 2654435761u) >> (32 - DEFLATE_HASH_BITS);
+}
+
+static void deflate_insert(struct zlib_writer *d, const size_t i)
+{
+	if (i + DEFLATE_MIN_MATCH > d->size)
+		return;
+
+	const uint32_t h = deflate_hash(&d->in[i]);
+
+	d->prev[i & (DEFLATE_WINDOW - 1)] = d->head[h];
+	d->head[h] = i;
+}
+
+/* Longest match at a position, that must not yet be inserted. */
+static struct deflate_match deflate_longest_match(const struct zlib_writer *d,
+	const size_t i)
+{
+	struct deflate_match m = { };
+
+	if (i + DEFLATE_MIN_MATCH > d->size)
+		return m;
+
+	const uint8_t *in = d->in;
+	const int n = min_t(size_t, d->size - i, DEFLATE_MAX_MATCH);
+	int32_t c = d->head[deflate_hash(&in[i])];
+
+	for (int chain = DEFLATE_MAX_CHAIN;
+	     c >= 0 && i - c <= DEFLATE_WINDOW && chain > 0;
+	     c = d->prev[c & (DEFLATE_WINDOW - 1)], chain--) {
+		if (in[c + m.length] != in[i + m.length])
+			continue;
+
+		int length = 0;
+
+		while (length < n && in[c + length] == in[i + length])
+			length++;
+
+		if (length > m.length) {
+			m = (struct deflate_match) {
+				.length = length,
+				.distance = i - c
+			};
+
+			if (length >= min(n, DEFLATE_NICE_MATCH))
+				break;
+		}
+	}
+
+	if (m.length < DEFLATE_MIN_MATCH ||
+	    (m.length == DEFLATE_MIN_MATCH && m.distance > DEFLATE_TOO_FAR))
+		m = (struct deflate_match) { };
+
+	return m;
+}
+
+static void deflate_insert_match(struct zlib_writer *d,
+	const size_t i, const struct deflate_match m)
+{
+	for (int k = 1; k < m.length; k++)
+		deflate_insert(d, i + k);
+}
+
+/*
+ * Lazy evaluation defers a match by one position, and takes the match at
+ * the next position instead if it is longer. Unless the data is final,
+ * compression stops short of the end of the buffer, so that matches and
+ * hash chains are the same as if all data had been given at once.
+ */
+static void deflate_compress(struct zlib_writer *d, const bool final)
+{
+	struct deflate_match pending = d->pending;
+	size_t i = d->pos;
+
+	while (i < d->size && (final || i + DEFLATE_LOOKAHEAD <= d->size)) {
+		const struct deflate_match m = deflate_longest_match(d, i);
+
+		deflate_insert(d, i);
+
+		if (pending.length && m.length <= pending.length) {
+			deflate_token(d, pending.length, pending.distance);
+			deflate_insert_match(d, i, (struct deflate_match) {
+				.length = pending.length - 1 });
+			i += pending.length - 1;
+			pending = (struct deflate_match) { };
+		} else if (pending.length) {
+			deflate_token(d, d->in[i - 1], 0);
+			pending = m;
+			i++;
+		} else if (m.length >= DEFLATE_NICE_MATCH) {
+			deflate_token(d, m.length, m.distance);
+			deflate_insert_match(d, i, m);
+			i += m.length;
+		} else if (m.length) {
+			pending = m;
+			i++;
+		} else {
+			deflate_token(d, d->in[i], 0);
+			i++;
+		}
+	}
+
+	d->pos = i;
+	d->pending = pending;
+
+	if (!final)
+		return;
+
+	if (pending.length)
+		deflate_token(d, pending.length, pending.distance);
+
+	deflate_block(d, true);
+}
+
+static int32_t deflate_slide_position(const int32_t position,
+	const size_t slide)
+{
+	return position >= (int32_t)slide ? position - (int32_t)slide : -1;
+}
+
+/*
+ * The buffer slides by whole windows, such that positions keep their
+ * places in the hash chains. A window before the next position is kept
+ * for matches, as is the current block, in case it is stored. A block
+ * that is too long to keep is therefore ended early.
+ */
+static void deflate_slide(struct zlib_writer *d)
+{
+	size_t slide = min(d->pos - DEFLATE_WINDOW, d->block_start);
+
+	if (slide < DEFLATE_WINDOW) {
+		deflate_block(d, false);
+
+		slide = min(d->pos - DEFLATE_WINDOW, d->block_start);
+	}
+
+	slide &= ~(size_t)(DEFLATE_WINDOW - 1);
+
+	BUG_ON(!slide);
+
+	memmove(&d->in[0], &d->in[slide], d->size - slide);
+	d->size -= slide;
+	d->pos -= slide;
+	d->block_start -= slide;
+	d->block_end -= slide;
+
+	for (size_t i = 0; i < ARRAY_SIZE(d->head); i++)
+		d->head[i] = deflate_slide_position(d->head[i], slide);
+	for (size_t i = 0; i < ARRAY_SIZE(d->prev); i++)
+		d->prev[i] = deflate_slide_position(d->prev[i], slide);
+}
+
+/**
+ * zlib_writer_open - open a zlib stream that is compressed as it is written
+ * @write: callback to write compressed data, that may be called by
+ * 	zlib_writer_write() and zlib_writer_close()
+ * @arg: argument passed to @write
+ *
+ * Return: zlib stream, or %NULL with errno set
+ */
+struct zlib_writer *zlib_writer_open(
+	bool (*write)(const void *buf, size_t nbyte, void *arg), void *arg)
+{
+	struct zlib_writer *d = malloc(sizeof(*d));
+
+	if (!d)
+		return NULL;
+
+	d->write = write;
+	d->arg = arg;
+	d->adler = 1;
+	d->size = 0;
+	d->pos = 0;
+	d->pending = (struct deflate_match) { };
+	d->out = (typeof(d->out)) { .valid = true };
+	d->block_start = 0;
+	d->block_end = 0;
+	d->token_count = 0;
+
+	memset(d->litlen_freq, 0, sizeof(d->litlen_freq));
+	memset(d->distance_freq, 0, sizeof(d->distance_freq));
+	memset(d->head, 0xff, sizeof(d->head));	/* Empty chains are -1 */
+	deflate_symbols(d);
+
+	deflate_put_byte(d, 0x78);	/* 32 KiB window deflate */
+	deflate_put_byte(d, 0x9c);	/* Default compression, checked */
+
+	return d;
+}
+
+/**
+ * zlib_writer_write - compress data to a zlib stream
+ * @d: zlib stream
+ * @buf: data to compress
+ * @nbyte: size in bytes of @buf
+ *
+ * Return: %true on success, otherwise %false with errno set
+ */
+bool zlib_writer_write(struct zlib_writer *d, const void *buf, size_t nbyte)
+{
+	const uint8_t *b = buf;
+
+	d->adler = adler32(d->adler, buf, nbyte);
+
+	while (nbyte && d->out.valid) {
+		if (d->size == ARRAY_SIZE(d->in))
+			deflate_slide(d);
+
+		const size_t n = min(nbyte, ARRAY_SIZE(d->in) - d->size);
+
+		memcpy(&d->in[d->size], b, n);
+		d->size += n;
+		b += n;
+		nbyte -= n;
+
+		deflate_compress(d, false);
+	}
+
+	if (!d->out.valid)
+		errno = d->out.errno_;
+
+	return d->out.valid;
+}
+
+/**
+ * zlib_writer_close - compress remaining data and close a zlib stream
+ * @d: zlib stream to close, or %NULL
+ *
+ * Return: %true if all data was written, otherwise %false with errno set
+ */
+bool zlib_writer_close(struct zlib_writer *d)
+{
+	if (!d)
+		return true;
+
+	if (d->out.valid) {
+		deflate_compress(d, true);
+		deflate_align(d);
+
+		for (int k = 24; k >= 0; k -= 8)
+			deflate_put_byte(d, d->adler >> k);
+
+		deflate_flush(d);
+	}
+
+	const bool valid = d->out.valid;
+	const int err = d->out.errno_;
+
+	free(d->out.data);
+	free(d);
+
+	if (!valid)
+		errno = err;
+
+	return valid;
+}
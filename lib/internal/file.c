@@ -5,6 +5,7 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <pthread.h>
 #include <stdarg.h>
 #include <stdlib.h>
 #include <string.h>
@@ -12,6 +13,7 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include "internal/assert.h"
 #include "internal/compare.h"
 #include "internal/file.h"
 #include "internal/macro.h"
@@ -201,3 +203,283 @@ const char *file_basename(const char *path)
 
 	return &path[k];
 }
+
+/*
+ * Buffers are handed off from the thread that fills them to a writer
+ * thread, such that filling and writing overlap. Buffers are page
+ * aligned and large, to keep the number of system calls small.
+ */
+#define FILE_WRITER_BUFFERS	4
+#define FILE_WRITER_ALIGN	4096
+
+struct file_writer_buffer {
+	size_t size;
+	uint8_t *data;
+};
+
+/**
+ * struct file_writer - buffers in transit to an asynchronous writer
+ * @mutex: lock for @head, @tail, @done, @valid and @errno_
+ * @cond: signalled when buffers are handed off or written
+ * @head: number of buffers filled and handed off to the writer
+ * @tail: number of buffers written
+ * @done: %true when no more buffers will be handed off
+ * @valid: %false if writing failed
+ * @errno_: errno of failed write
+ * @thread: writer thread
+ * @buffer: ring of buffers
+ * @write: callback to write a buffer
+ * @fd: file descriptor if @write is %NULL
+ * @arg: argument to @write
+ */
+struct file_writer {
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	size_t head;
+	size_t tail;
+	bool done;
+	bool valid;
+	int errno_;
+	pthread_t thread;
+	struct file_writer_buffer buffer[FILE_WRITER_BUFFERS];
+
+	bool (*write)(const void *buf, size_t nbyte, void *arg);
+	int fd;
+	void *arg;
+};
+
+static bool file_writer_output(struct file_writer *writer,
+	const void *buf, size_t nbyte)
+{
+	if (writer->write)
+		return writer->write(buf, nbyte, writer->arg);
+
+	return xwrite(writer->fd, buf, nbyte) == nbyte;
+}
+
+static void *file_writer_thread(void *arg)
+{
+	struct file_writer *writer = arg;
+
+	pthread_mutex_lock(&writer->mutex);
+
+	for (;;) {
+		while (writer->head == writer->tail && !writer->done)
+			pthread_cond_wait(&writer->cond, &writer->mutex);
+		if (writer->head == writer->tail)
+			break;
+
+		struct file_writer_buffer *buffer =
+			&writer->buffer[writer->tail % FILE_WRITER_BUFFERS];
+		bool valid = writer->valid;
+
+		pthread_mutex_unlock(&writer->mutex);
+
+		if (valid && !file_writer_output(writer,
+				buffer->data, buffer->size))
+			valid = false;
+
+		pthread_mutex_lock(&writer->mutex);
+
+		if (!valid && writer->valid) {
+			writer->valid = false;
+			writer->errno_ = errno;
+		}
+
+		buffer->size = 0;
+		writer->tail++;
+		pthread_cond_broadcast(&writer->cond);
+	}
+
+	pthread_mutex_unlock(&writer->mutex);
+
+	return NULL;
+}
+
+static void file_writer_free(struct file_writer *writer)
+{
+	for (int i = 0; i < FILE_WRITER_BUFFERS; i++)
+		free(writer->buffer[i].data);
+
+	free(writer);
+}
+
+static struct file_writer *file_writer_start(
+	bool (*write)(const void *buf, size_t nbyte, void *arg),
+	int fd, void *arg)
+{
+	struct file_writer *writer = malloc(sizeof(*writer));
+	int err;
+
+	if (!writer)
+		return NULL;
+
+	*writer = (struct file_writer) {
+		.mutex = PTHREAD_MUTEX_INITIALIZER,
+		.cond = PTHREAD_COND_INITIALIZER,
+		.valid = true,
+		.write = write,
+		.fd = fd,
+		.arg = arg
+	};
+
+	for (int i = 0; i < FILE_WRITER_BUFFERS; i++)
+		if ((err = posix_memalign((void **)&writer->buffer[i].data,
+				FILE_WRITER_ALIGN, FILE_WRITER_BUFFER_SIZE)))
+			goto err;
+
+	if ((err = pthread_create(&writer->thread, NULL,
+			file_writer_thread, writer)))
+		goto err;
+
+	return writer;
+
+err:
+	file_writer_free(writer);
+	errno = err;
+
+	return NULL;
+}
+
+/**
+ * file_writer_open - open an asynchronous writer with a callback
+ * @write: callback to write a buffer, called on the writer thread
+ * @arg: argument passed to @write
+ *
+ * Return: asynchronous writer, or %NULL with errno set
+ */
+struct file_writer *file_writer_open(
+	bool (*write)(const void *buf, size_t nbyte, void *arg), void *arg)
+{
+	return file_writer_start(write, -1, arg);
+}
+
+/**
+ * file_writer_open_fd - open an asynchronous writer to a file descriptor
+ * @fd: file descriptor to write to, not closed by the writer
+ *
+ * Return: asynchronous writer, or %NULL with errno set
+ */
+struct file_writer *file_writer_open_fd(int fd)
+{
+	return file_writer_start(NULL, fd, NULL);
+}
+
+/* Hand off the current buffer to the writer, and wait for a free one. */
+static bool file_writer_flush(struct file_writer *writer)
+{
+	pthread_mutex_lock(&writer->mutex);
+
+	writer->head++;
+	pthread_cond_broadcast(&writer->cond);
+
+	while (writer->head - writer->tail == FILE_WRITER_BUFFERS &&
+	       writer->valid)
+		pthread_cond_wait(&writer->cond, &writer->mutex);
+
+	const bool valid = writer->valid;
+
+	if (!valid)
+		errno = writer->errno_;
+
+	pthread_mutex_unlock(&writer->mutex);
+
+	return valid;
+}
+
+/**
+ * file_writer_buffer - space to fill with data to write asynchronously
+ * @writer: asynchronous writer
+ * @size: size in bytes of space, at most %FILE_WRITER_BUFFER_SIZE
+ *
+ * The space is written in order with other data, once the buffer it
+ * belongs to is full or the writer is closed. It remains valid until
+ * the next call with the writer.
+ *
+ * Return: space to fill, or %NULL with errno set if writing has failed
+ */
+void *file_writer_buffer(struct file_writer *writer, size_t size)
+{
+	struct file_writer_buffer *buffer =
+		&writer->buffer[writer->head % FILE_WRITER_BUFFERS];
+
+	BUG_ON(size > FILE_WRITER_BUFFER_SIZE);
+
+	if (buffer->size + size > FILE_WRITER_BUFFER_SIZE) {
+		if (!file_writer_flush(writer))
+			return NULL;
+
+		buffer = &writer->buffer[writer->head % FILE_WRITER_BUFFERS];
+	}
+
+	void *buf = &buffer->data[buffer->size];
+
+	buffer->size += size;
+
+	return buf;
+}
+
+/**
+ * file_writer_write - write data asynchronously
+ * @writer: asynchronous writer
+ * @buf: data to write, copied before return
+ * @nbyte: size in bytes of data
+ *
+ * Return: %true on success, otherwise %false with errno set
+ */
+bool file_writer_write(struct file_writer *writer,
+	const void *buf, size_t nbyte)
+{
+	const uint8_t *data = buf;
+
+	while (nbyte) {
+		const size_t size = min_t(size_t, nbyte,
+			FILE_WRITER_BUFFER_SIZE);
+		void *b = file_writer_buffer(writer, size);
+
+		if (!b)
+			return false;
+
+		memcpy(b, data, size);
+		data += size;
+		nbyte -= size;
+	}
+
+	return true;
+}
+
+/**
+ * file_writer_close - write remaining data and close an asynchronous writer
+ * @writer: asynchronous writer to close, or %NULL
+ *
+ * Return: %true if all data was written, otherwise %false with errno set
+ */
+bool file_writer_close(struct file_writer *writer)
+{
+	if (!writer)
+		return true;
+
+	struct file_writer_buffer *buffer =
+		&writer->buffer[writer->head % FILE_WRITER_BUFFERS];
+
+	pthread_mutex_lock(&writer->mutex);
+
+	if (buffer->size)
+		writer->head++;
+	writer->done = true;
+	pthread_cond_broadcast(&writer->cond);
+
+	pthread_mutex_unlock(&writer->mutex);
+
+	pthread_join(writer->thread, NULL);
+
+	const bool valid = writer->valid;
+	const int err = writer->errno_;
+
+	file_writer_free(writer);
+
+	if (!valid)
+		errno = err;
+
+	return valid;
+}
@@ -0,0 +1,447 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Copyright (C) 2022 Fredrik Noring
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "internal/assert.h"
+#include "internal/compare.h"
+#include "internal/deflate.h"
+#include "internal/file.h"
+#include "internal/macro.h"
+#include "internal/png.h"
+
+#define PNG_COLOR_TYPE_INDEXED	3
+#define PNG_COLOR_TYPE_RGBA	6
+
+/**
+ * struct png_palette - palette of RGBA colours
+ * @count: number of colours
+ * @color: colours as 8-bit red, green, blue and alpha from most to least
+ * 	significant byte
+ * @hash: hash table of @color indices, or -1 if empty
+ */
+struct png_palette {
+	int count;
+	uint32_t color[256];
+	int16_t hash[1024];
+};
+
+/**
+ * struct png - PNG image being written
+ * @f: callbacks for the size of the image, its rows and writing
+ * @arg: argument passed to the callbacks
+ * @discard: discard remaining compressed data after an error
+ * @crc_table: CRC-32 of every byte
+ */
+struct png {
+	const struct png_image_f *f;
+	void *arg;
+	bool discard;
+
+	uint32_t crc_table[256];
+};
+
+static void png_crc_table(uint32_t table[256])
+{
+	for (uint32_t n = 0; n < 256; n++) {
+		uint32_t c = n;
+
+		for (int k = 0; k < 8; k++)
+			c = c & 1 ? 0xedb88320 ^ (c >> 1) : c >> 1;
+
+		table[n] = c;
+	}
+}
+
+static uint32_t png_crc(const struct png *png, uint32_t crc,
+	const void *buf, size_t nbyte)
+{
+	const uint8_t *b = buf;
+
+	for (size_t i = 0; i < nbyte; i++)
+		crc = png->crc_table[(crc ^ b[i]) & 0xff] ^ (crc >> 8);
+
+	return crc;
+}
+
+static void png_be32(uint8_t *b, const uint32_t v)
+{
+	b[0] = v >> 24;
+	b[1] = v >> 16;
+	b[2] = v >>  8;
+	b[3] = v;
+}
+
+static bool png_chunk(const struct png *png, const char *type,
+	const void *data, const uint32_t size)
+{
+	uint8_t header[8];
+	uint8_t trailer[4];
+
+	png_be32(&header[0], size);
+	memcpy(&header[4], type, 4);
+	png_be32(&trailer[0], ~png_crc(png,
+		png_crc(png, ~0u, &header[4], 4), data, size));
+
+	return png->f->write(header, sizeof(header), png->arg) &&
+	       (!size || png->f->write(data, size, png->arg)) &&
+	       png->f->write(trailer, sizeof(trailer), png->arg);
+}
+
+static uint8_t png_sample(const uint16_t v)
+{
+	return (v * 255 + 32767) / 65535;
+}
+
+static uint32_t png_rgba(const struct tiff_pixel *pixel)
+{
+	return ((uint32_t)png_sample(pixel->r) << 24) |
+	       ((uint32_t)png_sample(pixel->g) << 16) |
+	       ((uint32_t)png_sample(pixel->b) <<  8) |
+		(uint32_t)png_sample(pixel->a);
+}
+
+/* Palette index of a colour, added if necessary, or -1 if full. */
+static int png_palette_index(struct png_palette *palette, const uint32_t c)
+{
+	uint32_t h = (c * 2654435761u) >> 22;
+
+	for (;; h = (h + 1) % ARRAY_SIZE(palette->hash)) {
+		const int i = palette->hash[h];
+
+		if (i >= 0 && palette->color[i] == c)
+			return i;
+		if (i >= 0)
+			continue;
+		if (palette->count == ARRAY_SIZE(palette->color))
+			return -1;
+
+		palette->color[palette->count] = c;
+		palette->hash[h] = palette->count;
+
+		return palette->count++;
+	}
+}
+
+static int png_depth(const struct png_palette *palette)
+{
+	return palette->count <= 2 ? 1 :
+	       palette->count <= 4 ? 2 :
+	       palette->count <= 16 ? 4 : 8;
+}
+
+static uint8_t png_paeth(const int a, const int b, const int c)
+{
+	const int p = a + b - c;
+	const int pa = abs(p - a);
+	const int pb = abs(p - b);
+	const int pc = abs(p - c);
+
+	return pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+}
+
+static void png_filter(uint8_t *out, const int type, const uint8_t *row,
+	const uint8_t *prev, const size_t stride, const size_t bpp)
+{
+	out[0] = type;
+
+	for (size_t i = 0; i < stride; i++) {
+		const int a = i >= bpp ? row[i - bpp] : 0;
+		const int b = prev ? prev[i] : 0;
+		const int c = prev && i >= bpp ? prev[i - bpp] : 0;
+
+		switch (type) {
+		case 0: out[1 + i] = row[i]; break;
+		case 1: out[1 + i] = row[i] - a; break;
+		case 2: out[1 + i] = row[i] - b; break;
+		case 3: out[1 + i] = row[i] - (a + b) / 2; break;
+		case 4: out[1 + i] = row[i] - png_paeth(a, b, c); break;
+		}
+	}
+}
+
+static size_t png_filter_cost(const uint8_t *out, const size_t stride)
+{
+	size_t cost = 0;
+
+	for (size_t i = 0; i < stride; i++)
+		cost += abs((int8_t)out[1 + i]);
+
+	return cost;
+}
+
+/*
+ * Rows of RGBA pixels are filtered with the type of minimum sum of
+ * absolute differences, as recommended by the PNG specification. Palette
+ * rows are not filtered, as also recommended.
+ */
+static void png_filter_row(uint8_t *out, const uint8_t *row,
+	const uint8_t *prev, const size_t stride, uint8_t *tmp)
+{
+	size_t best = SIZE_MAX;
+
+	for (int type = 0; type < 5; type++) {
+		png_filter(tmp, type, row, prev, stride, 4);
+
+		const size_t cost = png_filter_cost(tmp, stride);
+
+		if (cost < best) {
+			best = cost;
+			memcpy(out, tmp, 1 + stride);
+		}
+	}
+}
+
+static void png_rgba_row(uint8_t *out, const struct tiff_pixel *row,
+	const uint16_t width)
+{
+	for (uint16_t x = 0; x < width; x++)
+		png_be32(&out[4 * x], png_rgba(&row[x]));
+}
+
+static void png_pack_row(uint8_t *out, const struct tiff_pixel *row,
+	struct png_palette *palette, const uint16_t width,
+	const size_t stride, const int depth)
+{
+	memset(out, 0, 1 + stride);
+
+	for (uint16_t x = 0; x < width; x++) {
+		const size_t bit = x * depth;
+		const int k = png_palette_index(palette, png_rgba(&row[x]));
+
+		BUG_ON(k < 0);	/* All colours are in the palette */
+
+		out[1 + bit / 8] |= k << (8 - depth - bit % 8);
+	}
+}
+
+static bool png_header(const struct png *png,
+	const uint16_t width, const uint16_t height,
+	const struct png_palette *palette, const int depth)
+{
+	static const uint8_t signature[8] = {
+		0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'
+	};
+	uint8_t ihdr[13] = {
+		[8] = depth,
+		[9] = palette ? PNG_COLOR_TYPE_INDEXED : PNG_COLOR_TYPE_RGBA,
+	};
+	uint8_t plte[3 * 256];
+	uint8_t trns[256];
+	int trns_count = 0;
+
+	png_be32(&ihdr[0], width);
+	png_be32(&ihdr[4], height);
+
+	for (int i = 0; palette && i < palette->count; i++) {
+		const uint32_t c = palette->color[i];
+
+		plte[3 * i + 0] = c >> 24;
+		plte[3 * i + 1] = c >> 16;
+		plte[3 * i + 2] = c >>  8;
+		trns[i] = c;
+
+		if (trns[i] != 0xff)
+			trns_count = i + 1;
+	}
+
+	return png->f->write(signature, sizeof(signature), png->arg) &&
+	       png_chunk(png, "IHDR", ihdr, sizeof(ihdr)) &&
+	       (!palette || png_chunk(png, "PLTE",
+			plte, 3 * palette->count)) &&
+	       (!trns_count || png_chunk(png, "tRNS", trns, trns_count));
+}
+
+/* Compressed data is written in IDAT chunks as it becomes available. */
+static bool png_idat(const void *buf, size_t nbyte, void *arg)
+{
+	const struct png *png = arg;
+
+	return !png->discard && png_chunk(png, "IDAT", buf, nbyte);
+}
+
+/**
+ * png_image - write a PNG image
+ * @f: callbacks for the size of the image, its rows and writing
+ * @arg: argument passed to the callbacks
+ *
+ * Images of at most 256 colours are written with a palette of the
+ * smallest bit depth possible, and other images with 8-bit RGBA samples.
+ * Images must be at least one pixel wide and high.
+ *
+ * Rows are given in two passes from top to bottom, the first to collect
+ * the palette and the second to filter and compress them, such that only
+ * the current and previous rows are kept in memory. The first pass ends
+ * early if there are more than 256 colours.
+ *
+ * Return: %true on success, otherwise %false with errno set
+ */
+bool png_image(const struct png_image_f *f, void *arg)
+{
+	struct png png = { .f = f, .arg = arg };
+	uint16_t width = 0;
+	uint16_t height = 0;
+
+	if (!f->image(&width, &height, arg))
+		return false;
+
+	if (!width || !height) {
+		errno = EINVAL;
+		return false;
+	}
+
+	struct png_palette palette = { };
+	struct tiff_pixel *row = malloc(sizeof(struct tiff_pixel[width]));
+	struct zlib_writer *z = NULL;
+	uint8_t *rgba[2] = { };
+	uint8_t *out = NULL;
+	uint8_t *tmp = NULL;
+	bool indexed = true;
+	bool valid = false;
+
+	if (!row)
+		goto out;
+
+	memset(palette.hash, 0xff, sizeof(palette.hash));
+	png_crc_table(png.crc_table);
+
+	for (uint16_t y = 0; y < height && indexed; y++) {
+		if (!f->row(y, width, row, arg))
+			goto out;
+
+		for (uint16_t x = 0; x < width && indexed; x++)
+			if (png_palette_index(&palette, png_rgba(&row[x])) < 0)
+				indexed = false;	/* Too many colours */
+	}
+
+	const int depth = indexed ? png_depth(&palette) : 8;
+	const size_t stride = indexed ? (width * depth + 7) / 8 : 4 * width;
+
+	if (!(out = malloc(1 + stride)))
+		goto out;
+
+	if (!indexed && (!(rgba[0] = malloc(stride)) ||
+			 !(rgba[1] = malloc(stride)) ||
+			 !(tmp = malloc(1 + stride))))
+		goto out;
+
+	if (!png_header(&png, width, height,
+			indexed ? &palette : NULL, depth) ||
+	    !(z = zlib_writer_open(png_idat, &png)))
+		goto out;
+
+	for (uint16_t y = 0; y < height; y++) {
+		if (!f->row(y, width, row, arg))
+			goto out;
+
+		if (indexed)
+			png_pack_row(out, row, &palette, width, stride, depth);
+		else {
+			png_rgba_row(rgba[y % 2], row, width);
+			png_filter_row(out, rgba[y % 2],
+				y ? rgba[(y - 1) % 2] : NULL, stride, tmp);
+		}
+
+		if (!zlib_writer_write(z, out, 1 + stride))
+			goto out;
+	}
+
+	valid = zlib_writer_close(z);
+	z = NULL;
+
+	valid = valid && png_chunk(&png, "IEND", NULL, 0);
+
+out:
+	preserve (errno) {
+		png.discard = true;
+		zlib_writer_close(z);
+		free(tmp);
+		free(rgba[1]);
+		free(rgba[0]);
+		free(out);
+		free(row);
+	}
+
+	return valid;
+}
+
+struct file_arg {
+	struct file_writer *writer;
+
+	const struct png_image_file_f *f;
+	void *arg;
+};
+
+static bool png_file_image(uint16_t *width, uint16_t *height, void *arg)
+{
+	struct file_arg *arg_ = arg;
+
+	return arg_->f->image(width, height, arg_->arg);
+}
+
+static bool png_file_row(uint16_t y, uint16_t width,
+	struct tiff_pixel *row, void *arg)
+{
+	struct file_arg *arg_ = arg;
+
+	return arg_->f->row(y, width, row, arg_->arg);
+}
+
+static bool png_file_write(const void *buf, size_t nbyte, void *arg)
+{
+	struct file_arg *arg_ = arg;
+
+	return file_writer_write(arg_->writer, buf, nbyte);
+}
+
+bool png_image_file(const char *path,
+	const struct png_image_file_f *f, void *arg)
+{
+	static const struct png_image_f ff = {
+		.image = png_file_image,
+		.row = png_file_row,
+		.write = png_file_write
+	};
+	const int fd = xopen(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	struct file_arg arg_ = { .f = f, .arg = arg };
+
+	if (fd < 0)
+		return false;
+
+	if (!(arg_.writer = file_writer_open_fd(fd)) ||
+	    !png_image(&ff, &arg_)) {
+		preserve (errno) {
+			file_writer_close(arg_.writer);
+			xclose(fd);
+		}
+
+		goto err;
+	}
+
+	/* Errors of the final writes are reported when the writer closes. */
+	if (!file_writer_close(arg_.writer)) {
+		preserve (errno) {
+			xclose(fd);
+		}
+
+		goto err;
+	}
+
+	if (xclose(fd) < 0)
+		goto err;
+
+	return true;
+
+err:
+	preserve (errno) {
+		unlink(path);
+	}
+
+	return false;
+}
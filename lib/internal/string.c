@@ -10,6 +10,7 @@
 #include <string.h>
 
 #include "internal/assert.h"
+#include "internal/compare.h"
 #include "internal/memory.h"
 #include "internal/string.h"
 #include "internal/types.h"
@@ -149,6 +150,23 @@ struct line_column string_line_column(const char *s, struct line_column lc)
 	return lc;
 }
 
+bool sbreserve(struct strbuf *sb, size_t size)
+{
+	if (sb->capacity >= sb->length + size + 1)
+		return true;
+
+	const size_t capacity = max(sb->length + size + 1, 2 * sb->capacity);
+	char *s = realloc(sb->s, capacity);
+
+	if (!s)
+		return false;
+
+	sb->capacity = capacity;
+	sb->s = s;
+
+	return true;
+}
+
 bool sbprintf(struct strbuf *sb, const char *fmt, ...)
 {
 	va_list ap;
@@ -144,7 +144,7 @@ struct tiff_ifd_entry {
 
 static bool tiff_header_ifd(const int i, const int n,
 	const uint16_t width, const uint16_t height,
-	size_t *offset, const struct tiff_image_f *f, void *arg)
+	size_t *offset, struct file_writer *writer)
 {
 	const int samples_per_pixel = 4;
 	const size_t data_size = sizeof(struct tiff_pixel[height][width]);
@@ -183,13 +183,13 @@ static bool tiff_header_ifd(const int i, const int n,
 	BUILD_BUG_ON(sizeof(ifd) != 2 + ARRAY_SIZE(ifd.entry) * 12 + 4);
 
 	if (!*offset) {
-		if (!f->write(&header, sizeof(header), arg))
+		if (!file_writer_write(writer, &header, sizeof(header)))
 			return false;
 
 		*offset += sizeof(header);
 	}
 
-	if (!f->write(&ifd, sizeof(ifd), arg))
+	if (!file_writer_write(writer, &ifd, sizeof(ifd)))
 		return false;
 
 	*offset += sizeof(ifd) + data_size;
@@ -197,7 +197,8 @@ static bool tiff_header_ifd(const int i, const int n,
 	return true;
 }
 
-bool tiff_image(uint16_t n, const struct tiff_image_f *f, void *arg)
+static bool tiff_images(struct file_writer *writer, uint16_t n,
+	const struct tiff_image_f *f, void *arg)
 {
 	size_t offset = 0;
 
@@ -208,35 +209,50 @@ bool tiff_image(uint16_t n, const struct tiff_image_f *f, void *arg)
 		if (!f->image(&width, &height, arg))
 			return false;
 
-		if (!tiff_header_ifd(i, n, width, height, &offset, f, arg))
+		if (!tiff_header_ifd(i, n, width, height, &offset, writer))
 			return false;
 
-		struct pixel_buf {
-			size_t n;
-			struct tiff_pixel pixel[1024];
-		} buf = { };
+		for (uint16_t y = 0; y < height; y++) {
+			struct tiff_pixel *row = file_writer_buffer(writer,
+				sizeof(struct tiff_pixel[width]));
 
-		for (uint16_t y = 0; y < height; y++)
-		for (uint16_t x = 0; x < width; x++) {
-			if (!f->pixel(x, y, &buf.pixel[buf.n++], arg))
+			if (!row || !f->row(y, width, row, arg))
 				return false;
+		}
+	}
 
-			if (buf.n < ARRAY_SIZE(buf.pixel))
-				continue;
+	return true;
+}
 
-			if (!f->write(buf.pixel,
-					sizeof(struct tiff_pixel[buf.n]), arg))
-				return false;
+/**
+ * tiff_image - write TIFF images of 16-bit RGBA pixels
+ * @n: number of images
+ * @f: callbacks for the size of every image, its rows and writing
+ * @arg: argument passed to the callbacks
+ *
+ * Rows are drawn directly into the buffers of an asynchronous writer,
+ * such that drawing and writing overlap. The @f->image and @f->row
+ * callbacks are called on the calling thread, and @f->write on the
+ * writer thread.
+ *
+ * Return: %true on success, otherwise %false with errno set
+ */
+bool tiff_image(uint16_t n, const struct tiff_image_f *f, void *arg)
+{
+	struct file_writer *writer = file_writer_open(f->write, arg);
+
+	if (!writer)
+		return false;
 
-			buf = (struct pixel_buf) { };
+	if (!tiff_images(writer, n, f, arg)) {
+		preserve (errno) {
+			file_writer_close(writer);
 		}
 
-		if (buf.n && !f->write(buf.pixel,
-				sizeof(struct tiff_pixel[buf.n]), arg))
-			return false;
+		return false;
 	}
 
-	return true;
+	return file_writer_close(writer);
 }
 
 struct file_arg {
@@ -253,12 +269,12 @@ static bool tiff_file_image(uint16_t *width, uint16_t *height, void *arg)
 	return arg_->f->image(width, height, arg_->arg);
 }
 
-static bool tiff_file_pixel(uint16_t x, uint16_t y,
-	struct tiff_pixel *pixel, void *arg)
+static bool tiff_file_row(uint16_t y, uint16_t width,
+	struct tiff_pixel *row, void *arg)
 {
 	struct file_arg *arg_ = arg;
 
-	return arg_->f->pixel(x, y, pixel, arg_->arg);
+	return arg_->f->row(y, width, row, arg_->arg);
 }
 
 static bool tiff_file_write(const void *buf, size_t nbyte, void *arg)
@@ -273,7 +289,7 @@ bool tiff_image_file(const char *path, uint16_t n,
 {
 	static const struct tiff_image_f ff = {
 		.image = tiff_file_image,
-		.pixel = tiff_file_pixel,
+		.row = tiff_file_row,
 		.write = tiff_file_write
 	};
 	struct file_arg arg_ = {
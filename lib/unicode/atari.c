@@ -1,5 +1,9 @@
 // SPDX-License-Identifier: GPL-2.0
 
+#include <pthread.h>
+#include <string.h>
+
+#include "internal/assert.h"
 #include "internal/macro.h"
 
 #include "unicode/atari.h"
@@ -277,18 +281,112 @@ const char *charset_atari_st_to_name(uint8_t c, void *arg)
 	return atari_st_charset[c].name;
 }
 
+/*
+ * Reverse index of the charset, as a two-level table of code points in
+ * pages of 256. The charset spans 15 pages, so the index is small. It is
+ * built once on first use.
+ */
+#define ATARI_ST_INDEX_PAGES	16
+#define ATARI_ST_PAGE_SIZE	256
+#define ATARI_ST_CODE_PAGES	(0x110000 / ATARI_ST_PAGE_SIZE)
+
+static struct {
+	uint8_t page[ATARI_ST_CODE_PAGES];
+	int16_t c[1 + ATARI_ST_INDEX_PAGES][ATARI_ST_PAGE_SIZE];
+} atari_st_index;
+
+static pthread_once_t atari_st_index_once = PTHREAD_ONCE_INIT;
+
+static void atari_st_index_init(void)
+{
+	int pages = 0;
+
+	/* Page 0 of the index is empty, for code points not in the charset. */
+	memset(atari_st_index.c, 0xff, sizeof(atari_st_index.c));
+
+	for (int c = 0; c < ARRAY_SIZE(atari_st_charset); c++) {
+		const unicode_t u = atari_st_charset[c].code;
+		const size_t p = u / ATARI_ST_PAGE_SIZE;
+
+		BUG_ON(p >= ATARI_ST_CODE_PAGES);
+
+		if (!atari_st_index.page[p]) {
+			BUG_ON(pages == ATARI_ST_INDEX_PAGES);
+			atari_st_index.page[p] = ++pages;
+		}
+
+		int16_t *i = &atari_st_index.c[atari_st_index.page[p]]
+					      [u % ATARI_ST_PAGE_SIZE];
+
+		if (*i < 0)
+			*i = c;
+	}
+}
+
+/* Character of a code point, or -1 if not in the charset. */
+static int atari_st_index_lookup(unicode_t u)
+{
+	if (u >= ATARI_ST_CODE_PAGES * ATARI_ST_PAGE_SIZE)
+		return -1;
+
+	return atari_st_index.c[atari_st_index.page[u / ATARI_ST_PAGE_SIZE]]
+			       [u % ATARI_ST_PAGE_SIZE];
+}
+
 uint8_t utf32_to_charset_atari_st(unicode_t u, void *arg)
 {
-	for (int c = 0; c < ARRAY_SIZE(atari_st_charset); c++)
-		if (u == atari_st_charset[c].code)
-			return c;
+	pthread_once(&atari_st_index_once, atari_st_index_init);
 
-	return '?';
+	const int c = atari_st_index_lookup(u);
+
+	return c >= 0 ? c : '?';
 }
 
 bool utf8_valid_in_atari_st(const uint8_t *u, size_t length)
 {
-	return utf8_valid_in_charset_string(u, length,
-			charset_atari_st_to_utf32,
-			utf32_to_charset_atari_st, NULL);
+	size_t i = 0;
+
+	pthread_once(&atari_st_index_once, atari_st_index_init);
+
+	while (i < length && u[i]) {
+		unicode_t c = 0;
+
+		const int r = utf8_to_utf32(&c, &u[i], length - i);
+
+		i += r != -1 ? r : 1;
+
+		if (atari_st_index_lookup(c) < 0)
+			return false;
+	}
+
+	return true;
+}
+
+/**
+ * charset_atari_st_to_utf8_string - convert an Atari ST string to UTF-8
+ * @s: Atari ST string
+ * @length: maximum length in bytes of @s, that may also be NUL terminated
+ *
+ * Return: NUL terminated UTF-8 string to free, or %NULL with errno set
+ */
+uint8_t *charset_atari_st_to_utf8_string(const uint8_t *s, size_t length)
+{
+	return charset_to_utf8_string(s, length,
+		charset_atari_st_to_utf32, NULL);
+}
+
+/**
+ * utf8_to_charset_atari_st_string - convert a UTF-8 string to Atari ST
+ * @u: UTF-8 string
+ * @length: maximum length in bytes of @u, that may also be NUL terminated
+ *
+ * Invalid UTF-8 sequences are skipped, and code points not in the charset
+ * are converted to ``?``.
+ *
+ * Return: NUL terminated Atari ST string to free, or %NULL with errno set
+ */
+uint8_t *utf8_to_charset_atari_st_string(const uint8_t *u, size_t length)
+{
+	return utf8_to_charset_string(u, length,
+		utf32_to_charset_atari_st, NULL);
 }
@@ -2,11 +2,19 @@
 
 #define _POSIX_C_SOURCE 200809L
 
+#include <errno.h>
 #include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
 #include "internal/assert.h"
+#include "internal/string.h"
 #include "internal/types.h"
 
 #include "unicode/utf8.h"
@@ -124,7 +132,7 @@ ssize_t charset_to_utf8_string_length(const uint8_t *s, size_t length,
 {
 	ssize_t size = 0;
 
-	for (size_t i = 0; s[i] && i < length; i++) {
+	for (size_t i = 0; i < length && s[i]; i++) {
 		int r = utf32_to_utf8_length(charset_to_utf32(s[i], arg));
 
 		if (r == -1)
@@ -139,38 +147,128 @@ ssize_t charset_to_utf8_string_length(const uint8_t *s, size_t length,
 	return size;
 }
 
-uint8_t *charset_to_utf8_string(const uint8_t *s, size_t length,
-	 unicode_t (*charset_to_utf32)(uint8_t c, void *arg), void *arg)
+/**
+ * utf8_ascii_length - length of a run of printable ASCII characters
+ * @s: string
+ * @length: length in bytes of @s
+ *
+ * Printable ASCII is searched 16 bytes at a time with SSE2 or NEON, and
+ * otherwise 8 bytes at a time in a 64-bit word, where every byte b with
+ * bit 7 clear is printable if b + 0x60 has bit 7 set and b + 0x01 has not.
+ *
+ * Return: number of leading bytes of @s in the range 0x20 to 0x7e
+ */
+size_t utf8_ascii_length(const uint8_t *s, size_t length)
 {
-	const ssize_t size = charset_to_utf8_string_length(s, length,
-			charset_to_utf32, arg);
+	size_t i = 0;
 
-	if (size == -1)
-		return NULL;
+#if defined(__SSE2__)
+	const __m128i lo = _mm_set1_epi8(0x20 - 1);
+	const __m128i hi = _mm_set1_epi8(0x7f);
 
-	uint8_t *u = malloc(size + 1);
-	if (!s)
-		return NULL;
+	for (; i + 16 <= length; i += 16) {
+		const __m128i v = _mm_loadu_si128((const __m128i *)&s[i]);
+		const int mask = _mm_movemask_epi8(_mm_and_si128(
+			_mm_cmpgt_epi8(v, lo), _mm_cmplt_epi8(v, hi)));
+
+		if (mask != 0xffff)
+			return i + __builtin_ctz(~mask);
+	}
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+	const uint8x16_t lo = vdupq_n_u8(0x20);
+	const uint8x16_t hi = vdupq_n_u8(0x7e);
+
+	for (; i + 16 <= length; i += 16) {
+		const uint8x16_t v = vld1q_u8(&s[i]);
+
+		if (vminvq_u8(vandq_u8(vcgeq_u8(v, lo), vcleq_u8(v, hi))) != 0xff)
+			break;
+	}
+#endif
+
+	for (; i + 8 <= length; i += 8) {
+		const uint64_t h = 0x8080808080808080ull;
+		uint64_t x;
+
+		memcpy(&x, &s[i], sizeof(x));
+
+		if ((x & h) || (~(x + 0x6060606060606060ull) & h) ||
+		    ((x + 0x0101010101010101ull) & h))
+			break;
+	}
+
+	while (i < length && 0x20 <= s[i] && s[i] <= 0x7e)
+		i++;
+
+	return i;
+}
+
+/**
+ * charset_to_utf8_strbuf - append a charset string converted to UTF-8
+ * @sb: string buffer to append to, can be initialised to zero
+ * @s: charset string
+ * @length: maximum length in bytes of @s, that may also be NUL terminated
+ * @charset_to_utf32: callback to convert a character to a code point
+ * @arg: argument passed to @charset_to_utf32
+ *
+ * Runs of printable ASCII are copied as is, so the charset must map
+ * printable ASCII to itself, as GEM charsets do.
+ *
+ * Return: %true on success, otherwise %false with errno set
+ */
+bool charset_to_utf8_strbuf(struct strbuf *sb,
+	const uint8_t *s, size_t length,
+	unicode_t (*charset_to_utf32)(uint8_t c, void *arg), void *arg)
+{
+	size_t i = 0;
 
-	size_t n = 0;
+	/* The runs are searched in blocks, so they must not pass a NUL. */
+	length = strnlen((const char *)s, length);
+
+	for (;;) {
+		const size_t n = utf8_ascii_length(&s[i], length - i);
+
+		/* Room for the run and the UTF-8 sequence of one character. */
+		if (!sbreserve(sb, n + 4))
+			return false;
+
+		memcpy(&sb->s[sb->length], &s[i], n);
+		sb->length += n;
+		i += n;
+
+		if (i == length)
+			break;
 
-	for (size_t i = 0; s[i] && i < length; i++) {
 		const int r = utf32_to_utf8_with_replacement(
-				charset_to_utf32(s[i], arg), &u[n], size - n);
+			charset_to_utf32(s[i], arg),
+			(uint8_t *)&sb->s[sb->length], 4);
 
 		if (r == -1) {
-			free(u);
-			return NULL;
+			sb->s[sb->length] = '\0';
+			errno = EILSEQ;
+			return false;
 		}
 
-		n += r;
+		sb->length += r;
+		i++;
 	}
 
-	BUG_ON(n != size);
+	sb->s[sb->length] = '\0';
 
-	u[n] = '\0';
+	return true;
+}
+
+uint8_t *charset_to_utf8_string(const uint8_t *s, size_t length,
+	 unicode_t (*charset_to_utf32)(uint8_t c, void *arg), void *arg)
+{
+	struct strbuf sb = { };
+
+	if (!charset_to_utf8_strbuf(&sb, s, length, charset_to_utf32, arg)) {
+		free(sb.s);
+		return NULL;
+	}
 
-	return u;
+	return (uint8_t *)sb.s;
 }
 
 ssize_t utf8_to_charset_string_length(const uint8_t *u, size_t length)
@@ -178,7 +276,7 @@ ssize_t utf8_to_charset_string_length(const uint8_t *u, size_t length)
 	ssize_t size = 0;
 	size_t i = 0;
 
-	while (u[i] && i < length) {
+	while (i < length && u[i]) {
 		int r = utf8_to_utf32(NULL, &u[i], length - i);
 
 		if (r != -1) {
@@ -191,40 +289,72 @@ ssize_t utf8_to_charset_string_length(const uint8_t *u, size_t length)
 	return size;
 }
 
-uint8_t *utf8_to_charset_string(const uint8_t *u, size_t length,
-	 uint8_t (*utf32_to_charset)(unicode_t u, void *arg), void *arg)
+/**
+ * utf8_to_charset_strbuf - append a UTF-8 string converted to a charset
+ * @sb: string buffer to append to, can be initialised to zero
+ * @u: UTF-8 string
+ * @length: maximum length in bytes of @u, that may also be NUL terminated
+ * @utf32_to_charset: callback to convert a code point to a character
+ * @arg: argument passed to @utf32_to_charset
+ *
+ * Invalid UTF-8 sequences are skipped. Runs of printable ASCII are copied
+ * as is, so the charset must map printable ASCII to itself, as GEM
+ * charsets do.
+ *
+ * Return: %true on success, otherwise %false with errno set
+ */
+bool utf8_to_charset_strbuf(struct strbuf *sb,
+	const uint8_t *u, size_t length,
+	uint8_t (*utf32_to_charset)(unicode_t u, void *arg), void *arg)
 {
-	const ssize_t size = utf8_to_charset_string_length(u, length);
+	size_t i = 0;
 
-	if (size == -1)
-		return NULL;
+	/* The runs are searched in blocks, so they must not pass a NUL. */
+	length = strnlen((const char *)u, length);
 
-	uint8_t *s = malloc(size + 1);
-	if (!s)
-		return NULL;
+	for (;;) {
+		const size_t n = utf8_ascii_length(&u[i], length - i);
 
-	size_t n = 0;
-	size_t i = 0;
+		/* Room for the run and one character. */
+		if (!sbreserve(sb, n + 1))
+			return false;
+
+		memcpy(&sb->s[sb->length], &u[i], n);
+		sb->length += n;
+		i += n;
+
+		if (i == length)
+			break;
 
-	while (u[i] && i < length) {
 		unicode_t c = 0;
 
-		int r = utf8_to_utf32(&c, &u[i], length - i);
+		const int r = utf8_to_utf32(&c, &u[i], length - i);
 
 		if (r == -1) {
 			i++;
 			continue;
 		}
 
-		s[n++] = utf32_to_charset(c, arg);
+		sb->s[sb->length++] = utf32_to_charset(c, arg);
 		i += r;
 	}
 
-	BUG_ON(n != size);
+	sb->s[sb->length] = '\0';
+
+	return true;
+}
 
-	s[n] = '\0';
+uint8_t *utf8_to_charset_string(const uint8_t *u, size_t length,
+	 uint8_t (*utf32_to_charset)(unicode_t u, void *arg), void *arg)
+{
+	struct strbuf sb = { };
+
+	if (!utf8_to_charset_strbuf(&sb, u, length, utf32_to_charset, arg)) {
+		free(sb.s);
+		return NULL;
+	}
 
-	return s;
+	return (uint8_t *)sb.s;
 }
 
 bool utf8_valid_in_charset_string(const uint8_t *u, size_t length,
@@ -233,7 +363,7 @@ bool utf8_valid_in_charset_string(const uint8_t *u, size_t length,
 {
 	size_t i = 0;
 
-	while (u[i] && i < length) {
+	while (i < length && u[i]) {
 		unicode_t c = 0;
 
 		int r = utf8_to_utf32(&c, &u[i], length - i);
@@ -0,0 +1,271 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Copyright (C) 2022 Fredrik Noring
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "internal/compare.h"
+#include "internal/deflate.h"
+#include "internal/macro.h"
+#include "internal/memory.h"
+#include "internal/print.h"
+
+#include "inflate.h"
+#include "random.h"
+
+char progname[] = "test/deflate";
+
+struct zlib_buffer {
+	uint8_t *data;
+	size_t size;
+};
+
+static bool zlib_buffer_write(const void *buf, size_t nbyte, void *arg)
+{
+	struct zlib_buffer *zb = arg;
+
+	zb->data = xrealloc(zb->data, zb->size + nbyte);
+	memcpy(&zb->data[zb->size], buf, nbyte);
+	zb->size += nbyte;
+
+	return true;
+}
+
+/*
+ * Data is written in pieces of 1 to @piece bytes, or all at once if
+ * @piece is zero.
+ */
+static struct zlib_buffer zlib_compress(const uint8_t *data,
+	const size_t size, const size_t piece)
+{
+	struct zlib_buffer zb = { };
+	struct zlib_writer *z = zlib_writer_open(zlib_buffer_write, &zb);
+
+	if (!z)
+		pr_fatal_errno("zlib_writer_open");
+
+	for (size_t i = 0; i < size; ) {
+		const size_t n = min(size - i,
+			piece ? 1 + random_next() % piece : size);
+
+		if (!zlib_writer_write(z, &data[i], n))
+			pr_fatal_errno("zlib_writer_write");
+
+		i += n;
+	}
+
+	if (!zlib_writer_close(z))
+		pr_fatal_errno("zlib_writer_close");
+
+	return zb;
+}
+
+/*
+ * Data is compressed all at once and in random pieces, that must give
+ * the same stream, and inflated to the same data with the same Adler-32
+ * checksum. The number of blocks of each type is accumulated in @blocks.
+ */
+static void check_round_trip(const char *name, const uint8_t *data,
+	const size_t size, size_t blocks[INFLATE_BLOCK_TYPES])
+{
+	struct zlib_buffer a = zlib_compress(data, size, 0);
+	struct zlib_buffer b = zlib_compress(data, size,
+		1 + random_next() % 100000);
+	struct inflate z = {
+		.in = a.data,
+		.size = a.size
+	};
+
+	if (a.size != b.size || memcmp(a.data, b.data, a.size) != 0)
+		pr_fatal_error("%s: %zu bytes written in pieces differ\n",
+			name, size);
+
+	if (!inflate(&z))
+		pr_fatal_error("%s: %zu bytes fail to inflate\n", name, size);
+
+	if (z.length != size || (size && memcmp(z.out, data, size) != 0))
+		pr_fatal_error("%s: %zu bytes inflate differently\n",
+			name, size);
+
+	for (int i = 0; i < INFLATE_BLOCK_TYPES; i++)
+		blocks[i] += z.blocks[i];
+
+	free(z.out);
+	free(b.data);
+	free(a.data);
+}
+
+static void check_adler32(void)
+{
+	static const char wikipedia[] = "Wikipedia";
+	uint8_t data[20000];
+
+	if (adler32(1, wikipedia, strlen(wikipedia)) != 0x11e60398)
+		pr_fatal_error("adler32 of \"%s\"\n", wikipedia);
+
+	if (adler32(1, NULL, 0) != 1)
+		pr_fatal_error("adler32 of nothing\n");
+
+	/* All 0xff maximises the sums, to overflow if not reduced. */
+	for (int fill = 0; fill < 2; fill++) {
+		for (size_t i = 0; i < sizeof(data); i++)
+			data[i] = fill ? 0xff : random_next();
+
+		for (int k = 0; k < 100; k++) {
+			const size_t n = random_next() % (sizeof(data) + 1);
+			const size_t split = random_next() % (n + 1);
+			const uint32_t a = adler32(adler32(1, data, split),
+				&data[split], n - split);
+
+			if (a != inflate_adler32(data, n))
+				pr_fatal_error("adler32 of %zu bytes split "
+					"at %zu\n", n, split);
+		}
+	}
+}
+
+enum data_kind {
+	DATA_RANDOM,
+	DATA_RUN,
+	DATA_TEXT,
+	DATA_MIXED
+};
+
+/*
+ * Mixed data has pieces of random bytes, runs and copies of earlier data
+ * at distances up to and beyond the window, to take every match length
+ * and distance.
+ */
+static uint8_t *random_data(const enum data_kind kind, const size_t size)
+{
+	static const char *words[] = {
+		"the ", "resource ", "object ", "tree ", "BOX ", "IBOX ",
+		"text ", "font ", "\n", "drawn ", "with ", "layers "
+	};
+	uint8_t *data = xmalloc(max_t(size_t, size, 1));
+	const uint8_t c = random_next();
+
+	for (size_t i = 0; i < size; ) {
+		const uint32_t r = random_next();
+		size_t n = min_t(size_t, size - i, 1 + (r >> 8) % 300);
+
+		switch (kind == DATA_MIXED ? r % 3 : kind) {
+		case DATA_RANDOM:
+			for (size_t k = 0; k < n; k++)
+				data[i + k] = random_next();
+			break;
+		case DATA_RUN:
+			memset(&data[i], c, n);
+			break;
+		case DATA_TEXT: {
+			const char *w = words[r % ARRAY_SIZE(words)];
+
+			n = min(n, strlen(w));
+			memcpy(&data[i], w, n);
+			break;
+		}
+		default: {
+			const size_t d = 1 + random_next() %
+				min_t(size_t, i ? i : 1, 40000);
+
+			if (d > i) {
+				data[i] = r;
+				n = 1;
+				break;
+			}
+
+			for (size_t k = 0; k < n; k++)
+				data[i + k] = data[i + k - d];
+		}
+		}
+
+		i += n;
+	}
+
+	return data;
+}
+
+static void check_degenerate(void)
+{
+	size_t blocks[INFLATE_BLOCK_TYPES] = { };
+	uint8_t *data = zalloc(1000000);
+
+	check_round_trip("empty", data, 0, blocks);
+
+	for (int c = 0; c < 256; c += 85)
+		check_round_trip("one byte", (const uint8_t[]) { c }, 1, blocks);
+
+	for (size_t size = 2; size < 300; size++)
+		check_round_trip("short run", data, size, blocks);
+
+	check_round_trip("long run", data, 1000000, blocks);
+
+	/* A single repeated literal has a code of a single symbol. */
+	memset(data, 'a', 1000);
+	for (size_t size = 2; size < 5; size++)
+		check_round_trip("literals", data, size, blocks);
+
+	free(data);
+
+	if (!blocks[INFLATE_BLOCK_FIXED])
+		pr_fatal_error("degenerate data without fixed blocks\n");
+}
+
+static void check_block_types(void)
+{
+	static const struct {
+		const char *name;
+		enum data_kind kind;
+		size_t size;
+		enum inflate_block block;
+	} checks[] = {
+		{ "incompressible", DATA_RANDOM, 300000, INFLATE_BLOCK_STORED },
+		{ "short text", DATA_TEXT, 20, INFLATE_BLOCK_FIXED },
+		{ "text", DATA_TEXT, 200000, INFLATE_BLOCK_DYNAMIC },
+	};
+
+	for (size_t i = 0; i < ARRAY_SIZE(checks); i++) {
+		size_t blocks[INFLATE_BLOCK_TYPES] = { };
+		uint8_t *data = random_data(checks[i].kind, checks[i].size);
+
+		check_round_trip(checks[i].name, data, checks[i].size, blocks);
+
+		if (!blocks[checks[i].block])
+			pr_fatal_error("%s: block type %d not taken\n",
+				checks[i].name, checks[i].block);
+
+		free(data);
+	}
+}
+
+static void check_random(void)
+{
+	size_t blocks[INFLATE_BLOCK_TYPES] = { };
+
+	for (int i = 0; i < 200; i++) {
+		const enum data_kind kind = random_next() % 4;
+		const size_t size = random_next() % (i % 10 ? 5000 : 400000);
+		uint8_t *data = random_data(kind, size);
+
+		check_round_trip("random", data, size, blocks);
+
+		free(data);
+	}
+
+	for (int i = 0; i < INFLATE_BLOCK_TYPES; i++)
+		if (!blocks[i])
+			pr_fatal_error("random data without block type %d\n", i);
+}
+
+int main(int argc, char *argv[])
+{
+	check_adler32();
+	check_degenerate();
+	check_block_types();
+	check_random();
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,203 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Copyright (C) 2022 Fredrik Noring
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <gem/fnt.h>
+#include <gem/vdi.h>
+
+#include "internal/macro.h"
+#include "internal/memory.h"
+#include "internal/print.h"
+
+#include "random.h"
+
+char progname[] = "test/fnt";
+
+/*
+ * Big-endian fonts are made of copies of the system fonts, with the header
+ * words and the offset tables byte-swapped and the big-endian flag set, as
+ * in original Atari fonts. Normalised, they must be identical to the
+ * system fonts, and give the same pixels for every character.
+ */
+static const struct {
+	uint16_t point;
+	uint16_t height;
+} system_fonts[] = {
+	{ .point =  8, .height =  6 },
+	{ .point =  9, .height =  8 },
+	{ .point = 10, .height = 16 },
+};
+
+static void byte_swap(uint8_t *b, const size_t size)
+{
+	for (size_t i = 0; i < size / 2; i++) {
+		const uint8_t t = b[i];
+
+		b[i] = b[size - 1 - i];
+		b[size - 1 - i] = t;
+	}
+}
+
+static void byte_swap_words(uint8_t *b, const size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+		byte_swap(&b[2 * i], 2);
+}
+
+static void byte_swap_header(struct fnt_header *header)
+{
+	uint8_t *b = (uint8_t *)header;
+
+#define SWAP_HEADER_FIELD(type_, symbol_, form_)			\
+	if (sizeof(type_) == 2 || sizeof(type_) == 4)			\
+		byte_swap(&b[offsetof(struct fnt_header, symbol_)],	\
+			sizeof(type_));
+FNT_HEADER_FIELD(SWAP_HEADER_FIELD)
+}
+
+static struct fnt_header *big_endian_font(const struct fnt *fnt)
+{
+	struct fnt_header *header = xmemdup(fnt->header, fnt->size);
+	const size_t count = 1 + header->last - header->first;
+	uint8_t *b = (uint8_t *)header;
+
+	if (header->flags.horizontal)
+		byte_swap_words(&b[header->horizontal_offsets], count);
+	byte_swap_words(&b[header->character_offsets], count + 1);
+
+	header->flags.big_endian = 1;
+	byte_swap_header(header);
+
+	return header;
+}
+
+/*
+ * Proportional fonts have a table of horizontal offsets, that is appended
+ * with random offsets to a copy of the font.
+ */
+static struct fnt proportional_font(const struct fnt *fnt)
+{
+	const size_t count = 1 + fnt->header->last - fnt->header->first;
+	const size_t size = fnt->size + 2 * count;
+	struct fnt_header *header = xmalloc(size);
+	uint8_t *b = (uint8_t *)header;
+
+	memcpy(header, fnt->header, fnt->size);
+
+	for (size_t i = 0; i < 2 * count; i++)
+		b[fnt->size + i] = random_next();
+
+	header->flags.horizontal = 1;
+	header->horizontal_offsets = fnt->size;
+
+	return (struct fnt) {
+		.size = size,
+		.header = header
+	};
+}
+
+static void check_chars(const struct fnt *a, const struct fnt *b)
+{
+	const size_t stride = (a->header->max_cell_width + 7) / 8 + 1;
+	const size_t size = stride * a->header->bitmap_lines;
+	uint8_t *bitmap_a = xmalloc(size);
+	uint8_t *bitmap_b = xmalloc(size);
+
+	for (int c = 0; c < 256; c++) {
+		memset(bitmap_a, 0, size);
+		memset(bitmap_b, 0, size);
+
+		const int wa = fnt_char_bitmap(bitmap_a, stride, c, a);
+		const int wb = fnt_char_bitmap(bitmap_b, stride, c, b);
+
+		if (wa != wb || memcmp(bitmap_a, bitmap_b, size) != 0)
+			pr_fatal_error("%u point character %d bitmap differs\n",
+				a->header->point, c);
+
+		if (fnt_char_horizontal(c, a) != fnt_char_horizontal(c, b))
+			pr_fatal_error("%u point character %d horizontal "
+				"offset differs\n", a->header->point, c);
+	}
+
+	free(bitmap_b);
+	free(bitmap_a);
+}
+
+static void check_normalise(const struct fnt *fnt)
+{
+	struct fnt_header *big = big_endian_font(fnt);
+	struct fnt_header header = *big;
+	const struct fnt swapped = {
+		.size = fnt->size,
+		.header = big
+	};
+	const uint16_t point = fnt->header->point;
+
+	if (fnt_valid(&swapped))
+		pr_fatal_error("%u point big-endian font valid\n", point);
+
+	/* The header alone is swapped, with the big-endian flag kept. */
+	fnt_normalise_header(&header);
+	if (!header.flags.big_endian)
+		pr_fatal_error("%u point header big-endian flag cleared\n",
+			point);
+	header.flags.big_endian = 0;
+	if (memcmp(&header, fnt->header, sizeof(header)) != 0)
+		pr_fatal_error("%u point header normalised differs\n", point);
+
+	/* Offset tables beyond the end of the font are not converted. */
+	memcpy(&header, big, sizeof(header));
+	if (fnt_normalise(&header, sizeof(header)))
+		pr_fatal_error("%u point truncated font normalised\n", point);
+
+	if (!fnt_normalise(big, fnt->size))
+		pr_fatal_error("%u point font normalise\n", point);
+	if (memcmp(big, fnt->header, fnt->size) != 0)
+		pr_fatal_error("%u point font normalised differs\n", point);
+	if (!fnt_valid(&swapped))
+		pr_fatal_error("%u point font normalised invalid\n", point);
+
+	check_chars(fnt, &swapped);
+
+	/* Fonts already in little-endian form are unchanged. */
+	if (!fnt_normalise(big, fnt->size) ||
+	    memcmp(big, fnt->header, fnt->size) != 0)
+		pr_fatal_error("%u point font normalised twice differs\n",
+			point);
+
+	free(big);
+}
+
+int main(int argc, char *argv[])
+{
+	vdi_id_t vdi_id = vdi_v_opnwk(NULL, NULL);
+
+	if (!vdi_id_valid(vdi_id))
+		pr_fatal_errno("vdi_v_opnwk");
+
+	for (size_t i = 0; i < ARRAY_SIZE(system_fonts); i++) {
+		const struct fnt *fnt = vdi_fnt_lookup(vdi_id,
+			VDI_SYSTEM_FONT, system_fonts[i].point,
+			system_fonts[i].height);
+
+		if (!fnt)
+			pr_fatal_error("system font %zu lookup\n", i);
+
+		const struct fnt proportional = proportional_font(fnt);
+
+		check_normalise(fnt);
+		check_normalise(&proportional);
+
+		free((void *)proportional.header);
+	}
+
+	vdi_v_clswk(vdi_id);
+
+	return EXIT_SUCCESS;
+}
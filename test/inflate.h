@@ -0,0 +1,383 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Copyright (C) 2022 Fredrik Noring
+ *
+ * Inflater of the zlib format of RFC 1950, written from RFC 1951 for
+ * tests, independently of lib/internal/deflate.c. Codes are decoded one
+ * bit at a time with canonical Huffman counts, much as with puff of zlib.
+ */
+
+#ifndef TEST_INFLATE_H
+#define TEST_INFLATE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "internal/compare.h"
+#include "internal/macro.h"
+#include "internal/memory.h"
+
+#define INFLATE_MAX_BITS	15
+
+enum inflate_block {
+	INFLATE_BLOCK_STORED,
+	INFLATE_BLOCK_FIXED,
+	INFLATE_BLOCK_DYNAMIC,
+	INFLATE_BLOCK_TYPES
+};
+
+/**
+ * struct inflate - zlib stream to inflate
+ * @in: compressed data
+ * @size: size in bytes of @in
+ * @pos: position in @in of the next byte
+ * @bits: bits not yet consumed, least significant first
+ * @count: number of bits in @bits
+ * @out: inflated data
+ * @length: length in bytes of @out
+ * @capacity: size in bytes of @out
+ * @blocks: number of blocks of each type
+ */
+struct inflate {
+	const uint8_t *in;
+	size_t size;
+	size_t pos;
+	uint32_t bits;
+	int count;
+
+	uint8_t *out;
+	size_t length;
+	size_t capacity;
+
+	size_t blocks[INFLATE_BLOCK_TYPES];
+};
+
+struct inflate_huffman {
+	uint16_t count[INFLATE_MAX_BITS + 1];
+	uint16_t symbol[288];
+};
+
+/* Adler-32 one byte at a time, as given by RFC 1950. */
+static inline uint32_t inflate_adler32(const uint8_t *b, size_t n)
+{
+	uint32_t s1 = 1;
+	uint32_t s2 = 0;
+
+	for (size_t i = 0; i < n; i++) {
+		s1 = (s1 + b[i]) % 65521;
+		s2 = (s2 + s1) % 65521;
+	}
+
+	return (s2 << 16) | s1;
+}
+
+static inline bool inflate_bits(struct inflate *z, const int n, int *v)
+{
+	while (z->count < n) {
+		if (z->pos == z->size)
+			return false;
+
+		z->bits |= (uint32_t)z->in[z->pos++] << z->count;
+		z->count += 8;
+	}
+
+	*v = z->bits & ((1u << n) - 1);
+	z->bits >>= n;
+	z->count -= n;
+
+	return true;
+}
+
+static inline void inflate_put(struct inflate *z, const uint8_t b)
+{
+	if (z->length == z->capacity) {
+		z->capacity = max_t(size_t, 0x1000, 2 * z->capacity);
+		z->out = xrealloc(z->out, z->capacity);
+	}
+
+	z->out[z->length++] = b;
+}
+
+/* Over-subscribed codes are invalid, but incomplete codes are allowed. */
+static inline bool inflate_huffman(struct inflate_huffman *h,
+	const uint8_t *lengths, const int n)
+{
+	uint16_t offset[INFLATE_MAX_BITS + 1];
+	int left = 1;
+
+	memset(h->count, 0, sizeof(h->count));
+
+	for (int s = 0; s < n; s++)
+		h->count[lengths[s]]++;
+
+	for (int l = 1; l <= INFLATE_MAX_BITS; l++) {
+		left = 2 * left - h->count[l];
+
+		if (left < 0)
+			return false;
+	}
+
+	offset[1] = 0;
+	for (int l = 1; l < INFLATE_MAX_BITS; l++)
+		offset[l + 1] = offset[l] + h->count[l];
+
+	for (int s = 0; s < n; s++)
+		if (lengths[s])
+			h->symbol[offset[lengths[s]]++] = s;
+
+	return true;
+}
+
+static inline int inflate_decode(struct inflate *z,
+	const struct inflate_huffman *h)
+{
+	int code = 0;
+	int first = 0;
+	int index = 0;
+
+	for (int l = 1; l <= INFLATE_MAX_BITS; l++) {
+		int b;
+
+		if (!inflate_bits(z, 1, &b))
+			return -1;
+
+		code |= b;
+
+		if (code - first < h->count[l])
+			return h->symbol[index + code - first];
+
+		index += h->count[l];
+		first = (first + h->count[l]) << 1;
+		code <<= 1;
+	}
+
+	return -1;
+}
+
+static inline bool inflate_stored(struct inflate *z)
+{
+	z->bits = 0;
+	z->count = 0;
+
+	if (z->size - z->pos < 4)
+		return false;
+
+	const uint8_t *b = &z->in[z->pos];
+	const int len = b[0] | (b[1] << 8);
+	const int nlen = b[2] | (b[3] << 8);
+
+	z->pos += 4;
+
+	if (len != (~nlen & 0xffff) || z->size - z->pos < len)
+		return false;
+
+	for (int i = 0; i < len; i++)
+		inflate_put(z, z->in[z->pos++]);
+
+	return true;
+}
+
+static inline bool inflate_codes(struct inflate *z,
+	const struct inflate_huffman *litlen,
+	const struct inflate_huffman *distance)
+{
+	static const uint16_t length_base[29] = {
+		3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+		35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+	};
+	static const uint8_t length_extra[29] = {
+		0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+		3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+	};
+	static const uint16_t distance_base[30] = {
+		1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+		257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+		8193, 12289, 16385, 24577
+	};
+	static const uint8_t distance_extra[30] = {
+		0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+		7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+	};
+
+	for (;;) {
+		const int s = inflate_decode(z, litlen);
+		int e, d;
+
+		if (s < 0)
+			return false;
+		if (s < 256) {
+			inflate_put(z, s);
+			continue;
+		}
+		if (s == 256)
+			return true;
+		if (s - 257 >= ARRAY_SIZE(length_base) ||
+		    !inflate_bits(z, length_extra[s - 257], &e))
+			return false;
+
+		const int length = length_base[s - 257] + e;
+		const int ds = inflate_decode(z, distance);
+
+		if (ds < 0 || ds >= ARRAY_SIZE(distance_base) ||
+		    !inflate_bits(z, distance_extra[ds], &d))
+			return false;
+
+		const size_t dist = distance_base[ds] + d;
+
+		if (dist > z->length)
+			return false;
+
+		for (int i = 0; i < length; i++)
+			inflate_put(z, z->out[z->length - dist]);
+	}
+}
+
+static inline bool inflate_fixed(struct inflate *z)
+{
+	uint8_t lengths[288];
+	struct inflate_huffman litlen, distance;
+
+	for (int s = 0; s < 288; s++)
+		lengths[s] = s < 144 ? 8 : s < 256 ? 9 : s < 280 ? 7 : 8;
+	inflate_huffman(&litlen, lengths, 288);
+
+	for (int s = 0; s < 30; s++)
+		lengths[s] = 5;
+	inflate_huffman(&distance, lengths, 30);
+
+	return inflate_codes(z, &litlen, &distance);
+}
+
+static inline bool inflate_dynamic(struct inflate *z)
+{
+	static const uint8_t order[19] = {
+		16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+	};
+	uint8_t lengths[286 + 30] = { };
+	struct inflate_huffman codelen, litlen, distance;
+	int hlit, hdist, hclen;
+
+	if (!inflate_bits(z, 5, &hlit) ||
+	    !inflate_bits(z, 5, &hdist) ||
+	    !inflate_bits(z, 4, &hclen))
+		return false;
+
+	hlit += 257;
+	hdist += 1;
+	hclen += 4;
+
+	if (hlit > 286 || hdist > 30)
+		return false;
+
+	for (int i = 0; i < hclen; i++) {
+		int l;
+
+		if (!inflate_bits(z, 3, &l))
+			return false;
+
+		lengths[order[i]] = l;
+	}
+
+	if (!inflate_huffman(&codelen, lengths, 19))
+		return false;
+
+	memset(lengths, 0, sizeof(lengths));
+
+	for (int i = 0; i < hlit + hdist; ) {
+		const int s = inflate_decode(z, &codelen);
+		int l = 0, r;
+
+		if (s < 0)
+			return false;
+		if (s < 16) {
+			lengths[i++] = s;
+			continue;
+		}
+		if (s == 16) {
+			if (!i || !inflate_bits(z, 2, &r))
+				return false;
+			l = lengths[i - 1];
+			r += 3;
+		} else if (s == 17) {
+			if (!inflate_bits(z, 3, &r))
+				return false;
+			r += 3;
+		} else {
+			if (!inflate_bits(z, 7, &r))
+				return false;
+			r += 11;
+		}
+
+		if (i + r > hlit + hdist)
+			return false;
+
+		while (r--)
+			lengths[i++] = l;
+	}
+
+	if (!lengths[256])
+		return false;	/* End of block must have a code */
+
+	return inflate_huffman(&litlen, lengths, hlit) &&
+	       inflate_huffman(&distance, &lengths[hlit], hdist) &&
+	       inflate_codes(z, &litlen, &distance);
+}
+
+/**
+ * inflate - inflate a zlib stream and check its Adler-32 checksum
+ * @z: zlib stream, with @z->in and @z->size given and other members zero
+ *
+ * The inflated data is in @z->out, to be freed by the caller, also if the
+ * stream is invalid.
+ *
+ * Return: %true if the stream is valid and complete, otherwise %false
+ */
+static inline bool inflate(struct inflate *z)
+{
+	int cmf, flg, final, type;
+
+	if (!inflate_bits(z, 8, &cmf) || !inflate_bits(z, 8, &flg) ||
+	    (cmf & 0xf) != 8 || (cmf >> 4) > 7 || (flg & 0x20) ||
+	    ((cmf << 8) | flg) % 31)
+		return false;
+
+	do {
+		if (!inflate_bits(z, 1, &final) || !inflate_bits(z, 2, &type))
+			return false;
+
+		switch (type) {
+		case INFLATE_BLOCK_STORED:
+			if (!inflate_stored(z))
+				return false;
+			break;
+		case INFLATE_BLOCK_FIXED:
+			if (!inflate_fixed(z))
+				return false;
+			break;
+		case INFLATE_BLOCK_DYNAMIC:
+			if (!inflate_dynamic(z))
+				return false;
+			break;
+		default:
+			return false;
+		}
+
+		z->blocks[type]++;
+	} while (!final);
+
+	z->bits = 0;
+	z->count = 0;
+
+	if (z->size - z->pos != 4)
+		return false;
+
+	const uint8_t *b = &z->in[z->pos];
+	const uint32_t adler = ((uint32_t)b[0] << 24) | (b[1] << 16) |
+		(b[2] << 8) | b[3];
+
+	return adler == inflate_adler32(z->out, z->length);
+}
+
+#endif /* TEST_INFLATE_H */
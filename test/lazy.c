@@ -0,0 +1,149 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Copyright (C) 2022 Fredrik Noring
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <gem/object.h>
+#include <gem/rsc.h>
+#include <gem/rsc-map.h>
+
+#include "internal/file.h"
+#include "internal/memory.h"
+#include "internal/print.h"
+
+#include "random.h"
+
+char progname[] = "test/lazy";
+
+enum lazy_order {
+	LAZY_FORWARD,
+	LAZY_REVERSE,
+	LAZY_RANDOM,
+	LAZY_ORDERS
+};
+
+/*
+ * Trees are accessed in forward, reverse or random order, and accessed
+ * again in index order, to give whether each of them is valid.
+ */
+static void lazy_valid(bool *valid, const enum lazy_order order,
+	const struct rsc *rsc, const char *path)
+{
+	const size_t ntree = rsc->header->rsh_ntree;
+	struct rsc_lazy *lazy = rsc_lazy_open(rsc, NULL, NULL);
+	size_t *index = xmalloc(sizeof(size_t) * ntree);
+
+	if (!lazy)
+		pr_fatal_errno(path);
+
+	for (size_t i = 0; i < ntree; i++)
+		index[i] = order == LAZY_REVERSE ? ntree - 1 - i : i;
+
+	if (order == LAZY_RANDOM)
+		for (size_t i = ntree - 1; i > 0; i--) {
+			const size_t k = random_next() % (i + 1);
+			const size_t t = index[i];
+
+			index[i] = index[k];
+			index[k] = t;
+		}
+
+	for (size_t i = 0; i < ntree; i++)
+		valid[index[i]] = rsc_lazy_tree_at_index(lazy, index[i]);
+
+	for (size_t i = 0; i < ntree; i++)
+		if (valid[i] != !!rsc_lazy_tree_at_index(lazy, i))
+			pr_fatal_error("%s: tree %zu validity changed\n",
+				path, i);
+
+	if (rsc_lazy_tree_at_index(lazy, ntree))
+		pr_fatal_error("%s: tree out of range found\n", path);
+
+	rsc_lazy_close(lazy);
+	free(index);
+}
+
+static struct rsc_object *lazy_last_object(struct rsc_object *tree)
+{
+	int16_t last = 0;
+
+	for (int16_t ob = 0; rsc_valid_ob(ob);
+	     ob = rsc_tree_traverse(ob, tree))
+		last = ob;
+
+	return &tree[last];
+}
+
+/*
+ * Tree k is corrupted such that it is found invalid only after all of
+ * its objects are mapped, and then with its root object marked as a
+ * string over the objects of the next tree, which must remain valid.
+ */
+static void lazy_corrupt(struct rsc *rsc, const size_t k)
+{
+	const size_t j = (k + 1) % rsc->header->rsh_ntree;
+	struct rsc_object *tree = rsc_tree_at_index(k, rsc);
+
+	tree[0].shape.type.g = GEM_G_STRING;
+	tree[0].shape.spec.string = rsc_tree_offset_at_index(j, rsc);
+	lazy_last_object(tree)->shape.flags.lastob = 0;
+}
+
+static void check_lazy(const char *path)
+{
+	struct file f = file_read(path);
+
+	if (!file_valid(&f))
+		pr_fatal_errno(path);
+
+	struct rsc rsc = {
+		.size = f.size,
+		.header = (struct rsc_header *)f.data
+	};
+
+	if (!rsc_valid_structure(&rsc))
+		pr_fatal_error("%s: malformed RSC structure\n", path);
+
+	const size_t ntree = rsc.header->rsh_ntree;
+	uint8_t *original = xmemdup(f.data, f.size);
+	bool *valid = xmalloc(sizeof(bool) * ntree);
+
+	for (size_t k = 0; k <= ntree; k++) {
+		memcpy(f.data, original, f.size);
+
+		/* All trees of the unchanged file are valid. */
+		if (k < ntree)
+			lazy_corrupt(&rsc, k);
+
+		if (k < ntree && rsc_valid_structure(&rsc))
+			pr_fatal_error("%s: tree %zu corrupted but valid\n",
+				path, k);
+
+		for (int order = 0; order < LAZY_ORDERS; order++) {
+			lazy_valid(valid, order, &rsc, path);
+
+			for (size_t i = 0; i < ntree; i++)
+				if (valid[i] != (i != k))
+					pr_fatal_error("%s: tree %zu corrupted, "
+						"tree %zu %s in order %d\n",
+						path, k, i, valid[i] ?
+						"valid" : "invalid", order);
+		}
+	}
+
+	free(valid);
+	free(original);
+	file_free(&f);
+}
+
+int main(int argc, char *argv[])
+{
+	for (int i = 1; i < argc; i++)
+		check_lazy(argv[i]);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,332 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Copyright (C) 2022 Fredrik Noring
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <gem/aes.h>
+#include <gem/aes-rsc.h>
+#include <gem/aes-shape.h>
+#include <gem/aes-surface.h>
+#include <gem/rsc.h>
+
+#include "internal/file.h"
+#include "internal/macro.h"
+#include "internal/memory.h"
+#include "internal/print.h"
+#include "internal/string.h"
+
+#include "inflate.h"
+
+char progname[] = "test/png";
+
+/*
+ * PNG images saved by make png, as <rsc>-<tree>.png, are decoded and
+ * compared with trees drawn as RGBA16 surfaces, of which PNG samples are
+ * the 8-bit equivalents.
+ */
+struct png_decoded {
+	const char *path;
+	uint32_t width;
+	uint32_t height;
+	int depth;
+	int color_type;
+	int palette_count;
+	uint8_t palette[256][4];
+	struct inflate z;
+};
+
+static uint32_t png_be32(const uint8_t *b)
+{
+	return ((uint32_t)b[0] << 24) | (b[1] << 16) | (b[2] << 8) | b[3];
+}
+
+/* CRC-32 one bit at a time, as given by the PNG specification. */
+static uint32_t png_crc(const uint8_t *b, const size_t n)
+{
+	uint32_t crc = ~0u;
+
+	for (size_t i = 0; i < n; i++) {
+		crc ^= b[i];
+
+		for (int k = 0; k < 8; k++)
+			crc = crc & 1 ? (crc >> 1) ^ 0xedb88320 : crc >> 1;
+	}
+
+	return ~crc;
+}
+
+static void png_header(struct png_decoded *png, const uint8_t *c,
+	const uint32_t length)
+{
+	if (length != 13)
+		pr_fatal_error("%s: IHDR length %u\n", png->path, length);
+
+	png->width = png_be32(&c[0]);
+	png->height = png_be32(&c[4]);
+	png->depth = c[8];
+	png->color_type = c[9];
+
+	const bool indexed = png->color_type == 3 &&
+		(png->depth == 1 || png->depth == 2 ||
+		 png->depth == 4 || png->depth == 8);
+	const bool rgba = png->color_type == 6 && png->depth == 8;
+
+	if (!png->width || !png->height || c[10] || c[11] || c[12] ||
+	    (!indexed && !rgba))
+		pr_fatal_error("%s: IHDR unsupported\n", png->path);
+}
+
+static void png_chunks(struct png_decoded *png, const struct file *f)
+{
+	static const uint8_t signature[8] = {
+		0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'
+	};
+	const uint8_t *b = f->data;
+	uint8_t *idat = NULL;
+	size_t idat_size = 0;
+	bool end = false;
+
+	if (f->size < sizeof(signature) ||
+	    memcmp(b, signature, sizeof(signature)) != 0)
+		pr_fatal_error("%s: signature\n", png->path);
+
+	for (size_t i = sizeof(signature); !end; ) {
+		if (f->size - i < 12)
+			pr_fatal_error("%s: truncated chunk\n", png->path);
+
+		const uint32_t length = png_be32(&b[i]);
+		const uint8_t *type = &b[i + 4];
+		const uint8_t *c = &b[i + 8];
+
+		if (f->size - i - 12 < length)
+			pr_fatal_error("%s: truncated chunk\n", png->path);
+		if (png_crc(type, 4 + length) != png_be32(&c[length]))
+			pr_fatal_error("%s: %.4s CRC\n", png->path, type);
+
+		if (i == sizeof(signature) && memcmp(type, "IHDR", 4) != 0)
+			pr_fatal_error("%s: IHDR not first\n", png->path);
+
+		if (memcmp(type, "IHDR", 4) == 0)
+			png_header(png, c, length);
+		else if (memcmp(type, "PLTE", 4) == 0) {
+			if (length % 3 || length > 3 * 256)
+				pr_fatal_error("%s: PLTE length\n", png->path);
+
+			png->palette_count = length / 3;
+			for (int k = 0; k < png->palette_count; k++) {
+				memcpy(png->palette[k], &c[3 * k], 3);
+				png->palette[k][3] = 0xff;
+			}
+		} else if (memcmp(type, "tRNS", 4) == 0) {
+			if (length > png->palette_count)
+				pr_fatal_error("%s: tRNS length\n", png->path);
+
+			for (int k = 0; k < length; k++)
+				png->palette[k][3] = c[k];
+		} else if (memcmp(type, "IDAT", 4) == 0) {
+			idat = xrealloc(idat, max_t(size_t,
+				idat_size + length, 1));
+			memcpy(&idat[idat_size], c, length);
+			idat_size += length;
+		} else if (memcmp(type, "IEND", 4) == 0)
+			end = true;
+		else
+			pr_fatal_error("%s: unknown chunk %.4s\n",
+				png->path, type);
+
+		i += 12 + length;
+
+		if (end && i != f->size)
+			pr_fatal_error("%s: data after IEND\n", png->path);
+	}
+
+	if (png->color_type == 3 && !png->palette_count)
+		pr_fatal_error("%s: PLTE missing\n", png->path);
+
+	png->z = (struct inflate) {
+		.in = idat,
+		.size = idat_size
+	};
+
+	if (!inflate(&png->z))
+		pr_fatal_error("%s: IDAT fails to inflate\n", png->path);
+
+	free(idat);
+}
+
+static uint8_t png_paeth(const int a, const int b, const int c)
+{
+	const int p = a + b - c;
+	const int pa = abs(p - a);
+	const int pb = abs(p - b);
+	const int pc = abs(p - c);
+
+	return pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+}
+
+/* Rows are unfiltered in place, and the pixels returned as RGBA8. */
+static uint8_t *png_pixels(struct png_decoded *png)
+{
+	const size_t bpp = png->color_type == 6 ? 4 : 1;
+	const size_t stride = png->color_type == 6 ? 4 * png->width :
+		(png->width * png->depth + 7) / 8;
+	uint8_t *rgba = xmalloc(4 * png->width * png->height);
+
+	if (png->z.length != png->height * (1 + stride))
+		pr_fatal_error("%s: image data size\n", png->path);
+
+	for (uint32_t y = 0; y < png->height; y++) {
+		uint8_t *row = &png->z.out[y * (1 + stride)];
+		const uint8_t *prev = y ? &row[-stride] : NULL;
+		const int type = row[0];
+
+		row++;
+
+		for (size_t i = 0; i < stride; i++) {
+			const int a = i >= bpp ? row[i - bpp] : 0;
+			const int b = prev ? prev[i] : 0;
+			const int c = prev && i >= bpp ? prev[i - bpp] : 0;
+
+			switch (type) {
+			case 0: break;
+			case 1: row[i] += a; break;
+			case 2: row[i] += b; break;
+			case 3: row[i] += (a + b) / 2; break;
+			case 4: row[i] += png_paeth(a, b, c); break;
+			default:
+				pr_fatal_error("%s: filter type %d\n",
+					png->path, type);
+			}
+		}
+
+		for (uint32_t x = 0; x < png->width; x++) {
+			uint8_t *p = &rgba[4 * (y * png->width + x)];
+
+			if (png->color_type == 6) {
+				memcpy(p, &row[4 * x], 4);
+				continue;
+			}
+
+			const size_t bit = x * png->depth;
+			const int k = (row[bit / 8] >> (8 - png->depth -
+				bit % 8)) & ((1 << png->depth) - 1);
+
+			if (k >= png->palette_count)
+				pr_fatal_error("%s: palette index %d\n",
+					png->path, k);
+
+			memcpy(p, png->palette[k], 4);
+		}
+	}
+
+	return rgba;
+}
+
+static uint8_t png_sample(const uint16_t v)
+{
+	return (v * 255 + 32767) / 65535;
+}
+
+static void check_png(const char *path, aes_id_t aes_id,
+	struct aes_object_shape_iterator *iterator,
+	struct aes_surface_arena *arena)
+{
+	struct file f = file_read(path);
+	struct png_decoded png = { .path = path };
+
+	if (!file_valid(&f))
+		pr_fatal_errno(path);
+
+	png_chunks(&png, &f);
+
+	uint8_t *rgba = png_pixels(&png);
+	struct aes_surface surface = {
+		.format = AES_SURFACE_FORMAT_RGBA16,
+		.area = aes_object_shape_bounds(iterator),
+		.scale = 1
+	};
+	const struct aes_rectangle size = aes_surface_size(&surface);
+
+	if (size.w != png.width || size.h != png.height)
+		pr_fatal_error("%s: size %ux%u differs from drawing %dx%d\n",
+			path, png.width, png.height, size.w, size.h);
+
+	surface.stride = aes_surface_format_stride(surface.format, size.w);
+	surface.data = xmalloc(max_t(size_t, surface.stride * size.h, 1));
+
+	if (!aes_surface_draw(aes_id, &surface, iterator, arena))
+		pr_fatal_errno("aes_surface_draw");
+
+	for (int y = 0; y < size.h; y++)
+	for (int x = 0; x < size.w; x++) {
+		const uint16_t *s = (const uint16_t *)
+			&((const uint8_t *)surface.data)[y * surface.stride];
+		const uint8_t *p = &rgba[4 * (y * size.w + x)];
+
+		for (int k = 0; k < 4; k++)
+			if (p[k] != png_sample(s[4 * x + k]))
+				pr_fatal_error("%s: pixel %d,%d differs "
+					"from drawing\n", path, x, y);
+	}
+
+	free(surface.data);
+	free(rgba);
+	free(png.z.out);
+	file_free(&f);
+}
+
+static void check_rsc(const char *path)
+{
+	struct file f = file_read(path);
+	struct aes aes_ = { };
+	struct aes_surface_arena arena = { };
+
+	if (!file_valid(&f))
+		pr_fatal_errno(path);
+
+	const struct rsc rsc = {
+		.size = f.size,
+		.header = (struct rsc_header *)f.data
+	};
+	const aes_id_t aes_id = aes_appl_init(&aes_);
+	const size_t length = strlen(path) -
+		(strsuffix(".rsc", path) ? 4 : 0);
+
+	if (!aes_id_valid(aes_id))
+		pr_fatal_error("%s: Failed to open AES\n", path);
+
+	if (!rsc_valid_structure(&rsc))
+		pr_fatal_error("%s: malformed RSC structure\n", path);
+
+	for (int i = 0; i < rsc.header->rsh_ntree; i++) {
+		struct aes_rsc_object_shape_iterator_arg iterator_arg;
+		struct aes_object_shape_iterator iterator =
+			aes_rsc_object_shape_iterator(aes_id,
+				rsc_tree_at_index(i, &rsc), &rsc,
+				&iterator_arg);
+		struct strbuf sb = { };
+
+		if (!sbprintf(&sb, "%.*s-%02d.png", (int)length, path, i))
+			pr_fatal_errno("sbprintf");
+
+		check_png(sb.s, aes_id, &iterator, &arena);
+
+		free(sb.s);
+	}
+
+	aes_surface_arena_free(&arena);
+	aes_appl_exit(aes_id);
+	file_free(&f);
+}
+
+int main(int argc, char *argv[])
+{
+	for (int i = 1; i < argc; i++)
+		check_rsc(argv[i]);
+
+	return EXIT_SUCCESS;
+}
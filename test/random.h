@@ -0,0 +1,26 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Copyright (C) 2022 Fredrik Noring
+ */
+
+#ifndef TEST_RANDOM_H
+#define TEST_RANDOM_H
+
+#include <stdint.h>
+
+/*
+ * Xorshift pseudorandom numbers, with a fixed seed such that tests are
+ * reproducible. Each test program has its own state.
+ */
+static uint32_t random_state = 1;
+
+static inline uint32_t random_next(void)
+{
+	random_state ^= random_state << 13;
+	random_state ^= random_state >> 17;
+	random_state ^= random_state << 5;
+
+	return random_state;
+}
+
+#endif /* TEST_RANDOM_H */
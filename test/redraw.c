@@ -0,0 +1,435 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Copyright (C) 2022 Fredrik Noring
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <gem/aes.h>
+#include <gem/aes-area.h>
+#include <gem/aes-layer.h>
+#include <gem/aes-pixel.h>
+#include <gem/aes-rsc.h>
+#include <gem/aes-shape.h>
+#include <gem/aes-simple.h>
+#include <gem/aes-surface.h>
+#include <gem/aes-text.h>
+#include <gem/rsc.h>
+
+#include "internal/file.h"
+#include "internal/macro.h"
+#include "internal/memory.h"
+#include "internal/print.h"
+
+#include "random.h"
+
+char progname[] = "test/redraw";
+
+static const enum aes_surface_format formats[] = {
+#define REDRAW_FORMAT(symbol_, label_, bpp_, layout_)			\
+	AES_SURFACE_FORMAT_ ## symbol_,
+AES_SURFACE_FORMAT(REDRAW_FORMAT)
+};
+
+struct redraw {
+	const char *path;
+	aes_id_t aes_id;
+	const struct rsc *rsc;
+	struct rsc_object *tree;
+	size_t i;
+	struct aes_object_shape_iterator iterator;
+	struct aes_rsc_object_shape_iterator_arg iterator_arg;
+	struct aes_surface_arena arena;
+};
+
+struct redraw_surface {
+	struct aes_surface surface;
+	size_t size;
+};
+
+static struct redraw_surface redraw_surface(struct redraw *redraw,
+	const enum aes_surface_format format, const int scale)
+{
+	struct redraw_surface rs = {
+		.surface = {
+			.format = format,
+			.area = aes_object_shape_bounds(&redraw->iterator),
+			.scale = scale
+		}
+	};
+	const struct aes_rectangle size = aes_surface_size(&rs.surface);
+
+	rs.surface.stride = aes_surface_format_stride(format, size.w);
+	rs.size = max_t(size_t, rs.surface.stride * size.h, 1);
+	rs.surface.data = xmalloc(rs.size);
+
+	/* Bits beyond the width of rows must be kept as they are. */
+	memset(rs.surface.data, 0xa5, rs.size);
+
+	return rs;
+}
+
+static void redraw_full(struct redraw *redraw, struct redraw_surface *rs)
+{
+	memset(rs->surface.data, 0xa5, rs->size);
+
+	if (!aes_surface_draw(redraw->aes_id, &rs->surface,
+			&redraw->iterator, &redraw->arena))
+		pr_fatal_errno("aes_surface_draw");
+}
+
+static void redraw_compare(const struct redraw *redraw,
+	const struct redraw_surface *a, const struct redraw_surface *b,
+	const int16_t ob, const char *op)
+{
+	if (memcmp(a->surface.data, b->surface.data, a->size) != 0)
+		pr_fatal_error("%s: tree %zu object %d format %d scale %d: "
+			"%s differs from full redraw\n", redraw->path,
+			redraw->i, ob, a->surface.format, a->surface.scale, op);
+}
+
+static bool redraw_single_row(const struct aes_area clip,
+	const struct aes_object_shape_layer *layers, void *arg)
+{
+	const struct aes_region *region = arg;
+
+	if (clip.r.h != 1 ||
+	    !aes_point_within_region(clip.p, region) ||
+	    !aes_point_within_region((struct aes_point) {
+			.x = clip.p.x + clip.r.w - 1,
+			.y = clip.p.y
+		}, region))
+		pr_fatal_error("region layer clip is not a row of the region\n");
+
+	return true;
+}
+
+struct layer_pixels {
+	aes_id_t aes_id;
+	struct aes_area clip;
+	int *index;
+};
+
+static bool redraw_layer_pixels(const struct aes_area clip,
+	const struct aes_object_shape_layer *layers, void *arg)
+{
+	struct layer_pixels *lp = arg;
+
+	for (int x = 0; x < clip.r.w; x++) {
+		const struct aes_point p = {
+			.x = clip.p.x + x,
+			.y = clip.p.y
+		};
+		const int index = aes_object_shape_pixel(lp->aes_id, p,
+			&layers->shape);
+
+		if (clip.r.h != 1 || !aes_point_within_area(p, lp->clip))
+			pr_fatal_error("layer clip is not within the row\n");
+
+		if (index >= 0)
+			lp->index[p.x - lp->clip.p.x] = index;
+	}
+
+	return true;
+}
+
+/*
+ * Layers are compared with a reference of every pixel, given by the
+ * topmost shape that is not transparent at it, such that the occlusion
+ * early-out and the subdivision of clips must leave drawings unchanged.
+ */
+static void redraw_layers(struct redraw *redraw)
+{
+	const struct aes_area bounds =
+		aes_object_shape_bounds(&redraw->iterator);
+	struct aes_object_simple_shape_iterator_arg simple_arg;
+	struct aes_object_shape_iterator simple_iterator =
+		aes_object_simple_shape_iterator(&redraw->iterator,
+			&simple_arg);
+	struct aes_object_shape shape;
+	struct aes_object_shape *shapes = NULL;
+	size_t n = 0;
+
+	aes_for_each_object_shape (&shape, &simple_iterator) {
+		shapes = xrealloc(shapes, sizeof(*shapes) * (n + 1));
+		shapes[n++] = shape;
+	}
+
+	size_t *overlap = xmalloc(sizeof(size_t) * max_t(size_t, n, 1));
+	struct layer_pixels lp = {
+		.aes_id = redraw->aes_id,
+		.index = xmalloc(sizeof(int) * max(bounds.r.w, 1))
+	};
+
+	for (int y = 0; y < bounds.r.h; y++) {
+		size_t m = 0;
+
+		lp.clip = (struct aes_area) {
+			.p = {
+				.x = bounds.p.x,
+				.y = bounds.p.y + y
+			},
+			.r = {
+				.w = bounds.r.w,
+				.h = 1
+			}
+		};
+
+		for (size_t i = 0; i < n; i++)
+			if (aes_area_overlap(shapes[i].area, lp.clip))
+				overlap[m++] = i;
+
+		for (int x = 0; x < bounds.r.w; x++)
+			lp.index[x] = -1;
+
+		/* Rows are split into clips of 1 to 512 pixels. */
+		for (int x = 0; x < bounds.r.w; x += 1 << (y % 10))
+			if (!aes_object_shape_layers_arena((struct aes_area) {
+					.p = {
+						.x = lp.clip.p.x + x,
+						.y = lp.clip.p.y
+					},
+					.r = {
+						.w = min(1 << (y % 10),
+							bounds.r.w - x),
+						.h = 1
+					}
+				}, &redraw->iterator, redraw_layer_pixels, &lp,
+				&redraw->arena.layer))
+				pr_fatal_errno("aes_object_shape_layers_arena");
+
+		for (int x = 0; x < bounds.r.w; x++) {
+			const struct aes_point p = {
+				.x = lp.clip.p.x + x,
+				.y = lp.clip.p.y
+			};
+			int index = -1;
+
+			for (size_t k = m; k > 0 && index < 0; k--)
+				if (aes_point_within_area(p,
+						shapes[overlap[k - 1]].area))
+					index = aes_object_shape_pixel(
+						redraw->aes_id, p,
+						&shapes[overlap[k - 1]]);
+
+			if (lp.index[x] != index)
+				pr_fatal_error("%s: tree %zu at %d,%d: "
+					"layers differ from reference\n",
+					redraw->path, redraw->i, p.x, p.y);
+		}
+	}
+
+	free(lp.index);
+	free(overlap);
+	free(shapes);
+}
+
+/*
+ * Toggles the selected state of an object, and compares the surface
+ * redrawn in the damage region with a full redraw.
+ */
+static void redraw_damage(struct redraw *redraw, const int16_t ob,
+	const struct redraw_surface *drawn, struct redraw_surface *damaged,
+	struct redraw_surface *full)
+{
+	struct rsc_object *ro = &redraw->tree[ob];
+	struct aes_region damage = { };
+
+	memcpy(damaged->surface.data, drawn->surface.data, drawn->size);
+
+	if (!aes_rsc_object_damage(redraw->aes_id, &damage,
+			ob, redraw->tree, redraw->rsc))
+		pr_fatal_errno("aes_rsc_object_damage");
+	ro->shape.state.selected = !ro->shape.state.selected;
+	if (!aes_rsc_object_damage(redraw->aes_id, &damage,
+			ob, redraw->tree, redraw->rsc))
+		pr_fatal_errno("aes_rsc_object_damage");
+
+	if (!aes_surface_draw_region(redraw->aes_id, &damaged->surface,
+			&damage, &redraw->iterator, &redraw->arena))
+		pr_fatal_errno("aes_surface_draw_region");
+
+	if (!aes_object_shape_layers_region(&damage, &redraw->iterator,
+			redraw_single_row, &damage, &redraw->arena.layer))
+		pr_fatal_errno("aes_object_shape_layers_region");
+
+	redraw_full(redraw, full);
+	redraw_compare(redraw, damaged, full, ob, "damage");
+
+	ro->shape.state.selected = !ro->shape.state.selected;
+	aes_region_free(&damage);
+}
+
+/*
+ * Toggles the selected state of an object by inverting it in place, if
+ * possible, and compares the surface with a full redraw.
+ */
+static void redraw_toggle(struct redraw *redraw, const int16_t ob,
+	const struct redraw_surface *drawn, struct redraw_surface *toggled,
+	struct redraw_surface *full)
+{
+	struct rsc_object *ro = &redraw->tree[ob];
+
+	memcpy(toggled->surface.data, drawn->surface.data, drawn->size);
+
+	if (!aes_rsc_object_toggle_selected(redraw->aes_id,
+			&toggled->surface, ob, redraw->tree, redraw->rsc))
+		return;		/* The object must be redrawn instead */
+
+	redraw_full(redraw, full);
+	redraw_compare(redraw, toggled, full, ob, "toggle");
+
+	ro->shape.state.selected = !ro->shape.state.selected;
+}
+
+static void redraw_tree(struct redraw *redraw)
+{
+	redraw->iterator = aes_rsc_object_shape_iterator(redraw->aes_id,
+		redraw->tree, redraw->rsc, &redraw->iterator_arg);
+
+	redraw_layers(redraw);
+
+	for (size_t f = 0; f < ARRAY_SIZE(formats); f++) {
+		const int scale = 1 + (redraw->i + f) % 3;
+		struct redraw_surface drawn =
+			redraw_surface(redraw, formats[f], scale);
+		struct redraw_surface damaged =
+			redraw_surface(redraw, formats[f], scale);
+		struct redraw_surface full =
+			redraw_surface(redraw, formats[f], scale);
+		int16_t ob = 0;
+
+		redraw_full(redraw, &drawn);
+
+		/* Objects take turns with the formats to keep the test fast. */
+		for (size_t k = 0; rsc_valid_ob(ob);
+		     k++, ob = rsc_tree_traverse(ob, redraw->tree))
+			if ((k + redraw->i) % ARRAY_SIZE(formats) == f) {
+				redraw_damage(redraw, ob,
+					&drawn, &damaged, &full);
+				redraw_toggle(redraw, ob,
+					&drawn, &damaged, &full);
+			}
+
+		free(full.surface.data);
+		free(damaged.surface.data);
+		free(drawn.surface.data);
+	}
+}
+
+static void redraw_rsc(const char *path)
+{
+	struct file f = file_read(path);
+	struct aes aes_ = { };
+
+	if (!file_valid(&f))
+		pr_fatal_errno(path);
+
+	const struct rsc rsc = {
+		.size = f.size,
+		.header = (struct rsc_header *)f.data
+	};
+	struct redraw redraw = {
+		.path = path,
+		.aes_id = aes_appl_init(&aes_),
+		.rsc = &rsc
+	};
+
+	if (!aes_id_valid(redraw.aes_id))
+		pr_fatal_error("%s: Failed to open AES\n", path);
+
+	if (!rsc_valid_structure(&rsc))
+		pr_fatal_error("%s: malformed RSC structure\n", path);
+
+	for (redraw.i = 0; redraw.i < rsc.header->rsh_ntree; redraw.i++) {
+		redraw.tree = rsc_tree_at_index(redraw.i, &rsc);
+
+		redraw_tree(&redraw);
+	}
+
+	aes_surface_arena_free(&redraw.arena);
+	aes_appl_exit(redraw.aes_id);
+	file_free(&f);
+}
+
+/*
+ * Strings edited in place between drawings, and more strings than the
+ * layout cache has room for, must give the same pixels as an AES with an
+ * empty layout cache.
+ */
+#define REDRAW_TEXTS 300
+#define REDRAW_TEXT_LENGTH 24
+
+static void redraw_text_compare(aes_id_t aes_id, aes_id_t reference,
+	const struct aes_object_shape *shape)
+{
+	aes_text_cache_free(reference);
+
+	for (int y = 0; y < shape->area.r.h; y++)
+	for (int x = 0; x < shape->area.r.w; x++) {
+		const struct aes_point p = {
+			.x = shape->area.p.x + x,
+			.y = shape->area.p.y + y
+		};
+
+		if (aes_object_shape_pixel(aes_id, p, shape) !=
+		    aes_object_shape_pixel(reference, p, shape))
+			pr_fatal_error("text \"%s\" at %d,%d differs "
+				"from reference\n", shape->spec.string, x, y);
+	}
+}
+
+static void redraw_text_edit(char *s)
+{
+	const size_t length = random_next() % REDRAW_TEXT_LENGTH;
+
+	for (size_t i = 0; i < length; i++)
+		s[i] = 0x20 + random_next() % 0x5f;
+	s[length] = '\0';
+}
+
+static void redraw_text(void)
+{
+	static char s[REDRAW_TEXTS][REDRAW_TEXT_LENGTH];
+	struct aes aes_ = { };
+	struct aes reference_ = { };
+	const aes_id_t aes_id = aes_appl_init(&aes_);
+	const aes_id_t reference = aes_appl_init(&reference_);
+
+	if (!aes_id_valid(aes_id) || !aes_id_valid(reference))
+		pr_fatal_error("Failed to open AES\n");
+
+	for (int round = 0; round < 3; round++) {
+		for (size_t i = 0; i < REDRAW_TEXTS; i++)
+			if (!round || random_next() % 2)
+				redraw_text_edit(s[i]);
+
+		for (size_t i = 0; i < REDRAW_TEXTS; i++) {
+			const struct aes_object_shape shape = {
+				.type.g = i % 2 ? GEM_G_BUTTON : GEM_G_STRING,
+				.spec.string = s[i],
+				.area.r = {
+					.w = 8 * REDRAW_TEXT_LENGTH,
+					.h = 16
+				}
+			};
+
+			redraw_text_compare(aes_id, reference, &shape);
+		}
+	}
+
+	aes_appl_exit(reference);
+	aes_appl_exit(aes_id);
+}
+
+int main(int argc, char *argv[])
+{
+	redraw_text();
+
+	for (int i = 1; i < argc; i++)
+		redraw_rsc(argv[i]);
+
+	return EXIT_SUCCESS;
+}
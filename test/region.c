@@ -0,0 +1,287 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Copyright (C) 2022 Fredrik Noring
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <gem/aes-area.h>
+#include <gem/aes-region.h>
+
+#include "internal/print.h"
+
+#include "random.h"
+
+char progname[] = "test/region";
+
+/*
+ * Regions are compared against a bitmap model of a small grid, where the
+ * random areas may extend beyond the grid on all sides.
+ */
+#define GRID_SIZE 24
+#define GRID_MARGIN 4
+
+struct grid {
+	bool b[GRID_SIZE][GRID_SIZE];
+};
+
+static int random_range(const int lo, const int hi)
+{
+	return lo + (int)(random_next() % (uint32_t)(hi - lo + 1));
+}
+
+static struct aes_area random_area(void)
+{
+	const int lo = -GRID_MARGIN;
+	const int hi = GRID_SIZE + GRID_MARGIN;
+	const int x = random_range(lo, hi);
+	const int y = random_range(lo, hi);
+
+	return (struct aes_area) {
+		.p = { .x = x, .y = y },
+		.r = {
+			.w = random_next() % 8 ? random_range(1, GRID_SIZE) : 0,
+			.h = random_next() % 8 ? random_range(1, GRID_SIZE) : 0
+		}
+	};
+}
+
+static void grid_area(struct grid *grid, const struct aes_area area,
+	const bool set)
+{
+	for (int y = 0; y < GRID_SIZE; y++)
+	for (int x = 0; x < GRID_SIZE; x++)
+		if (aes_point_within_area((struct aes_point) { .x = x, .y = y },
+				area))
+			grid->b[y][x] = set;
+}
+
+static struct grid grid_from_region(const struct aes_region *region)
+{
+	struct grid grid = { };
+	struct aes_area area;
+
+	aes_for_each_region_area (&area, region)
+		grid_area(&grid, area, true);
+
+	return grid;
+}
+
+static bool grid_equal(const struct grid *a, const struct grid *b)
+{
+	return memcmp(a, b, sizeof(*a)) == 0;
+}
+
+static int area_bottom(const struct aes_area area)
+{
+	return area.p.y + area.r.h;
+}
+
+static bool band_equal_spans(const struct aes_region *region,
+	size_t a, const size_t a_end, size_t b, const size_t b_end)
+{
+	if (a_end - a != b_end - b)
+		return false;
+
+	for (; a < a_end; a++, b++)
+		if (region->areas[a].p.x != region->areas[b].p.x ||
+		    region->areas[a].r.w != region->areas[b].r.w)
+			return false;
+
+	return true;
+}
+
+static size_t band_end(const struct aes_region *region, size_t i)
+{
+	const int y = region->areas[i].p.y;
+
+	while (i < region->count && region->areas[i].p.y == y)
+		i++;
+
+	return i;
+}
+
+/* Verify the band representation documented for struct aes_region. */
+static void check_region_bands(const struct aes_region *region,
+	const char *op)
+{
+	for (size_t i = 0; i < region->count; i++) {
+		const struct aes_area a = region->areas[i];
+
+		if (aes_area_degenerate(a))
+			pr_fatal_error("%s: degenerate area %zu\n", op, i);
+
+		if (i + 1 == region->count)
+			continue;
+
+		const struct aes_area b = region->areas[i + 1];
+
+		if (a.p.y == b.p.y) {
+			if (a.r.h != b.r.h)
+				pr_fatal_error("%s: band height mismatch %zu\n",
+					op, i);
+			if (a.p.x + a.r.w >= b.p.x)
+				pr_fatal_error("%s: band areas touch %zu\n",
+					op, i);
+		} else if (area_bottom(a) > b.p.y)
+			pr_fatal_error("%s: bands overlap %zu\n", op, i);
+	}
+
+	for (size_t i = 0; i < region->count; ) {
+		const size_t j = band_end(region, i);
+
+		if (j < region->count &&
+		    area_bottom(region->areas[i]) == region->areas[j].p.y &&
+		    band_equal_spans(region, i, j, j, band_end(region, j)))
+			pr_fatal_error("%s: bands not coalesced %zu\n", op, i);
+
+		i = j;
+	}
+}
+
+static void check_region(const struct aes_region *region,
+	const struct grid *model, const char *op)
+{
+	const struct grid grid = grid_from_region(region);
+
+	check_region_bands(region, op);
+
+	if (!grid_equal(&grid, model))
+		pr_fatal_error("%s: region differs from bitmap model\n", op);
+
+	for (int y = 0; y < GRID_SIZE; y++)
+	for (int x = 0; x < GRID_SIZE; x++)
+		if (aes_point_within_region((struct aes_point) {
+				.x = x, .y = y }, region) != model->b[y][x])
+			pr_fatal_error("%s: point within region %d %d\n",
+				op, x, y);
+}
+
+static void random_region(struct aes_region *region, struct grid *model)
+{
+	const int n = random_range(0, 6);
+
+	if (!aes_region_from_area(region, random_area()))
+		pr_fatal_errno("aes_region_from_area");
+	*model = grid_from_region(region);
+
+	for (int i = 0; i < n; i++) {
+		const struct aes_area area = random_area();
+		const bool add = random_next() % 3;
+
+		if (!(add ? aes_region_union_area(region, area) :
+			    aes_region_subtract_area(region, area)))
+			pr_fatal_errno("aes_region_area");
+
+		grid_area(model, area, add);
+		check_region(region, model, add ? "union area" :
+			"subtract area");
+	}
+}
+
+static void check_bounds(const struct aes_region *region, const char *op)
+{
+	const struct aes_area bounds = aes_region_bounds(region);
+	struct aes_area area;
+
+	if (aes_region_empty(region)) {
+		if (!aes_area_degenerate(bounds))
+			pr_fatal_error("%s: bounds of empty region\n", op);
+		return;
+	}
+
+	aes_for_each_region_area (&area, region)
+		if (!aes_area_within_area(area, bounds))
+			pr_fatal_error("%s: area outside of bounds\n", op);
+}
+
+static void check_ops(void)
+{
+	struct aes_region a = { };
+	struct aes_region b = { };
+	struct aes_region r = { };
+	struct grid ma, mb, m;
+
+	random_region(&a, &ma);
+	random_region(&b, &mb);
+
+	if (!aes_region_union(&r, &a, &b))
+		pr_fatal_errno("aes_region_union");
+	for (int y = 0; y < GRID_SIZE; y++)
+	for (int x = 0; x < GRID_SIZE; x++)
+		m.b[y][x] = ma.b[y][x] || mb.b[y][x];
+	check_region(&r, &m, "union");
+	check_bounds(&r, "union");
+
+	if (!aes_region_intersection(&r, &a, &b))
+		pr_fatal_errno("aes_region_intersection");
+	for (int y = 0; y < GRID_SIZE; y++)
+	for (int x = 0; x < GRID_SIZE; x++)
+		m.b[y][x] = ma.b[y][x] && mb.b[y][x];
+	check_region(&r, &m, "intersection");
+	check_bounds(&r, "intersection");
+
+	if (!aes_region_subtract(&r, &a, &b))
+		pr_fatal_errno("aes_region_subtract");
+	for (int y = 0; y < GRID_SIZE; y++)
+	for (int x = 0; x < GRID_SIZE; x++)
+		m.b[y][x] = ma.b[y][x] && !mb.b[y][x];
+	check_region(&r, &m, "subtract");
+	check_bounds(&r, "subtract");
+
+	/* The result may be the same as one of the operands. */
+	if (!aes_region_copy(&r, &a))
+		pr_fatal_errno("aes_region_copy");
+	check_region(&r, &ma, "copy");
+	if (!aes_region_subtract(&r, &r, &b))
+		pr_fatal_errno("aes_region_subtract");
+	for (int y = 0; y < GRID_SIZE; y++)
+	for (int x = 0; x < GRID_SIZE; x++)
+		m.b[y][x] = ma.b[y][x] && !mb.b[y][x];
+	check_region(&r, &m, "subtract alias");
+
+	if (!aes_region_union(&b, &r, &b))
+		pr_fatal_errno("aes_region_union");
+	for (int y = 0; y < GRID_SIZE; y++)
+	for (int x = 0; x < GRID_SIZE; x++)
+		m.b[y][x] = m.b[y][x] || mb.b[y][x];
+	check_region(&b, &m, "union alias");
+
+	aes_region_free(&a);
+	aes_region_free(&b);
+	aes_region_free(&r);
+}
+
+static void check_empty(void)
+{
+	const struct grid empty = { };
+	struct aes_region a = { };
+	struct aes_region r = { };
+
+	if (!aes_region_copy(&r, &a))
+		pr_fatal_errno("aes_region_copy");
+	check_region(&r, &empty, "copy empty");
+
+	if (!aes_region_from_area(&r, (struct aes_area) {
+			.p = { .x = 1, .y = 1 }, .r = { .w = 0, .h = 5 } }))
+		pr_fatal_errno("aes_region_from_area");
+	check_region(&r, &empty, "degenerate area");
+
+	if (!aes_region_union(&r, &a, &a))
+		pr_fatal_errno("aes_region_union");
+	check_region(&r, &empty, "union empty");
+
+	aes_region_free(&r);
+}
+
+int main(int argc, char *argv[])
+{
+	check_empty();
+
+	for (int i = 0; i < 4000; i++)
+		check_ops();
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,218 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Copyright (C) 2022 Fredrik Noring
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "internal/memory.h"
+#include "internal/print.h"
+#include "internal/string.h"
+
+#include "unicode/atari.h"
+#include "unicode/utf8.h"
+
+#include "random.h"
+
+char progname[] = "test/unicode";
+
+static void sbappend(struct strbuf *sb, const void *s, size_t length)
+{
+	if (!sbreserve(sb, length))
+		pr_fatal_errno("sbreserve");
+
+	memcpy(&sb->s[sb->length], s, length);
+	sb->length += length;
+	sb->s[sb->length] = '\0';
+}
+
+/* Reference conversion of one character at a time. */
+static struct strbuf reference_to_utf8(const uint8_t *s, size_t length)
+{
+	struct strbuf sb = { };
+
+	sbappend(&sb, "", 0);
+
+	for (size_t i = 0; i < length && s[i]; i++) {
+		uint8_t u[4];
+		const int r = utf32_to_utf8(
+			charset_atari_st_to_utf32(s[i], NULL), u, sizeof(u));
+
+		if (r <= 0)
+			pr_fatal_error("utf32_to_utf8 of character %u\n", s[i]);
+
+		sbappend(&sb, u, r);
+	}
+
+	return sb;
+}
+
+/* Reference conversion of one code point at a time. */
+static struct strbuf reference_to_atari_st(const uint8_t *u, size_t length)
+{
+	struct strbuf sb = { };
+	size_t i = 0;
+
+	sbappend(&sb, "", 0);
+
+	while (i < length && u[i]) {
+		unicode_t c = 0;
+
+		const int r = utf8_to_utf32(&c, &u[i], length - i);
+
+		if (r == -1) {
+			i++;
+			continue;
+		}
+
+		const uint8_t k = utf32_to_charset_atari_st(c, NULL);
+
+		sbappend(&sb, &k, 1);
+		i += r;
+	}
+
+	return sb;
+}
+
+/*
+ * Random strings mix long runs of printable ASCII, to take the block
+ * paths, with control codes, Atari ST characters in UTF-8, code points
+ * not in the charset, invalid UTF-8 and NUL.
+ */
+static struct strbuf random_string(void)
+{
+	const int n = random_next() % 24;
+	struct strbuf sb = { };
+
+	sbappend(&sb, "", 0);
+
+	for (int i = 0; i < n; i++) {
+		const uint32_t r = random_next();
+		uint8_t u[4];
+
+		switch (r % 8) {
+		case 0:
+		case 1:
+		case 2:
+			for (int k = (r >> 8) % 40; k > 0; k--) {
+				const uint8_t c = 0x20 + random_next() % 0x5f;
+
+				sbappend(&sb, &c, 1);
+			}
+			break;
+		case 3:
+			u[0] = (r >> 8) % 0x20;
+			sbappend(&sb, u, 1);
+			break;
+		case 4:
+			sbappend(&sb, u, utf32_to_utf8(charset_atari_st_to_utf32(
+				(r >> 8) & 0xff, NULL), u, sizeof(u)));
+			break;
+		case 5:
+			/* Code points below the surrogates. */
+			sbappend(&sb, u, utf32_to_utf8(
+				(r >> 8) % 0xd800, u, sizeof(u)));
+			break;
+		default:
+			u[0] = r >> 8;
+			sbappend(&sb, u, 1);
+		}
+	}
+
+	return sb;
+}
+
+static void check_equal(const struct strbuf *expected, const uint8_t *s,
+	const char *op)
+{
+	if (!s)
+		pr_fatal_errno(op);
+
+	if (strcmp(expected->s, (const char *)s) != 0)
+		pr_fatal_error("%s differs from reference\n", op);
+}
+
+static void check_string(const uint8_t *s, size_t length, size_t n)
+{
+	struct strbuf u = reference_to_utf8(s, length);
+	struct strbuf a = reference_to_atari_st(s, length);
+	uint8_t *cu = charset_atari_st_to_utf8_string(s, n);
+	uint8_t *ca = utf8_to_charset_atari_st_string(s, n);
+
+	check_equal(&u, cu, "charset_atari_st_to_utf8_string");
+	check_equal(&a, ca, "utf8_to_charset_atari_st_string");
+
+	if (charset_to_utf8_string_length(s, n,
+			charset_atari_st_to_utf32, NULL) != u.length)
+		pr_fatal_error("charset_to_utf8_string_length differs\n");
+	if (utf8_to_charset_string_length(s, n) != a.length)
+		pr_fatal_error("utf8_to_charset_string_length differs\n");
+
+	free(ca);
+	free(cu);
+	free(a.s);
+	free(u.s);
+}
+
+/*
+ * Strings are copied to buffers of exactly their length, without a NUL,
+ * and to NUL terminated buffers given a greater maximum length, so that
+ * reads beyond either are caught by sanitizers.
+ */
+static void check_equivalence(void)
+{
+	struct strbuf sb = random_string();
+	const size_t length = random_next() % (sb.length + 1);
+	uint8_t *s = xmemdup(sb.s, length + 1);
+
+	s[length] = '\0';
+	check_string(s, length, SIZE_MAX);
+	free(s);
+
+	s = xmemdup(sb.s, length);
+	check_string(s, length, length);
+	free(s);
+
+	free(sb.s);
+}
+
+/* All characters, except NUL, convert to UTF-8 and back unchanged. */
+static void check_round_trip(void)
+{
+	uint8_t s[256];
+
+	for (int c = 1; c < 256; c++)
+		s[c - 1] = c;
+	s[255] = '\0';
+
+	uint8_t *u = charset_atari_st_to_utf8_string(s, sizeof(s));
+
+	if (!u)
+		pr_fatal_errno("charset_atari_st_to_utf8_string");
+
+	if (!utf8_valid_in_atari_st(u, strlen((const char *)u)))
+		pr_fatal_error("UTF-8 of Atari ST charset is not valid in it\n");
+
+	uint8_t *r = utf8_to_charset_atari_st_string(u, SIZE_MAX);
+
+	if (!r)
+		pr_fatal_errno("utf8_to_charset_atari_st_string");
+
+	if (strcmp((const char *)s, (const char *)r) != 0)
+		pr_fatal_error("Atari ST charset round trip differs\n");
+
+	free(r);
+	free(u);
+}
+
+int main(int argc, char *argv[])
+{
+	check_round_trip();
+
+	for (int i = 0; i < 20000; i++)
+		check_equivalence();
+
+	return EXIT_SUCCESS;
+}
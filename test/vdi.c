@@ -0,0 +1,333 @@
+// SPDX-License-Identifier: GPL-2.0
+/*
+ * Copyright (C) 2022 Fredrik Noring
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <gem/fnt.h>
+#include <gem/vdi.h>
+
+#include "internal/file.h"
+#include "internal/macro.h"
+#include "internal/memory.h"
+#include "internal/print.h"
+
+#include "random.h"
+
+char progname[] = "test/vdi";
+
+/*
+ * Fonts are registered in many faces and sizes, by copies of the system
+ * fonts with other face ids, point sizes and tops. Lookups and selections
+ * are compared with a linear search of the fonts in registration order.
+ */
+#define VDI_FACES 40
+#define VDI_FONTS 400
+
+struct key {
+	uint16_t id;
+	uint16_t point;
+	uint16_t top;
+	uint16_t height;
+};
+
+static struct key fnt_key(const struct fnt *fnt)
+{
+	return (struct key) {
+		.id = fnt->header->id,
+		.point = fnt->header->point,
+		.top = fnt->header->top,
+		.height = fnt->header->bitmap_lines
+	};
+}
+
+static bool key_equal(const struct key a, const struct key b)
+{
+	return a.id == b.id && a.point == b.point &&
+	       a.top == b.top && a.height == b.height;
+}
+
+static const struct key system_keys[] = {
+	{ .id = VDI_SYSTEM_FONT, .point =  8, .top =  4, .height =  6 },
+	{ .id = VDI_SYSTEM_FONT, .point =  9, .top =  6, .height =  8 },
+	{ .id = VDI_SYSTEM_FONT, .point = 10, .top = 13, .height = 16 },
+};
+
+/* The most recently registered font of the face id, point and height. */
+static const struct key *reference_lookup(const struct key *keys,
+	const size_t count, const uint16_t id, const uint16_t point,
+	const uint16_t height)
+{
+	const struct key *found = NULL;
+
+	for (size_t i = 0; i < count; i++)
+		if (keys[i].id == id && keys[i].point == point &&
+		    keys[i].height == height)
+			found = &keys[i];
+
+	return found;
+}
+
+/*
+ * The largest top of the face at most the height, or otherwise the
+ * smallest top, where the most recently registered font is preferred.
+ */
+static const struct key *reference_select(const struct key *keys,
+	const size_t count, const uint16_t id, const int height)
+{
+	const struct key *best = NULL;
+
+	for (size_t i = 0; i < count; i++) {
+		if (keys[i].id != id)
+			continue;
+
+		if (!best)
+			best = &keys[i];
+		else if (keys[i].top <= height ?
+				best->top > height || best->top <= keys[i].top :
+				best->top > height && best->top >= keys[i].top)
+			best = &keys[i];
+	}
+
+	return best;
+}
+
+static void check_system_fonts(vdi_id_t vdi_id)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(system_keys); i++) {
+		const struct key k = system_keys[i];
+		const struct fnt *fnt = vdi_fnt_lookup(vdi_id,
+			k.id, k.point, k.height);
+
+		if (!fnt || !key_equal(fnt_key(fnt), k))
+			pr_fatal_error("system font %zu lookup\n", i);
+	}
+
+	if (vdi_fnt_lookup(vdi_id, VDI_SYSTEM_FONT, 8, 8))
+		pr_fatal_error("lookup of font not loaded\n");
+
+	if (vst_font(vdi_id, VDI_FACES + 1) != VDI_SYSTEM_FONT)
+		pr_fatal_error("face not loaded selected\n");
+}
+
+static void register_fonts(vdi_id_t vdi_id, struct key *keys)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(system_keys); i++)
+		keys[i] = system_keys[i];
+
+	for (size_t i = ARRAY_SIZE(system_keys); i < VDI_FONTS; i++) {
+		const struct key s = system_keys[
+			random_next() % ARRAY_SIZE(system_keys)];
+		const struct fnt *system = vdi_fnt_lookup(vdi_id,
+			s.id, s.point, s.height);
+
+		if (!system)
+			pr_fatal_error("system font lookup\n");
+
+		struct fnt_header *header = xmemdup(system->header,
+			system->size);
+		const struct fnt fnt = {
+			.size = system->size,
+			.header = header
+		};
+
+		header->id = 2 + random_next() % (VDI_FACES - 1);
+		header->point = 8 + random_next() % 4;
+		header->top = 1 + random_next() % header->bitmap_lines;
+		keys[i] = fnt_key(&fnt);
+
+		if (!vdi_v_fontinit(vdi_id, &fnt))
+			pr_fatal_errno("vdi_v_fontinit");
+
+		free(header);
+	}
+}
+
+static void check_lookup(vdi_id_t vdi_id, const struct key *keys)
+{
+	for (uint16_t id = 1; id <= VDI_FACES + 1; id++)
+	for (uint16_t point = 7; point <= 12; point++)
+	for (size_t i = 0; i < ARRAY_SIZE(system_keys); i++) {
+		const uint16_t height = system_keys[i].height;
+		const struct key *r = reference_lookup(keys, VDI_FONTS,
+			id, point, height);
+		const struct fnt *fnt = vdi_fnt_lookup(vdi_id,
+			id, point, height);
+
+		if (!r != !fnt || (fnt && !key_equal(fnt_key(fnt), *r)))
+			pr_fatal_error("lookup of face %u point %u height %u\n",
+				id, point, height);
+	}
+}
+
+static void check_select(vdi_id_t vdi_id, const struct key *keys)
+{
+	for (int16_t face = 1; face <= VDI_FACES; face++)
+	for (int16_t height = 0; height <= 18; height++) {
+		const struct key *r = reference_select(keys, VDI_FONTS,
+			face, height);
+		int16_t char_width, char_height, cell_width, cell_height;
+
+		if (vst_font(vdi_id, face) != (r ? face : VDI_SYSTEM_FONT))
+			pr_fatal_error("vst_font face %d\n", face);
+		if (!r)
+			continue;
+
+		vst_height(vdi_id, height, &char_width, &char_height,
+			&cell_width, &cell_height);
+
+		const struct fnt *fnt = vdi_text_fnt(vdi_id);
+
+		if (!fnt || !key_equal(fnt_key(fnt), *r))
+			pr_fatal_error("vst_height face %d height %d\n",
+				face, height);
+
+		if (char_width != fnt->header->max_char_width ||
+		    char_height != fnt->header->top ||
+		    cell_width != fnt->header->max_cell_width ||
+		    cell_height != fnt->header->bitmap_lines)
+			pr_fatal_error("vst_height face %d height %d size\n",
+				face, height);
+	}
+}
+
+/*
+ * A GDOS font directory has two valid fonts of the same key, a font
+ * truncated after its header, a file too short for a header and a file
+ * that is not a font. Fonts are named by their files.
+ */
+#define VDI_DIR_FACE (VDI_FACES + 2)
+
+static const struct vdi_dir_file {
+	const char *name;
+	size_t system;
+	uint16_t top;
+	size_t size;
+} vdi_dir_files[] = {
+	{ "valid.fnt", 1, 6 },
+	{ "TRUNC.FNT", 2, 10, sizeof(struct fnt_header) + 64 },
+	{ "short.fnt", 0, 0, sizeof(struct fnt_header) / 2 },
+	{ "readme.txt", 0, 0 },
+	{ "other.fnt", 1, 6 },
+};
+
+static void dir_path(char *path, size_t size, const char *dir,
+	const char *name)
+{
+	if (snprintf(path, size, "%s/%s", dir, name) >= size)
+		pr_fatal_error("%s: path too long\n", dir);
+}
+
+static void write_font_dir(vdi_id_t vdi_id, const char *dir)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(vdi_dir_files); i++) {
+		const struct vdi_dir_file *f = &vdi_dir_files[i];
+		const struct key s = system_keys[f->system];
+		const struct fnt *system = vdi_fnt_lookup(vdi_id,
+			s.id, s.point, s.height);
+
+		if (!system)
+			pr_fatal_error("system font lookup\n");
+
+		struct fnt_header *header = xmemdup(system->header,
+			system->size);
+		char path[256];
+
+		header->id = VDI_DIR_FACE;
+		header->top = f->top;
+		snprintf(header->name.s, sizeof(header->name.s), "%s", f->name);
+
+		dir_path(path, sizeof(path), dir, f->name);
+		if (!file_write(path, header,
+				f->size ? f->size : system->size))
+			pr_fatal_errno(path);
+
+		free(header);
+	}
+}
+
+static void remove_font_dir(const char *dir)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(vdi_dir_files); i++) {
+		char path[256];
+
+		dir_path(path, sizeof(path), dir, vdi_dir_files[i].name);
+		if (unlink(path) == -1)
+			pr_fatal_errno(path);
+	}
+
+	if (rmdir(dir) == -1)
+		pr_fatal_errno(dir);
+}
+
+/*
+ * Fonts of the directory are indexed by their headers in byte order of
+ * their names, such that the valid font named last is found of the two
+ * with the same key. The truncated font fails to load only when it is
+ * selected, such that the valid font is selected instead.
+ */
+static void check_font_dir(vdi_id_t vdi_id)
+{
+	char dir[] = "/tmp/test-vdi-XXXXXX";
+	int16_t char_width, char_height, cell_width, cell_height;
+
+	if (!mkdtemp(dir))
+		pr_fatal_errno("mkdtemp");
+
+	write_font_dir(vdi_id, dir);
+
+	if (vst_load_fonts(vdi_id, dir) != 3)
+		pr_fatal_error("%s: vst_load_fonts count\n", dir);
+
+	if (vst_font(vdi_id, VDI_DIR_FACE) != VDI_DIR_FACE)
+		pr_fatal_error("%s: vst_font\n", dir);
+
+	vst_height(vdi_id, 12, &char_width, &char_height,
+		&cell_width, &cell_height);
+	if (char_height != vdi_dir_files[0].top)
+		pr_fatal_error("%s: truncated font selected\n", dir);
+
+	const struct key v = system_keys[vdi_dir_files[0].system];
+	const struct fnt *last = vdi_fnt_lookup(vdi_id, VDI_DIR_FACE,
+		v.point, v.height);
+
+	if (!last || strcmp(last->header->name.s, vdi_dir_files[0].name) != 0)
+		pr_fatal_error("%s: fonts not indexed in order of names\n",
+			dir);
+
+	const struct key t = system_keys[vdi_dir_files[1].system];
+
+	if (vdi_fnt_lookup(vdi_id, VDI_DIR_FACE, t.point, t.height))
+		pr_fatal_error("%s: truncated font found\n", dir);
+
+	const struct fnt *fnt = vdi_text_fnt(vdi_id);
+
+	if (!fnt || !fnt_valid(fnt))
+		pr_fatal_error("%s: valid font\n", dir);
+
+	remove_font_dir(dir);
+}
+
+int main(int argc, char *argv[])
+{
+	vdi_id_t vdi_id = vdi_v_opnwk(NULL, NULL);
+	struct key keys[VDI_FONTS];
+
+	if (!vdi_id_valid(vdi_id))
+		pr_fatal_errno("vdi_v_opnwk");
+
+	check_system_fonts(vdi_id);
+	register_fonts(vdi_id, keys);
+	check_lookup(vdi_id, keys);
+	check_select(vdi_id, keys);
+	check_font_dir(vdi_id);
+
+	vdi_v_clswk(vdi_id);
+
+	return EXIT_SUCCESS;
+}
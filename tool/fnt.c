@@ -7,9 +7,12 @@
 #include <unistd.h>
 
 #include <gem/fnt.h>
+#include <gem/vdi.h>
 
+#include "internal/compare.h"
 #include "internal/file.h"
 #include "internal/macro.h"
+#include "internal/memory.h"
 #include "internal/print.h"
 
 #include "unicode/atari.h"
@@ -23,6 +26,9 @@ static struct {
 	int identify;
 	int diagnostic;
 	char *format;
+	int face;
+	int height;
+	const char *fonts;
 	const char *input;
 } option;
 
@@ -30,9 +36,11 @@ static void help(FILE *file)
 {
 	fprintf(file,
 "Usage: %s [options]... <FNT-file>\n"
+"   or: %s [options]... --face <id>\n"
 "\n"
 "Displays Atari TOS GEM font (FNT) file header and character set, as text\n"
-"on standard output.\n"
+"on standard output. The font may also be selected by face id and height\n"
+"as with the VDI, from the system fonts and a GDOS font directory.\n"
 "\n"
 "Options:\n"
 "\n"
@@ -42,8 +50,15 @@ static void help(FILE *file)
 "    --identify            exit sucessfully if the file is a valid FNT\n"
 "    --diagnostic          display diagnostic warnings and errors\n"
 "    --format <text|bdf>   display format type text (default) or bdf\n"
+"\n"
+"    --face <id>           select the font of a face id\n"
+"    --height <pixels>     select the largest font of the face with at most\n"
+"                          the height from the baseline to the top line, or\n"
+"                          otherwise the smallest font, requires --face\n"
+"    --fonts <dir>         load the FNT files of a GDOS font directory,\n"
+"                          where invalid fonts are skipped, requires --face\n"
 "\n",
-		progname);
+		progname, progname);
 }
 
 static void NORETURN help_exit(int code)
@@ -68,6 +83,9 @@ static void parse_options(int argc, char **argv)
 		{ "identify",   no_argument,       &option.identify,   1 },
 		{ "diagnostic", no_argument,       &option.diagnostic, 1 },
 		{ "format",     required_argument, NULL,               0 },
+		{ "face",       required_argument, NULL,               0 },
+		{ "height",     required_argument, NULL,               0 },
+		{ "fonts",      required_argument, NULL,               0 },
 		{ NULL, 0, NULL, 0 }
 	};
 
@@ -76,6 +94,8 @@ static void parse_options(int argc, char **argv)
 	argv[0] = progname;	/* For better getopt_long error messages. */
 
 	option.format = "text";
+	option.face = -1;
+	option.height = -1;
 
 	for (;;) {
 		int index = 0;
@@ -91,6 +111,24 @@ static void parse_options(int argc, char **argv)
 				version_exit();
 			else if (OPT("format"))
 				option.format = optarg;
+			else if (OPT("face")) {
+				char *end;
+
+				option.face = strtol(optarg, &end, 10);
+				if (*end != '\0' || option.face < 0 ||
+				    option.face > INT16_MAX)
+					pr_fatal_error("invalid face \"%s\"\n",
+						optarg);
+			} else if (OPT("height")) {
+				char *end;
+
+				option.height = strtol(optarg, &end, 10);
+				if (*end != '\0' || option.height < 0 ||
+				    option.height > INT16_MAX)
+					pr_fatal_error("invalid height \"%s\"\n",
+						optarg);
+			} else if (OPT("fonts"))
+				option.fonts = optarg;
 			break;
 
 opt_h:		case 'h':
@@ -104,6 +142,19 @@ opt_h:		case 'h':
 #undef OPT
 out:
 
+	if (option.height >= 0 && option.face < 0)
+		pr_fatal_error("--height requires --face\n");
+	if (option.fonts && option.face < 0)
+		pr_fatal_error("--fonts requires --face\n");
+
+	if (option.face >= 0) {
+		if (optind < argc)
+			pr_fatal_error("%s: input file with --face\n",
+				argv[optind]);
+
+		return;
+	}
+
 	if (optind == argc)
 		pr_fatal_error("missing input file\n");
 	if (optind + 1 < argc)
@@ -198,6 +249,36 @@ FNT_HEADER_FIELD(FNT_HEADER_FIELD_PRINT)
 		print_fnt_char(c, fnt);
 }
 
+/* Rows of the bitmap are formatted in hexadecimal, and written at once. */
+static void print_bdf_bitmap(const int w, const uint16_t c,
+	const struct fnt *fnt)
+{
+	static const char hex[] = "0123456789ABCDEF";
+	const int h = fnt->header->bitmap_lines;
+	const size_t stride = max((w + 7) / 8, 1);
+	uint8_t *bitmap = zalloc(max(h * stride, (size_t)1));
+	char *text = xmalloc(max(h * (2 * stride + 1), (size_t)1));
+	char *t = text;
+
+	fnt_char_bitmap(bitmap, stride, c, fnt);
+
+	for (int y = 0; y < h; y++) {
+		for (size_t i = 0; i < stride; i++) {
+			const uint8_t m = bitmap[y * stride + i];
+
+			*t++ = hex[m >> 4];
+			*t++ = hex[m & 0xf];
+		}
+
+		*t++ = '\n';
+	}
+
+	fwrite(text, 1, t - text, stdout);
+
+	free(text);
+	free(bitmap);
+}
+
 static void print_bdf_char(const uint16_t c, const struct fnt *fnt)
 {
 	const int w = fnt_char_width(c, fnt);
@@ -216,22 +297,7 @@ static void print_bdf_char(const uint16_t c, const struct fnt *fnt)
 		0, -fnt->header->descent);
 
 	puts("BITMAP");
-	for (int y = 0; y < fnt->header->bitmap_lines; y++) {
-		uint8_t m = 0;
-
-		for (int x = 0; x < w; x++) {
-			if (x >= 8 && x % 8 == 0) {
-				printf("%02X", m);
-				m = 0;
-			}
-
-			if (fnt_char_pixel(x, y, c, fnt))
-				m |= 0x80 >> (x % 8);
-		}
-
-		printf("%02X\n", m);
-	}
-
+	print_bdf_bitmap(w, c, fnt);
 	puts("ENDCHAR");
 }
 
@@ -297,55 +363,86 @@ static void print_fnt_error(const char *msg, void *arg)
 	dprintf(STDERR_FILENO, "%s: error: %s\n", option.input, msg);
 }
 
-int main(int argc, char *argv[])
+static int process_fnt(const struct fnt *fnt)
 {
-	parse_options(argc, argv);
+	if (option.identify)
+		return fnt_valid(fnt) ? EXIT_SUCCESS : EXIT_FAILURE;
 
-	struct file f = file_read(option.input);
+	static const struct fnt_diagnostic print_fnt_diagnostic = {
+		.warning = print_fnt_warning,
+		.error   = print_fnt_error,
+	};
 
-	if (!file_valid(&f))
-		pr_fatal_errno(f.path);
+	if (!fnt_valid_diagnostic(fnt, &print_fnt_diagnostic, NULL))
+		return EXIT_FAILURE;
 
-	const struct fnt fnt = { .size = f.size, .header = f.data };
+	if (strcmp(option.format, "text") == 0)
+		print_fnt_info(fnt);
+	else if (strcmp(option.format, "bdf") == 0)
+		print_bdf(fnt);
+	else
+		pr_fatal_error("unrecognised format \"%s\"\n", option.format);
 
-	if (option.identify) {
-		const bool valid = fnt_valid(&fnt);
+	return EXIT_SUCCESS;
+}
 
-		file_free(&f);
+/* Selects a font by face id and height as the VDI does for text. */
+static int process_vdi_fnt(void)
+{
+	vdi_id_t vdi_id = vdi_v_opnwk(NULL, NULL);
 
-		return valid ? EXIT_SUCCESS : EXIT_FAILURE;
-	}
+	if (!vdi_id_valid(vdi_id))
+		pr_fatal_errno("vdi_v_opnwk");
 
-	static const struct fnt_diagnostic print_fnt_diagnostic = {
-		.warning = print_fnt_warning,
-		.error   = print_fnt_error,
-	};
+	if (option.fonts && vst_load_fonts(vdi_id, option.fonts) == -1)
+		pr_fatal_errno(option.fonts);
 
-	if (option.identify) {
-		const bool valid = fnt_valid_diagnostic(
-			&fnt, &print_fnt_diagnostic, NULL);
+	if (vst_font(vdi_id, option.face) != option.face)
+		pr_fatal_error("face %d is not loaded\n", option.face);
 
-		file_free(&f);
+	if (option.height >= 0) {
+		int16_t char_width, char_height, cell_width, cell_height;
 
-		return valid ? EXIT_SUCCESS : EXIT_FAILURE;
+		vst_height(vdi_id, option.height, &char_width, &char_height,
+			&cell_width, &cell_height);
 	}
 
-	if (!fnt_valid_diagnostic(&fnt, &print_fnt_diagnostic, NULL))
-		goto err;
+	const struct fnt *fnt = vdi_text_fnt(vdi_id);
 
-	if (strcmp(option.format, "text") == 0)
-		print_fnt_info(&fnt);
-	else if (strcmp(option.format, "bdf") == 0)
-		print_bdf(&fnt);
-	else
-		pr_fatal_error("unrecognised format \"%s\"\n", option.format);
+	if (!fnt)
+		pr_fatal_error("face %d has no valid font\n", option.face);
 
-	file_free(&f);
+	static char label[32];	/* For diagnostic messages */
 
-	return EXIT_SUCCESS;
+	snprintf(label, sizeof(label), "face %d", option.face);
+	option.input = label;
+
+	const int status = process_fnt(fnt);
+
+	vdi_v_clswk(vdi_id);
+
+	return status;
+}
+
+int main(int argc, char *argv[])
+{
+	parse_options(argc, argv);
+
+	if (option.face >= 0)
+		return process_vdi_fnt();
+
+	struct file f = file_read(option.input);
+
+	if (!file_valid(&f))
+		pr_fatal_errno(f.path);
+
+	/* Big-endian fonts that fail to normalise are invalid. */
+	fnt_normalise(f.data, f.size);
+
+	const struct fnt fnt = { .size = f.size, .header = f.data };
+	const int status = process_fnt(&fnt);
 
-err:
 	file_free(&f);
 
-	return EXIT_FAILURE;
+	return status;
 }
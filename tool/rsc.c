@@ -1,12 +1,21 @@
 // SPDX-License-Identifier: GPL-2.0
 
+#include <dirent.h>
+#include <errno.h>
 #include <getopt.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdatomic.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include <gem/aes.h>
+#include <gem/aes-atlas.h>
+#include <gem/aes-framebuffer.h>
 #include <gem/aes-layer.h>
 #include <gem/aes-rsc.h>
 #include <gem/aes-shape.h>
@@ -19,7 +28,9 @@
 #include "internal/file.h"
 #include "internal/macro.h"
 #include "internal/memory.h"
+#include "internal/png.h"
 #include "internal/print.h"
+#include "internal/string.h"
 #include "internal/tiff.h"
 
 #include "unicode/atari.h"
@@ -36,14 +47,89 @@ static struct {
 	int identify;
 	int diagnostic;
 	int draw;
+	int scale;
+	int thumbnail;
+	int samples;
+	int tree;
+	int select;
+	int jobs;
+	int png;
+	int batch;
+	int format_set;
+	int pixel_format_set;
+	enum aes_surface_format pixel_format;
+	const char *framebuffer;
+	const char *atlas;
+	const char *list;
 	const char *input;
 	const char *output;
+	char **inputs;
+	int ninput;
 } option;
 
+/**
+ * struct rsc_job - RSC file to process
+ * @input: path of RSC file
+ * @output: path of images, or %NULL
+ * @atlas: path of atlas index, or %NULL
+ * @out: text output, standard output or a buffer in batch mode
+ * @err: warnings and errors, standard error or a buffer in batch mode
+ * @out_buf: buffer of @out in batch mode
+ * @out_size: size in bytes of @out_buf
+ * @err_buf: buffer of @err in batch mode
+ * @err_size: size in bytes of @err_buf
+ * @valid: %true if the file was processed successfully
+ * @done: %true when the file has been processed in batch mode
+ * @error: errno if @input could not be read as a directory in batch mode,
+ * 	otherwise zero
+ * @duplicate: input of a preceding file with the same output and atlas
+ * 	paths in batch mode, or %NULL
+ */
+struct rsc_job {
+	char *input;
+	char *output;
+	char *atlas;
+	FILE *out;
+	FILE *err;
+	char *out_buf;
+	size_t out_size;
+	char *err_buf;
+	size_t err_size;
+	bool valid;
+	bool done;
+	int error;
+	const char *duplicate;
+};
+
+/* Files are processed by several threads in batch mode. */
+static _Thread_local struct rsc_job *job;
+
+static bool job_error(const char *fmt, ...)
+	__attribute__((format(printf, 1, 2)));
+
+static bool job_error(const char *fmt, ...)
+{
+	va_list ap;
+
+	fprintf(job->err, "error: ");
+
+	va_start(ap, fmt);
+	vfprintf(job->err, fmt, ap);
+	va_end(ap);
+
+	return false;
+}
+
+static bool job_errno(const char *s)
+{
+	return job_error("%s: %s\n", s, strerror(errno));
+}
+
 static void help(FILE *file)
 {
 	fprintf(file,
 "Usage: %s [options]... <RSC-file>\n"
+"       %s [options]... --batch <RSC-file|directory>...\n"
 "\n"
 "Displays Atari TOS GEM resource (RSC) file header, strings, images, icons,\n"
 "objects, and other details, as text on standard output.\n"
@@ -62,8 +148,40 @@ static void help(FILE *file)
 "\n"
 "    --draw                draw RSC forms and dialogues as images\n"
 "    -o, --output <path>   save images as a multipart TIFF file\n"
+"    --format <tiff|png>   save images as a multipart TIFF file, or as PNG\n"
+"                          files numbered by tree as <path>-<tree>.png;\n"
+"                          default is tiff\n"
+"    --scale <n>           draw with n by n pixels per point; default is 1\n"
+"    --thumbnail <n>       draw thumbnails with n by n points per pixel\n"
+"    --samples <n>         average n by n samples per thumbnail pixel, with\n"
+"                          rgb565, xrgb8888 or rgba16; default is 1\n"
+"    --atlas <path>        draw all trees into a single image, and save\n"
+"                          lines of tree index, x, y, width and height in\n"
+"                          pixels of every tree as a text file\n"
+"    -j, --jobs <n>        draw with n threads; default is the number of\n"
+"                          online processors\n"
+"\n"
+"    --framebuffer <path>  draw an RSC object tree into a framebuffer device\n"
+"                          such as /dev/fb0, or a file of raw pixels\n"
+"    --tree <index>        object tree to draw; default is 0\n"
+"    --select <object>     toggle the selected state of an object after\n"
+"                          drawing the tree, by inverting it in place or\n"
+"                          by redrawing it\n"
+"    --pixel-format <format>\n"
+"                          pixel format of framebuffer files: indexed1,\n"
+"                          indexed4, indexed8, rgb565, xrgb8888, rgba16,\n"
+"                          or Atari ST interleaved bitplanes planar1,\n"
+"                          planar2 or planar4; default is xrgb8888\n"
+"\n"
+"    --batch               process many RSC files in parallel, and RSC files\n"
+"                          in directories recursively; output and atlas\n"
+"                          paths are directories of files named as the RSC\n"
+"                          files, where later files of the same name are\n"
+"                          errors, and text and errors are displayed in order\n"
+"    --list <path>         process RSC files listed one per line in a file,\n"
+"                          or - for standard input, in batch mode\n"
 "\n",
-		progname);
+		progname, progname);
 }
 
 static void NORETURN help_exit(int code)
@@ -80,6 +198,19 @@ static void NORETURN version_exit(void)
 	exit(EXIT_SUCCESS);
 }
 
+static bool parse_surface_format(enum aes_surface_format *format,
+	const char *label)
+{
+#define SURFACE_FORMAT_PARSE(symbol_, label_, bpp_, layout_)		\
+	if (strcmp(label, #label_) == 0) {				\
+		*format = AES_SURFACE_FORMAT_ ## symbol_;		\
+		return true;						\
+	}
+AES_SURFACE_FORMAT(SURFACE_FORMAT_PARSE)
+
+	return false;
+}
+
 static void parse_options(int argc, char **argv)
 {
 	static const struct option options[] = {
@@ -91,6 +222,18 @@ static void parse_options(int argc, char **argv)
 		{ "map",            no_argument, &option.map,        1 },
 		{ "draw",           no_argument, &option.draw,       1 },
 		{ "output",   required_argument, NULL,               0 },
+		{ "framebuffer", required_argument, NULL,            0 },
+		{ "scale",    required_argument, NULL,               0 },
+		{ "thumbnail", required_argument, NULL,              0 },
+		{ "samples",  required_argument, NULL,               0 },
+		{ "atlas",    required_argument, NULL,               0 },
+		{ "jobs",     required_argument, NULL,               0 },
+		{ "tree",     required_argument, NULL,               0 },
+		{ "select",   required_argument, NULL,               0 },
+		{ "format",   required_argument, NULL,               0 },
+		{ "pixel-format", required_argument, NULL,           0 },
+		{ "batch",          no_argument, &option.batch,      1 },
+		{ "list",     required_argument, NULL,               0 },
 		{ NULL, 0, NULL, 0 }
 	};
 
@@ -99,11 +242,17 @@ static void parse_options(int argc, char **argv)
 	argv[0] = progname;	/* For better getopt_long error messages. */
 
 	option.utf8 = true;
+	option.pixel_format = AES_SURFACE_FORMAT_XRGB8888;
+	option.scale = 1;
+	option.thumbnail = 1;
+	option.samples = 1;
+	option.select = -1;
+	option.jobs = max(sysconf(_SC_NPROCESSORS_ONLN), 1L);
 
 	for (;;) {
 		int index = 0;
 
-		switch (getopt_long(argc, argv, "ho:", options, &index)) {
+		switch (getopt_long(argc, argv, "hj:o:", options, &index)) {
 		case -1:
 			goto out;
 
@@ -122,11 +271,86 @@ static void parse_options(int argc, char **argv)
 						optarg);
 			} else if (OPT("output"))
 				goto opt_o;
+			else if (OPT("atlas"))
+				option.atlas = optarg;
+			else if (OPT("list")) {
+				option.list = optarg;
+				option.batch = true;
+			}
+			else if (OPT("jobs"))
+				goto opt_j;
+			else if (OPT("framebuffer"))
+				option.framebuffer = optarg;
+			else if (OPT("scale")) {
+				char *end;
+
+				option.scale = strtol(optarg, &end, 10);
+				if (*end != '\0' ||
+				    option.scale < 1 || option.scale > 16)
+					pr_fatal_error("invalid scale \"%s\"\n",
+						optarg);
+			} else if (OPT("thumbnail")) {
+				char *end;
+
+				option.thumbnail = strtol(optarg, &end, 10);
+				if (*end != '\0' || option.thumbnail < 1 ||
+				    option.thumbnail > 64)
+					pr_fatal_error("invalid thumbnail \"%s\"\n",
+						optarg);
+			} else if (OPT("samples")) {
+				char *end;
+
+				option.samples = strtol(optarg, &end, 10);
+				if (*end != '\0' ||
+				    option.samples < 1 || option.samples > 16)
+					pr_fatal_error("invalid samples \"%s\"\n",
+						optarg);
+			} else if (OPT("tree")) {
+				char *end;
+
+				option.tree = strtol(optarg, &end, 10);
+				if (*end != '\0' || option.tree < 0)
+					pr_fatal_error("invalid tree \"%s\"\n",
+						optarg);
+			} else if (OPT("select")) {
+				char *end;
+
+				option.select = strtol(optarg, &end, 10);
+				if (*end != '\0' || option.select < 0 ||
+				    option.select > INT16_MAX)
+					pr_fatal_error("invalid object \"%s\"\n",
+						optarg);
+			} else if (OPT("format")) {
+				if (strcmp(optarg, "tiff") == 0)
+					option.png = false;
+				else if (strcmp(optarg, "png") == 0)
+					option.png = true;
+				else
+					pr_fatal_error("invalid format \"%s\"\n",
+						optarg);
+				option.format_set = true;
+			} else if (OPT("pixel-format")) {
+				if (!parse_surface_format(&option.pixel_format,
+						optarg))
+					pr_fatal_error(
+						"invalid pixel format \"%s\"\n",
+						optarg);
+				option.pixel_format_set = true;
+			}
 			break;
 
 opt_h:		case 'h':
 			help_exit(EXIT_SUCCESS);
 
+opt_j:		case 'j': {
+			char *end;
+
+			option.jobs = strtol(optarg, &end, 10);
+			if (*end != '\0' || option.jobs < 1 || option.jobs > 256)
+				pr_fatal_error("invalid jobs \"%s\"\n", optarg);
+			break;
+		}
+
 opt_o:		case 'o':
 			option.output = optarg;
 			break;
@@ -139,15 +363,45 @@ opt_o:		case 'o':
 #undef OPT
 out:
 
-	if (optind == argc)
-		pr_fatal_error("missing input file\n");
-	if (optind + 1 < argc)
-		pr_fatal_error("%s: too many input files\n", argv[optind + 1]);
+	if (option.batch) {
+		option.inputs = &argv[optind];
+		option.ninput = argc - optind;
+
+		if (!option.ninput && !option.list)
+			pr_fatal_error("missing input files\n");
+		if (option.draw && !option.output)
+			pr_fatal_error("missing output directory\n");
+		if (option.framebuffer)
+			pr_fatal_error(
+				"--framebuffer and --batch are exclusive\n");
+	} else {
+		if (optind == argc)
+			pr_fatal_error("missing input file\n");
+		if (optind + 1 < argc)
+			pr_fatal_error("%s: too many input files\n",
+				argv[optind + 1]);
+
+		option.input = argv[optind];
+	}
+
+	if (option.draw && option.png && !option.output)
+		pr_fatal_error("missing output file for PNG images\n");
+
+	if (option.format_set && !option.draw)
+		pr_fatal_error("--format requires --draw\n");
+
+	if (option.pixel_format_set && !option.framebuffer)
+		pr_fatal_error("--pixel-format requires --framebuffer\n");
 
-	option.input = argv[optind];
+	if (option.select >= 0 && !option.framebuffer)
+		pr_fatal_error("--select requires --framebuffer\n");
+
+	if (option.thumbnail > 1 && option.scale > 1)
+		pr_fatal_error("--scale and --thumbnail are exclusive\n");
 
 	option.info = !option.map &&
-		      !option.draw;
+		      !option.draw &&
+		      !option.framebuffer;
 }
 
 static void print_atari_st_char(const char c)
@@ -159,23 +413,23 @@ static void print_atari_st_char(const char c)
 
 		if (k > 0) {
 			u[k] = '\0';
-			printf("%s", u);
+			fprintf(job->out, "%s", u);
 		} else
-			printf("?");
+			fprintf(job->out, "?");
 	} else
-		printf("%c", c);
+		fprintf(job->out, "%c", c);
 }
 
 static void print_rsc_string_escaped(const char *s)
 {
 	for (size_t i = 0; s[i] != '\0'; i++)
 		switch (s[i]) {
-		case '\0': printf("\\0");  break;
-		case '\t': printf("\\t");  break;
-		case '\r': printf("\\r");  break;
-		case '\n': printf("\\n");  break;
-		case '\\': printf("\\\\"); break;
-		case  '"': printf("\\\""); break;
+		case '\0': fprintf(job->out, "\\0");  break;
+		case '\t': fprintf(job->out, "\\t");  break;
+		case '\r': fprintf(job->out, "\\r");  break;
+		case '\n': fprintf(job->out, "\\n");  break;
+		case '\\': fprintf(job->out, "\\\\"); break;
+		case  '"': fprintf(job->out, "\\\""); break;
 		default:   print_atari_st_char(s[i]);
 		}
 }
@@ -219,7 +473,7 @@ static void print_rsc_header(const struct rsc_header *h, size_t offset,
 	const struct rsc *rsc)
 {
 #define RSC_HEADER_PRINT(type, name)					\
-	printf("header rsh_" #name " %d\n", h->rsh_ ## name);
+	fprintf(job->out, "header rsh_" #name " %d\n", h->rsh_ ## name);
 RSC_HEADER_FIELD(RSC_HEADER_PRINT)
 }
 
@@ -243,11 +497,11 @@ static void print_rsc_string(const struct rsc_string *string,
 	const ssize_t i = rsc_string_indexed(offset, rsc);
 
 	if (i < 0)
-		printf("string %zd \"", offset);
+		fprintf(job->out, "string %zd \"", offset);
 	else
-		printf("frstr %zd \"", i);
+		fprintf(job->out, "frstr %zd \"", i);
 	print_rsc_string_escaped(s);
-	puts("\"");
+	fputs("\"\n", job->out);
 }
 
 static void print_rsc_iconblk(const struct rsc_iconblk *iconblk,
@@ -256,40 +510,43 @@ static void print_rsc_iconblk(const struct rsc_iconblk *iconblk,
 	const int w = iconblk->ib_icon.r.w;
 	const int h = iconblk->ib_icon.r.h;
 
-	printf("iconblk %zd icon w %d px h %d px x %d px y %d px fg %s bg %s\n",
+	fprintf(job->out,
+		"iconblk %zd icon w %d px h %d px x %d px y %d px fg %s bg %s\n",
 		offset, w, h, iconblk->ib_icon.p.x, iconblk->ib_icon.p.y,
 		rsc_object_color_label(iconblk->ib_char.color.fg),
 		rsc_object_color_label(iconblk->ib_char.color.bg));
 
-	printf("iconblk %zd char x %d px y %d px char 0x%02x", offset,
+	fprintf(job->out, "iconblk %zd char x %d px y %d px char 0x%02x",
+		offset,
 		iconblk->ib_char.p.x, iconblk->ib_char.p.y,
 		iconblk->ib_char.c);
 	if (iconblk->ib_char.c) {
-		printf(" \"");
+		fprintf(job->out, " \"");
 		print_atari_st_char(iconblk->ib_char.c);
-		puts("\"");
+		fputs("\"\n", job->out);
 	} else
-		puts(" NUL");
+		fputs(" NUL\n", job->out);
 
 	const char *text = rsc_string_at_offset(iconblk->ib_text, rsc);
 	BUG_ON(!text);
-	printf("iconblk %zd text x %d px y %d px w %d px h %d px string %u \"",
+	fprintf(job->out,
+		"iconblk %zd text x %d px y %d px w %d px h %d px string %u \"",
 		offset,
 		iconblk->ib_txt.p.x, iconblk->ib_txt.p.y,
 		iconblk->ib_txt.r.w, iconblk->ib_txt.r.h,
 		iconblk->ib_text);
 	print_rsc_string_escaped(text);
-	puts("\"");
+	fputs("\"\n", job->out);
 
 	for (int y = 0; y < h; y++) {
-		printf("\t");
+		fprintf(job->out, "\t");
 		for (int x = 0; x < w; x++) {
 			const struct rsc_iconblk_pixel p =
 				rsc_iconblk_pixel(x, y, iconblk, rsc);
 
-			printf("%c", p.data ? '#' : p.mask ? 'x' : '.');
+			fputc(p.data ? '#' : p.mask ? 'x' : '.', job->out);
 		}
-		puts("");
+		fputs("\n", job->out);
 	}
 }
 
@@ -310,33 +567,33 @@ static void print_rsc_bitblk(const struct rsc_bitblk *bitblk,
 	const int h = bitblk->bi_hl;
 
 	if (i < 0)
-		printf("bitblk %zd", offset);
+		fprintf(job->out, "bitblk %zd", offset);
 	else
-		printf("frimg %zd", i);
+		fprintf(job->out, "frimg %zd", i);
 
-	printf(" w %d px h %d px x %d px y %d px\n",
+	fprintf(job->out, " w %d px h %d px x %d px y %d px\n",
 		w, h, bitblk->bi_x, bitblk->bi_y);
 
 	for (int y = 0; y < h; y++) {
-		printf("\t");
+		fprintf(job->out, "\t");
 		for (int x = 0; x < w; x++)
-			printf("%c", rsc_bitblk_pixel(
+			fprintf(job->out, "%c", rsc_bitblk_pixel(
 				x, y, bitblk, rsc) ? '#' : '.');
-		puts("");
+		fputs("\n", job->out);
 	}
 }
 
 static void print_rsc_applblk(const struct rsc_applblk *applblk,
 	const size_t offset, const struct rsc *rsc)
 {
-	printf("applblk %zd code %u param %u\n",
+	fprintf(job->out, "applblk %zd code %u param %u\n",
 		offset, applblk->ap_code, applblk->ap_parm);
 }
 
 static void print_rsc_object_color(
 	const struct rsc_object_color color, const struct rsc *rsc)
 {
-	printf("border %s pattern %d %s %s text %s",
+	fprintf(job->out, "border %s pattern %d %s %s text %s",
 		rsc_object_color_label(color.border),
 		color.pattern,
 		rsc_object_color_label(color.fill),
@@ -348,7 +605,7 @@ static void print_rsc_tedinfo_integer(const char *name,
 	const int n, const struct rsc_tedinfo *tedinfo,
 	const size_t tedinfo_offset, const struct rsc *rsc)
 {
-	printf("tedinfo %zd %s %d \n", tedinfo_offset, name, n);
+	fprintf(job->out, "tedinfo %zd %s %d \n", tedinfo_offset, name, n);
 }
 
 static void print_rsc_tedinfo_string(const char *name,
@@ -358,17 +615,17 @@ static void print_rsc_tedinfo_string(const char *name,
 	const char *text = rsc_string_at_offset(string_offset, rsc);
 
 	BUG_ON(!text);
-	printf("tedinfo %zd %s string %zu \"",
+	fprintf(job->out, "tedinfo %zd %s string %zu \"",
 		tedinfo_offset, name, string_offset);
 	print_rsc_string_escaped(text);
-	puts("\"");
+	fputs("\"\n", job->out);
 }
 
 static void print_rsc_tedinfo_font(const char *name,
 	const int16_t te_font, const struct rsc_tedinfo *tedinfo,
 	const size_t tedinfo_offset, const struct rsc *rsc)
 {
-	printf("tedinfo %zd %s %d %s\n", tedinfo_offset, name,
+	fprintf(job->out, "tedinfo %zd %s %d %s\n", tedinfo_offset, name,
 		te_font, rsc_tedinfo_font_label(te_font));
 }
 
@@ -376,7 +633,7 @@ static void print_rsc_tedinfo_just(const char *name,
 	const int16_t te_just, const struct rsc_tedinfo *tedinfo,
 	const size_t tedinfo_offset, const struct rsc *rsc)
 {
-	printf("tedinfo %zd %s %d %s\n", tedinfo_offset, name,
+	fprintf(job->out, "tedinfo %zd %s %d %s\n", tedinfo_offset, name,
 		te_just, rsc_tedinfo_justificaion_label(te_just));
 }
 
@@ -385,9 +642,9 @@ static void print_rsc_tedinfo_color(const char *name,
 	const struct rsc_tedinfo *tedinfo, const size_t tedinfo_offset,
 	const struct rsc *rsc)
 {
-	printf("tedinfo %zd %s ", tedinfo_offset, name);
+	fprintf(job->out, "tedinfo %zd %s ", tedinfo_offset, name);
 	print_rsc_object_color(te_color, rsc);
-	puts("");
+	fputs("\n", job->out);
 }
 
 static void print_rsc_tedinfo(const struct rsc_tedinfo *tedinfo,
@@ -406,9 +663,9 @@ static void print_rsc_object_prefix(const int16_t ob,
 		print_rsc_object_prefix(rsc_object_parent(ob, tree),
 			tree, prefix);
 
-		printf(" object %d", ob);
+		fprintf(job->out, " object %d", ob);
 	} else
-		printf("%s", prefix);
+		fprintf(job->out, "%s", prefix);
 }
 
 static void print_rsc_object_link(
@@ -419,13 +676,13 @@ static void print_rsc_object_link(
 	const char *prefix)
 {
 	print_rsc_object_prefix(ob, tree, prefix);
-	printf(" link next %d\n", link.next);
+	fprintf(job->out, " link next %d\n", link.next);
 
 	print_rsc_object_prefix(ob, tree, prefix);
-	printf(" link head %d\n", link.head);
+	fprintf(job->out, " link head %d\n", link.head);
 
 	print_rsc_object_prefix(ob, tree, prefix);
-	printf(" link tail %d\n", link.tail);
+	fprintf(job->out, " link tail %d\n", link.tail);
 }
 
 static const char *rsc_object_g_type_label(const struct rsc_object_type type)
@@ -448,7 +705,7 @@ static void print_rsc_object_type(
 	const char *label = rsc_object_g_type_label(type);
 
 	print_rsc_object_prefix(ob, tree, prefix);
-	printf(" shape type %d %s %d\n", type.g,
+	fprintf(job->out, " shape type %d %s %d\n", type.g,
 		*label ? label : "G_UNDEFINED", type.m);
 }
 
@@ -460,17 +717,17 @@ static void print_rsc_object_flags(
 	const char *prefix)
 {
 	print_rsc_object_prefix(ob, tree, prefix);
-	printf(" shape flags 0x%x", flags.mask);
+	fprintf(job->out, " shape flags 0x%x", flags.mask);
 
 #define RSC_OBJECT_FLAG_PRINT(bit_, symbol_, label_)			\
 	if (flags.symbol_)						\
-		printf(" %s", #label_);
+		fprintf(job->out, " %s", #label_);
 GEM_OBJECT_FLAG(RSC_OBJECT_FLAG_PRINT)
 
 	if (flags.undefined)
-		printf(" UNDEFINED_0x%x", flags.undefined);
+		fprintf(job->out, " UNDEFINED_0x%x", flags.undefined);
 
-	puts("");
+	fputs("\n", job->out);
 }
 
 static void print_rsc_object_state(
@@ -481,25 +738,25 @@ static void print_rsc_object_state(
 	const char *prefix)
 {
 	print_rsc_object_prefix(ob, tree, prefix);
-	printf(" shape state 0x%x", state.mask);
+	fprintf(job->out, " shape state 0x%x", state.mask);
 
 #define RSC_OBJECT_STATE_PRINT(bit_, symbol_, label_)			\
 	if (state.symbol_)						\
-		printf(" %s", #label_);
+		fprintf(job->out, " %s", #label_);
 GEM_OBJECT_STATE(RSC_OBJECT_STATE_PRINT)
 
 	if (state.undefined)
-		printf(" UNDEFINED_0x%x", state.undefined);
+		fprintf(job->out, " UNDEFINED_0x%x", state.undefined);
 
-	puts("");
+	fputs("\n", job->out);
 }
 
 static void print_rsc_object_spec_box(
 	const struct rsc_object_spec spec, const struct rsc *rsc)
 {
-	printf(" box %d px ", spec.box.thickness);
+	fprintf(job->out, " box %d px ", spec.box.thickness);
 	print_rsc_object_color(spec.box.color, rsc);
-	puts("");
+	fputs("\n", job->out);
 }
 
 static void print_rsc_object_spec_string(
@@ -509,39 +766,39 @@ static void print_rsc_object_spec_string(
 
 	BUG_ON(!s);
 
-	printf(" string %u \"", spec.string);
+	fprintf(job->out, " string %u \"", spec.string);
 	print_rsc_string_escaped(s);
-	puts("\"");
+	fputs("\"\n", job->out);
 }
 
 static void print_rsc_object_spec_bitblk(
 	const struct rsc_object_spec spec, const struct rsc *rsc)
 {
-	printf(" bitblk %u\n", spec.bitblk);
+	fprintf(job->out, " bitblk %u\n", spec.bitblk);
 }
 
 static void print_rsc_object_spec_iconblk(
 	const struct rsc_object_spec spec, const struct rsc *rsc)
 {
-	printf(" iconblk %u\n", spec.iconblk);
+	fprintf(job->out, " iconblk %u\n", spec.iconblk);
 }
 
 static void print_rsc_object_spec_ciconblk(
 	const struct rsc_object_spec spec, const struct rsc *rsc)
 {
-	printf(" ciconblk %u\n", spec.ciconblk);
+	fprintf(job->out, " ciconblk %u\n", spec.ciconblk);
 }
 
 static void print_rsc_object_spec_tedinfo(
 	const struct rsc_object_spec spec, const struct rsc *rsc)
 {
-	printf(" tedinfo %u\n", spec.tedinfo);
+	fprintf(job->out, " tedinfo %u\n", spec.tedinfo);
 }
 
 static void print_rsc_object_spec_applblk(
 	const struct rsc_object_spec spec, const struct rsc *rsc)
 {
-	printf(" applblk %u\n", spec.applblk);
+	fprintf(job->out, " applblk %u\n", spec.applblk);
 }
 
 static void print_rsc_object_spec(
@@ -552,13 +809,13 @@ static void print_rsc_object_spec(
 	const char *prefix)
 {
 	print_rsc_object_prefix(ob, tree, prefix);
-	printf(" shape spec");
+	fprintf(job->out, " shape spec");
 
 	switch (tree[ob].shape.type.g) {
 #define RSC_OBJECT_G_TYPE_SPEC(n_, symbol_, label_, spec_)		\
 	case n_: return print_rsc_object_spec_ ## spec_(spec, rsc);
 GEM_OBJECT_G_TYPE(RSC_OBJECT_G_TYPE_SPEC)
-	default: printf(" UNDEFINED_0x%x\n", spec.undefined);
+	default: fprintf(job->out, " UNDEFINED_0x%x\n", spec.undefined);
 	}
 }
 
@@ -570,12 +827,14 @@ static void print_rsc_object_area(
 	const char *prefix)
 {
 	print_rsc_object_prefix(ob, tree, prefix);
-	printf(" shape area x %d ch %d px", area.p.x.ch, area.p.x.px);
-	printf(" y %d ch %d px\n", area.p.y.ch, area.p.y.px);
+	fprintf(job->out, " shape area x %d ch %d px",
+		area.p.x.ch, area.p.x.px);
+	fprintf(job->out, " y %d ch %d px\n", area.p.y.ch, area.p.y.px);
 
 	print_rsc_object_prefix(ob, tree, prefix);
-	printf(" shape area w %d ch %d px", area.r.w.ch, area.r.w.px);
-	printf(" h %d ch %d px\n", area.r.h.ch, area.r.h.px);
+	fprintf(job->out, " shape area w %d ch %d px",
+		area.r.w.ch, area.r.w.px);
+	fprintf(job->out, " h %d ch %d px\n", area.r.h.ch, area.r.h.px);
 }
 
 static void print_rsc_object(const int16_t ob,
@@ -609,15 +868,18 @@ static void print_rsc_trees(const struct rsc *rsc)
 		print_rsc_tree(i, rsc);
 }
 
-static void print_rsc_info(const struct rsc *rsc)
+static bool print_rsc_info(const struct rsc *rsc)
 {
 	struct rsc_map *map = rsc_map_alloc(rsc);
 	struct rsc_map_region region;
 
 	BUG_ON(!map);
 
-	if (!rsc_map(map, rsc))
-		pr_fatal_error("%s: malformed RSC structure\n", option.input);
+	if (!rsc_map(map, rsc)) {
+		rsc_map_free(map);
+
+		return job_error("%s: malformed RSC structure\n", job->input);
+	}
 
 #define PRINT_INFO_TYPE(type_)						\
 	rsc_map_for_each_region (region, map)				\
@@ -640,6 +902,8 @@ static void print_rsc_info(const struct rsc *rsc)
 	rsc_map_free(map);
 
 	print_rsc_trees(rsc);
+
+	return true;
 }
 
 static void print_rsc_map_region(
@@ -647,7 +911,7 @@ static void print_rsc_map_region(
 {
 	const char *s = rsc_map_entry_type_symbol(region->entry.type);
 
-	printf("%-8s %5zu %zu%s\n",
+	fprintf(job->out, "%-8s %5zu %zu%s\n",
 		s[0] ? s : "-",
 		region->offset, region->size,
 		region->entry.reserved ? " reserved" : "");
@@ -656,7 +920,7 @@ static void print_rsc_map_region(
 	    region->entry.reserved) {
 		const uint8_t *b = (const uint8_t *)rsc->header;
 
-		pr_mem(stdout, &b[region->offset], region->size);
+		pr_mem(job->out, &b[region->offset], region->size);
 	}
 }
 
@@ -684,21 +948,26 @@ static bool print_rsc_map(const struct rsc *rsc)
 
 struct draw_rsc_arg {
 	int i;
-	struct aes_area clip;
 	struct aes_area bounds;
-
-	struct draw_rsc_arg_pixel_buffer {
-		size_t i;
-		size_t n;
-		struct tiff_pixel px[64];
-	} buffer;
+	struct tiff_pixel *row;
 
 	aes_id_t aes_id;
 	const struct rsc *rsc;
+	struct aes_surface_arena arena;
 	struct aes_object_shape_iterator iterator;
 	struct aes_rsc_object_shape_iterator_arg arg;
 };
 
+static struct aes_surface draw_rsc_surface(const struct aes_area area)
+{
+	return (struct aes_surface) {
+		.format = AES_SURFACE_FORMAT_RGBA16,
+		.area = area,
+		.scale = option.scale,
+		.reduction = option.thumbnail
+	};
+}
+
 static bool draw_rsc_image(uint16_t *width, uint16_t *height, void *arg_)
 {
 	struct draw_rsc_arg *arg = arg_;
@@ -708,173 +977,818 @@ static bool draw_rsc_image(uint16_t *width, uint16_t *height, void *arg_)
 		arg->aes_id, tree, arg->rsc, &arg->arg);
 	arg->bounds = aes_object_shape_bounds(&arg->iterator);
 
-	*width  = arg->bounds.r.w;
-	*height = arg->bounds.r.h;
+	const struct aes_surface surface = draw_rsc_surface(arg->bounds);
+	const struct aes_rectangle size = aes_surface_size(&surface);
+
+	if (size.w > UINT16_MAX || size.h > UINT16_MAX) {
+		job_error("%s: tree %d too large to draw\n",
+			job->input, arg->i);
+		errno = EFBIG;
 
-	arg->buffer = (struct draw_rsc_arg_pixel_buffer) { };
+		return false;
+	}
+
+	*width  = size.w;
+	*height = size.h;
+
+	arg->row = xrealloc(arg->row, max_t(size_t,
+		aes_surface_scale(&surface) * size.w, 1) * sizeof(*arg->row));
 
 	return true;
 }
 
-static bool draw_rsc_layer(const struct aes_area clip,
-	const struct aes_object_shape_layer *layers, void *arg_)
+/*
+ * Rows of unscaled images are drawn directly into the row buffer of the
+ * image writer. Rows of scaled images are drawn scale rows at a time, that
+ * are then copied one by one.
+ */
+static bool draw_rsc_row(uint16_t y, uint16_t width,
+	struct tiff_pixel *row, void *arg_)
 {
 	struct draw_rsc_arg *arg = arg_;
-	struct vdi_color color;
+	struct aes_surface surface = draw_rsc_surface(arg->bounds);
+	const struct aes_rectangle size = aes_surface_size(&surface);
+	const int scale = aes_surface_scale(&surface);
+	const int reduction = aes_surface_reduction(&surface);
 
-	for (int x = 0; x < clip.r.w; x++) {
-		const struct aes_point p = {
-			.x = clip.p.x + x,
-			.y = clip.p.y
-		};
+	BUILD_BUG_ON(sizeof(*row) != 8);	/* Same as RGBA16 */
+	BUG_ON(width != size.w);
 
-		if (!aes_palette_color(arg->aes_id, aes_object_shape_pixel(
-				arg->aes_id, p, &layers->shape), &color))
-			return true;
+	if (!(y % scale)) {
+		const int v = (y / scale) * reduction;
+
+		surface.area.p.y += v;
+		surface.area.r.h = min(reduction, arg->bounds.r.h - v);
+		surface.stride = size.w * sizeof(*row);
+		surface.data = scale == 1 ? row : arg->row;
+
+		if (!aes_surface_draw_thumbnail(arg->aes_id, &surface,
+				option.samples, &arg->iterator, &arg->arena))
+			return false;
+	}
+
+	if (scale > 1)
+		memcpy(row, &arg->row[(y % scale) * size.w],
+			size.w * sizeof(*row));
+
+	return true;
+}
+
+/* PNG images are saved one per tree, numbered as <path>-<tree>.png. */
+static bool draw_rsc_png(const struct rsc *rsc, struct draw_rsc_arg *arg)
+{
+	const struct png_image_file_f f = {
+		.image = draw_rsc_image,
+		.row = draw_rsc_row
+	};
+	const size_t length = strlen(job->output) -
+		(strsuffix(".png", job->output) ? 4 : 0);
+
+	for (int i = 0; i < rsc->header->rsh_ntree; i++) {
+		struct strbuf sb = { };
+
+		if (!sbprintf(&sb, "%.*s-%02d.png",
+				(int)length, job->output, i))
+			return job_errno(job->output);
+
+		const bool valid = png_image_file(sb.s, &f, arg) ||
+			job_errno(sb.s);
+
+		free(sb.s);
 
-		const int n = x + clip.p.x - arg->clip.p.x;
+		if (!valid)
+			return false;
+	}
+
+	return true;
+}
+
+struct draw_rsc_atlas {
+	const struct rsc *rsc;
+	struct aes_area *bounds;
+	struct aes_area *areas;
+	struct aes_rectangle size;
+	struct tiff_pixel *pixels;
+	atomic_int next;
+	atomic_bool valid;
+};
 
-		BUG_ON(n < 0 || n >= ARRAY_SIZE(arg->buffer.px));
-		BUG_ON(n < 0 || n >= arg->clip.r.w);
-		BUG_ON(clip.r.w > ARRAY_SIZE(arg->buffer.px));
-		BUG_ON(clip.r.h != 1);
+static void draw_rsc_atlas_trees(aes_id_t aes_id,
+	struct draw_rsc_atlas *atlas)
+{
+	struct aes_surface_arena arena = { };
+	int i;
 
-		arg->buffer.px[n] = (struct tiff_pixel) {
-			.r = (0xffff * color.r + 500) / 1000,
-			.g = (0xffff * color.g + 500) / 1000,
-			.b = (0xffff * color.b + 500) / 1000,
-			.a =  0xffff
-		};
+	while ((i = atomic_fetch_add(&atlas->next, 1)) <
+			atlas->rsc->header->rsh_ntree && atlas->valid) {
+		struct aes_rsc_object_shape_iterator_arg iterator_arg;
+		struct aes_object_shape_iterator iterator =
+			aes_rsc_object_shape_iterator(aes_id,
+				rsc_tree_at_index(i, atlas->rsc), atlas->rsc,
+				&iterator_arg);
+		struct aes_surface surface = draw_rsc_surface(atlas->bounds[i]);
+		const struct aes_point p = atlas->areas[i].p;
+
+		/* Trees are disjoint, so threads never write the same pixels. */
+		surface.stride = atlas->size.w * sizeof(*atlas->pixels);
+		surface.data = &atlas->pixels[p.y * atlas->size.w + p.x];
+
+		if (!aes_surface_draw_thumbnail(aes_id, &surface,
+				option.samples, &iterator, &arena))
+			atlas->valid = false;
 	}
 
+	aes_surface_arena_free(&arena);
+}
+
+/* Helper threads open an AES of their own, as an AES is not shared. */
+static void *draw_rsc_atlas_worker(void *arg)
+{
+	struct draw_rsc_atlas *atlas = arg;
+	struct aes aes_ = { };
+	const aes_id_t aes_id = aes_appl_init(&aes_);
+
+	if (!aes_id_valid(aes_id)) {
+		atlas->valid = false;
+		return NULL;
+	}
+
+	draw_rsc_atlas_trees(aes_id, atlas);
+
+	aes_appl_exit(aes_id);
+
+	return NULL;
+}
+
+static bool draw_rsc_atlas_image(uint16_t *width, uint16_t *height,
+	void *arg)
+{
+	struct draw_rsc_atlas *atlas = arg;
+
+	*width  = atlas->size.w;
+	*height = atlas->size.h;
+
 	return true;
 }
 
-static bool draw_rsc_pixel(uint16_t x, uint16_t y,
-	struct tiff_pixel *pixel, void *arg_)
+static bool draw_rsc_atlas_row(uint16_t y, uint16_t width,
+	struct tiff_pixel *row, void *arg)
 {
-	struct draw_rsc_arg *arg = arg_;
+	struct draw_rsc_atlas *atlas = arg;
+
+	memcpy(row, &atlas->pixels[y * atlas->size.w], width * sizeof(*row));
+
+	return true;
+}
 
-	if (arg->buffer.i < arg->buffer.n)
-		goto draw;
+static bool save_rsc_atlas_index(const struct draw_rsc_atlas *atlas)
+{
+	struct strbuf sb = { };
+	bool valid = true;
+
+	for (int i = 0; i < atlas->rsc->header->rsh_ntree && valid; i++)
+		valid = sbprintf(&sb, "%d %d %d %d %d\n", i,
+			atlas->areas[i].p.x, atlas->areas[i].p.y,
+			atlas->areas[i].r.w, atlas->areas[i].r.h);
 
-	BUG_ON(x >= arg->bounds.r.w);
+	if (!valid || !file_write(job->atlas, sb.s, sb.length))
+		valid = job_errno(job->atlas);
 
-	arg->buffer = (struct draw_rsc_arg_pixel_buffer) { };
-	arg->buffer.n = min_t(size_t,
-		arg->bounds.r.w - x, ARRAY_SIZE(arg->buffer.px));
+	free(sb.s);
 
-	struct aes_point p = aes_point_add(arg->bounds.p,
-		(struct aes_point) { .x = x, .y = y });
-	arg->clip = (struct aes_area) {
-		.p = p,
-		.r = {
-			.w = arg->buffer.n,
-			.h = 1
-		},
+	return valid;
+}
+
+/*
+ * Draws all trees into a single image. The trees are packed in an atlas,
+ * and drawn in parallel directly into the pixels of the image, with the
+ * calling thread and helper threads taking the next tree to draw until
+ * all are done. Files are already drawn in parallel in batch mode, so
+ * then the calling thread draws alone.
+ */
+static bool draw_rsc_atlas(aes_id_t aes_id, const struct rsc *rsc)
+{
+	const int ntree = rsc->header->rsh_ntree;
+	struct draw_rsc_atlas atlas = {
+		.rsc = rsc,
+		.bounds = xmalloc(max(ntree, 1) * sizeof(*atlas.bounds)),
+		.areas = xmalloc(max(ntree, 1) * sizeof(*atlas.areas)),
+		.valid = true
 	};
+	const int jobs = option.batch ? 1 : clamp(ntree, 1, option.jobs);
+	pthread_t thread[jobs];
+	const struct tiff_image_file_f f = {
+		.image = draw_rsc_atlas_image,
+		.row = draw_rsc_atlas_row
+	};
+	bool valid = false;
+	int n = 0;
 
-	if (!aes_object_shape_layers(arg->clip,
-			&arg->iterator, draw_rsc_layer, arg))
-		return false;
+	if (!aes_id_valid(aes_id)) {
+		job_error("%s: Failed to open AES\n", job->input);
+		goto out;
+	}
 
-draw:
-	*pixel = arg->buffer.px[arg->buffer.i++];
+	for (int i = 0; i < ntree; i++) {
+		struct aes_rsc_object_shape_iterator_arg iterator_arg;
+		struct aes_object_shape_iterator iterator =
+			aes_rsc_object_shape_iterator(aes_id,
+				rsc_tree_at_index(i, rsc), rsc, &iterator_arg);
+		const struct aes_area bounds =
+			aes_object_shape_bounds(&iterator);
+		const struct aes_surface surface = draw_rsc_surface(bounds);
+
+		atlas.bounds[i] = bounds;
+		atlas.areas[i].r = aes_surface_size(&surface);
+	}
 
-	return true;
+	if (!aes_atlas_pack(&atlas.size, atlas.areas, ntree, 0)) {
+		job_errno("aes_atlas_pack");
+		goto out;
+	}
+
+	if (atlas.size.w > UINT16_MAX || atlas.size.h > UINT16_MAX) {
+		job_error("%s: atlas too large to draw\n", job->input);
+		goto out;
+	}
+
+	atlas.pixels = zalloc(max((size_t)atlas.size.w * atlas.size.h,
+		(size_t)1) * sizeof(*atlas.pixels));
+
+	for (; n < jobs - 1; n++)
+		if (pthread_create(&thread[n], NULL,
+				draw_rsc_atlas_worker, &atlas)) {
+			atlas.valid = false;
+			break;
+		}
+
+	draw_rsc_atlas_trees(aes_id, &atlas);
+
+	for (int i = 0; i < n; i++)
+		pthread_join(thread[i], NULL);
+
+	if (!atlas.valid) {
+		job_error("%s: Failed to draw atlas\n", job->input);
+		goto out;
+	}
+
+	if (option.png ?
+			!png_image_file(job->output,
+				&(const struct png_image_file_f) {
+					.image = f.image,
+					.row = f.row
+				}, &atlas) :
+			!tiff_image_file(job->output, 1, &f, &atlas)) {
+		job_errno(job->output);
+		goto out;
+	}
+
+	valid = save_rsc_atlas_index(&atlas);
+
+out:
+	free(atlas.pixels);
+	free(atlas.areas);
+	free(atlas.bounds);
+
+	return valid;
 }
 
-static bool draw_rsc(const struct rsc *rsc)
+static bool draw_rsc(aes_id_t aes_id, const struct rsc *rsc)
 {
-	struct aes aes_ = { };
 	struct draw_rsc_arg arg = {
 		.i = -1,
-		.aes_id = aes_appl_init(&aes_),
+		.aes_id = aes_id,
 		.rsc = rsc
 	};
 	const struct tiff_image_file_f f = {
 		.image = draw_rsc_image,
-		.pixel = draw_rsc_pixel
+		.row = draw_rsc_row
 	};
 
 	if (!aes_id_valid(arg.aes_id))
-		pr_fatal_error("%s: Failed to open AES\n", option.input);
+		return job_error("%s: Failed to open AES\n", job->input);
 
-	if (!tiff_image_file(option.output, rsc->header->rsh_ntree, &f, &arg))
-		pr_fatal_errno(option.output);
+	const int ntree = rsc->header->rsh_ntree;
+	const bool valid = option.png ? draw_rsc_png(rsc, &arg) :
+		tiff_image_file(job->output, ntree, &f, &arg) ||
+		job_errno(job->output);
 
-	aes_appl_exit(arg.aes_id);
+	aes_surface_arena_free(&arg.arena);
+	free(arg.row);
 
-	return true;
+	return valid;
+}
+
+static bool rsc_tree_object(const int16_t ob, const struct rsc_object *tree)
+{
+	for (int16_t k = 0; rsc_valid_ob(k); k = rsc_tree_traverse(k, tree))
+		if (k == ob)
+			return true;
+
+	return false;
+}
+
+/*
+ * Selection is toggled by inverting the object in place, if its pixels
+ * are exchanged by the selected state, and otherwise by redrawing the
+ * damage of the object. Averaged thumbnails are always redrawn in full.
+ */
+static bool draw_rsc_select(aes_id_t aes_id,
+	const struct aes_surface *surface, struct rsc_object *tree,
+	const struct rsc *rsc, struct aes_object_shape_iterator *iterator)
+{
+	const int16_t ob = option.select;
+	struct rsc_object *ro = &tree[ob];
+	struct aes_region damage = { };
+	bool valid;
+
+	if (!rsc_tree_object(ob, tree))
+		return job_error("%s: object %d out of range in tree %d\n",
+			job->input, ob, option.tree);
+
+	if (option.samples == 1 &&
+	    aes_rsc_object_toggle_selected(aes_id, surface, ob, tree, rsc))
+		return true;
+
+	valid = aes_rsc_object_damage(aes_id, &damage, ob, tree, rsc);
+	ro->shape.state.selected = !ro->shape.state.selected;
+	valid = valid &&
+		aes_rsc_object_damage(aes_id, &damage, ob, tree, rsc) &&
+		(aes_surface_reduction(surface) > 1 ?
+			aes_surface_draw_thumbnail(aes_id, surface,
+				option.samples, iterator, NULL) :
+			aes_surface_draw_region(aes_id, surface,
+				&damage, iterator, NULL));
+
+	aes_region_free(&damage);
+
+	return valid || job_errno(option.framebuffer);
+}
+
+/* Trees are validated by the lazily validated RSC file, if given. */
+static bool draw_rsc_framebuffer(aes_id_t aes_id, const struct rsc *rsc,
+	struct rsc_lazy *lazy)
+{
+	struct aes_rsc_object_shape_iterator_arg iterator_arg;
+	struct aes_framebuffer fb;
+
+	if (!aes_id_valid(aes_id))
+		return job_error("%s: Failed to open AES\n", job->input);
+
+	if (option.tree >= rsc->header->rsh_ntree)
+		return job_error("%s: tree %d out of range\n",
+			job->input, option.tree);
+
+	struct rsc_object *tree = lazy ?
+		rsc_lazy_tree_at_index(lazy, option.tree) :
+		rsc_tree_at_index(option.tree, rsc);
+
+	if (!tree)
+		return false;
+
+	struct aes_object_shape_iterator iterator =
+		aes_rsc_object_shape_iterator(aes_id, tree, rsc,
+			&iterator_arg);
+	const struct aes_surface surface = {
+		.format = option.pixel_format,
+		.area = aes_object_shape_bounds(&iterator),
+		.scale = option.scale,
+		.reduction = option.thumbnail
+	};
+
+	if (!aes_framebuffer_open(&fb, option.framebuffer, &surface))
+		return job_errno(option.framebuffer);
+
+	bool valid = aes_surface_draw_thumbnail(aes_id, &fb.surface,
+			option.samples, &iterator, NULL) ||
+		job_errno(option.framebuffer);
+
+	if (valid && option.select >= 0)
+		valid = draw_rsc_select(aes_id, &fb.surface,
+			tree, rsc, &iterator);
+
+	aes_framebuffer_close(&fb);
+
+	return valid;
+}
+
+static bool draw_rsc_framebuffer_lazy(aes_id_t aes_id,
+	const struct rsc *rsc, const struct rsc_diagnostic *diagnostic)
+{
+	struct rsc_lazy *lazy = rsc_lazy_open(rsc, diagnostic, NULL);
+
+	if (!lazy)
+		return errno == EINVAL ? false : job_errno(job->input);
+
+	const bool valid = draw_rsc_framebuffer(aes_id, rsc, lazy);
+
+	rsc_lazy_close(lazy);
+
+	return valid;
 }
 
 static void print_rsc_warning(const char *msg, void *arg)
 {
-	dprintf(STDERR_FILENO, "%s: warning: %s\n", option.input, msg);
+	fprintf(job->err, "%s: warning: %s\n", job->input, msg);
 }
 
 static void print_rsc_error(const char *msg, void *arg)
 {
-	dprintf(STDERR_FILENO, "%s: error: %s\n", option.input, msg);
+	fprintf(job->err, "%s: error: %s\n", job->input, msg);
 }
 
-int main(int argc, char *argv[])
+static bool process_rsc_file(aes_id_t aes_id, const struct rsc *rsc)
 {
-	parse_options(argc, argv);
+	static const struct rsc_diagnostic print_rsc_diagnostic = {
+		.warning = print_rsc_warning,
+		.error   = print_rsc_error,
+	};
+
+	if (option.identify) {
+		const bool valid = rsc_valid_structure(rsc);
+
+		/* Valid files are listed in batch mode. */
+		if (valid && option.batch)
+			fprintf(job->out, "%s\n", job->input);
+
+		return valid;
+	}
+
+	if (option.diagnostic)
+		return rsc_valid_structure_diagnostic(
+			rsc, &print_rsc_diagnostic, NULL);
+
+	/* Only the tree drawn into a framebuffer needs to be valid. */
+	if (option.framebuffer && !option.draw && !option.map)
+		return draw_rsc_framebuffer_lazy(aes_id,
+			rsc, &print_rsc_diagnostic);
+
+	if (!rsc_valid_structure_diagnostic(rsc, &print_rsc_diagnostic, NULL))
+		return false;
+
+	if (option.batch && (option.info || option.map))
+		fprintf(job->out, "%s:\n", job->input);
+
+	if (option.info && !print_rsc_info(rsc))
+		return false;
+
+	if (option.draw && option.atlas && !draw_rsc_atlas(aes_id, rsc))
+		return false;
+
+	if (option.draw && !option.atlas && !draw_rsc(aes_id, rsc))
+		return false;
+
+	if (option.framebuffer && !draw_rsc_framebuffer(aes_id, rsc, NULL))
+		return false;
+
+	if (option.map && !print_rsc_map(rsc))
+		return job_error("%s: malformed RSC structure\n", job->input);
+
+	return true;
+}
 
-	struct file f = file_read(option.input);
+static bool process_rsc(aes_id_t aes_id)
+{
+	struct file f = file_read(job->input);
 
 	if (!file_valid(&f))
-		pr_fatal_errno(option.input);
+		return job_errno(job->input);
 
 	const struct rsc rsc = {
 		.size = f.size,
 		.header = (struct rsc_header *)f.data
 	};
 
-	if (option.identify) {
-		const bool valid = rsc_valid_structure(&rsc);
+	const bool valid = process_rsc_file(aes_id, &rsc);
 
-		file_free(&f);
+	file_free(&f);
 
-		return valid ? EXIT_SUCCESS : EXIT_FAILURE;
-	}
+	return valid;
+}
 
-	static const struct rsc_diagnostic print_rsc_diagnostic = {
-		.warning = print_rsc_warning,
-		.error   = print_rsc_error,
-	};
+/**
+ * struct rsc_batch - RSC files to process in parallel
+ * @job: files in order of input
+ * @count: number of files
+ * @next: index of next file to process
+ * @mutex: lock for @job done
+ * @cond: signalled when a file has been processed
+ */
+struct rsc_batch {
+	struct rsc_job *job;
+	size_t count;
+	atomic_size_t next;
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+};
 
-	if (option.diagnostic) {
-		const bool valid = rsc_valid_structure_diagnostic(
-			&rsc, &print_rsc_diagnostic, NULL);
+static bool rsc_path(const char *path)
+{
+	const size_t length = strlen(path);
 
-		file_free(&f);
+	return length >= 4 && strcasecmp(&path[length - 4], ".rsc") == 0;
+}
 
-		return valid ? EXIT_SUCCESS : EXIT_FAILURE;
+static int rsc_path_compare(const void *a, const void *b)
+{
+	return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+static void rsc_batch_add_error(struct rsc_batch *batch, char *input,
+	const int error)
+{
+	batch->job = xrealloc(batch->job,
+		(batch->count + 1) * sizeof(*batch->job));
+	batch->job[batch->count++] = (struct rsc_job) {
+		.input = input,
+		.error = error
+	};
+}
+
+static void rsc_batch_add(struct rsc_batch *batch, char *input)
+{
+	rsc_batch_add_error(batch, input, 0);
+}
+
+/*
+ * Adds RSC files in a directory and its subdirectories, sorted by path.
+ * Paths that cannot be read are reported in order as errors of the batch.
+ */
+static void rsc_batch_add_dir(struct rsc_batch *batch, const char *path)
+{
+	DIR *dir = opendir(path);
+	const char *sep = strsuffix("/", path) ? "" : "/";
+	char **entry = NULL;
+	size_t count = 0;
+	struct dirent *d;
+
+	if (!dir) {
+		rsc_batch_add_error(batch, xstrdup(path), errno);
+		return;
 	}
 
-	if (!rsc_valid_structure_diagnostic(&rsc, &print_rsc_diagnostic, NULL))
-		goto err;
+	while ((d = readdir(dir))) {
+		if (strcmp(d->d_name, ".") == 0 || strcmp(d->d_name, "..") == 0)
+			continue;
 
-	if (option.info)
-		print_rsc_info(&rsc);
+		struct strbuf sb = { };
 
-	if (option.draw && !draw_rsc(&rsc))
-		goto err;
+		if (!sbprintf(&sb, "%s%s%s", path, sep, d->d_name))
+			pr_fatal_errno(path);
 
-	if (option.map && !print_rsc_map(&rsc)) {
-		pr_fatal_error("%s: malformed RSC structure\n", option.input);
+		entry = xrealloc(entry, (count + 1) * sizeof(*entry));
+		entry[count++] = sb.s;
+	}
+
+	closedir(dir);
+
+	qsort(entry, count, sizeof(*entry), rsc_path_compare);
 
-		goto err;
+	for (size_t i = 0; i < count; i++) {
+		struct stat st;
+
+		if (stat(entry[i], &st) == -1)
+			rsc_batch_add_error(batch, entry[i], errno);
+		else if (S_ISDIR(st.st_mode)) {
+			rsc_batch_add_dir(batch, entry[i]);
+			free(entry[i]);
+		} else if (rsc_path(entry[i]))
+			rsc_batch_add(batch, entry[i]);
+		else
+			free(entry[i]);
 	}
 
-	file_free(&f);
+	free(entry);
+}
+
+static void rsc_batch_add_path(struct rsc_batch *batch, const char *path)
+{
+	struct stat st;
+
+	if (stat(path, &st) == 0 && S_ISDIR(st.st_mode))
+		rsc_batch_add_dir(batch, path);
+	else
+		rsc_batch_add(batch, xstrdup(path));
+}
+
+static void rsc_batch_add_list(struct rsc_batch *batch, const char *path)
+{
+	struct file f = file_read_or_stdin(path);
+	struct string_split split;
+
+	if (!file_valid(&f))
+		pr_fatal_errno(path);
 
-	return EXIT_SUCCESS;
+	for_each_string_split (split, f.data, "\n")
+		if (!split.sep && split.length)
+			rsc_batch_add(batch, xstrndup(split.s, split.length));
 
-err:
 	file_free(&f);
+}
+
+/* Output file in a directory, named as the RSC file with a new suffix. */
+static char *rsc_batch_output(const char *dir, const char *input,
+	const char *suffix)
+{
+	const char *name = file_basename(input);
+	const size_t length = strlen(name) - (rsc_path(name) ? 4 : 0);
+	struct strbuf sb = { };
+
+	if (!sbprintf(&sb, "%s%s%.*s%s", dir, strsuffix("/", dir) ? "" : "/",
+			(int)length, name, suffix))
+		pr_fatal_errno(dir);
+
+	return sb.s;
+}
+
+/* Output and atlas paths are both named by the RSC file. */
+static const char *rsc_job_output(const struct rsc_job *job_)
+{
+	return job_->output ? job_->output : job_->atlas;
+}
+
+static int rsc_job_output_compare(const void *a, const void *b)
+{
+	const struct rsc_job *ja = *(const struct rsc_job * const *)a;
+	const struct rsc_job *jb = *(const struct rsc_job * const *)b;
+	const int c = strcmp(rsc_job_output(ja), rsc_job_output(jb));
+
+	return c ? c : ja < jb ? -1 : ja > jb;	/* Keep order of input */
+}
+
+/*
+ * Output and atlas paths are named by the RSC files only, so files with
+ * the same name in different directories would overwrite each other.
+ * All but the first of such files are reported as errors instead.
+ */
+static void rsc_batch_duplicates(struct rsc_batch *batch)
+{
+	struct rsc_job **sorted;
+
+	if (!option.output && !option.atlas)
+		return;
+
+	sorted = xmalloc(max(batch->count, (size_t)1) * sizeof(*sorted));
+	for (size_t i = 0; i < batch->count; i++)
+		sorted[i] = &batch->job[i];
+
+	qsort(sorted, batch->count, sizeof(*sorted), rsc_job_output_compare);
+
+	for (size_t i = 1, k = 0; i < batch->count; i++)
+		if (strcmp(rsc_job_output(sorted[k]),
+			   rsc_job_output(sorted[i])) == 0)
+			sorted[i]->duplicate = sorted[k]->input;
+		else
+			k = i;
+
+	free(sorted);
+}
+
+static bool process_rsc_job(aes_id_t aes_id)
+{
+	if (job->error) {
+		errno = job->error;
+
+		return job_errno(job->input);
+	}
+
+	if (job->duplicate)
+		return job_error("%s: same output name as %s\n",
+			job->input, job->duplicate);
+
+	return process_rsc(aes_id);
+}
+
+/*
+ * Every thread of the pool opens an AES of its own once, to draw all of
+ * its files with, since opening an AES loads the system fonts.
+ */
+static void *rsc_batch_worker(void *arg)
+{
+	struct rsc_batch *batch = arg;
+	struct aes aes_ = { };
+	const aes_id_t aes_id = aes_appl_init(&aes_);
+	size_t i;
+
+	while ((i = atomic_fetch_add(&batch->next, 1)) < batch->count) {
+		job = &batch->job[i];
+
+		job->out = open_memstream(&job->out_buf, &job->out_size);
+		job->err = open_memstream(&job->err_buf, &job->err_size);
+		if (!job->out || !job->err)
+			pr_fatal_errno(job->input);
+
+		job->valid = process_rsc_job(aes_id);
+
+		fclose(job->err);
+		fclose(job->out);
+
+		pthread_mutex_lock(&batch->mutex);
+		job->done = true;
+		pthread_cond_broadcast(&batch->cond);
+		pthread_mutex_unlock(&batch->mutex);
+	}
+
+	if (aes_id_valid(aes_id))
+		aes_appl_exit(aes_id);
+
+	return NULL;
+}
+
+/*
+ * Files are processed in parallel by a pool of threads, that take the
+ * next file until all are done. Text and errors of every file are
+ * buffered and displayed in order of input, as soon as all preceding
+ * files are done.
+ */
+static bool process_rsc_batch(void)
+{
+	struct rsc_batch batch = {
+		.mutex = PTHREAD_MUTEX_INITIALIZER,
+		.cond = PTHREAD_COND_INITIALIZER
+	};
+	bool valid = true;
+
+	if (option.list)
+		rsc_batch_add_list(&batch, option.list);
+	for (int i = 0; i < option.ninput; i++)
+		rsc_batch_add_path(&batch, option.inputs[i]);
+
+	const int jobs = clamp(batch.count, (size_t)1, (size_t)option.jobs);
+	pthread_t thread[jobs];
+
+	for (size_t i = 0; i < batch.count; i++) {
+		struct rsc_job *job_ = &batch.job[i];
+		const char *suffix = option.png ? ".png" : ".tiff";
+
+		if (option.output)
+			job_->output = rsc_batch_output(option.output,
+				job_->input, suffix);
+		if (option.atlas)
+			job_->atlas = rsc_batch_output(option.atlas,
+				job_->input, ".txt");
+	}
+
+	rsc_batch_duplicates(&batch);
+
+	for (int i = 0; i < jobs; i++)
+		if (pthread_create(&thread[i], NULL, rsc_batch_worker, &batch))
+			pr_fatal_error("Failed to create thread\n");
+
+	for (size_t i = 0; i < batch.count; i++) {
+		struct rsc_job *job_ = &batch.job[i];
+
+		pthread_mutex_lock(&batch.mutex);
+		while (!job_->done)
+			pthread_cond_wait(&batch.cond, &batch.mutex);
+		pthread_mutex_unlock(&batch.mutex);
+
+		fwrite(job_->out_buf, 1, job_->out_size, stdout);
+		fflush(stdout);
+		fwrite(job_->err_buf, 1, job_->err_size, stderr);
+
+		if (!job_->valid)
+			valid = false;
+
+		free(job_->err_buf);
+		free(job_->out_buf);
+		free(job_->atlas);
+		free(job_->output);
+		free(job_->input);
+	}
+
+	for (int i = 0; i < jobs; i++)
+		pthread_join(thread[i], NULL);
+
+	free(batch.job);
+
+	return valid;
+}
+
+int main(int argc, char *argv[])
+{
+	parse_options(argc, argv);
+
+	if (option.batch)
+		return process_rsc_batch() ? EXIT_SUCCESS : EXIT_FAILURE;
+
+	struct rsc_job job_ = {
+		.input = (char *)option.input,
+		.output = (char *)option.output,
+		.atlas = (char *)option.atlas,
+		.out = stdout,
+		.err = stderr
+	};
+
+	struct aes aes_ = { };
+	const aes_id_t aes_id = aes_appl_init(&aes_);
+
+	job = &job_;
+
+	const bool valid = process_rsc(aes_id);
+
+	if (aes_id_valid(aes_id))
+		aes_appl_exit(aes_id);
 
-	return EXIT_FAILURE;
+	return valid ? EXIT_SUCCESS : EXIT_FAILURE;
 }